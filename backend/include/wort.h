@@ -2,6 +2,7 @@
 #include "allocator.h"
 #include "primitives.h"
 #include <atomic>
+#include <cstddef>
 
 // 8-byte atomic pointer wrapper for WORT children
 struct AtomicChildPtr {
@@ -24,6 +25,13 @@ public:
   void put(uint64_t key, uint64_t value);
   bool get(uint64_t key, uint64_t &value);
 
+  // get for keys[0..n), with up to `group` lookups in flight: each one
+  // prefetches the child slot it reads next and hands over to the next
+  // lookup, so their misses overlap. Sets values[i] and found[i] like get;
+  // returns the number found.
+  size_t multi_get(const uint64_t *keys, size_t n, uint64_t *values,
+                   bool *found, size_t group = 8);
+
 private:
   Allocator *pmem;
   uint64_t root_offset; // Local root pointer (volatile) but points to PM
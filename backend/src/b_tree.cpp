@@ -114,6 +114,10 @@ void NVTree::scan(uint64_t start_key, size_t count,
   uint64_t offset = is_root_leaf ? root_leaf_offset : 0;
   while (offset != 0 && results.size() < count) {
     NVLeafNode *leaf = get_leaf(offset);
+    // Start pulling in the next leaf's header while this one is filtered.
+    if (leaf->next_leaf_offset != 0)
+      _mm_prefetch(reinterpret_cast<const char *>(get_leaf(leaf->next_leaf_offset)),
+                   _MM_HINT_T0);
     for (int i = 0; i < leaf->count; i++) {
       if (leaf->entries[i].key >= start_key) {
         results.push_back({leaf->entries[i].key, leaf->entries[i].value});
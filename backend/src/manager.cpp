@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -12,6 +14,27 @@
 #include "wort.h"
 
 
+// Reads the numbers of a flat JSON array such as "keys": [1, 2, 3].
+static std::vector<uint64_t> parse_u64_array(const std::string &line,
+                                             const std::string &field) {
+  std::vector<uint64_t> out;
+  size_t pos = line.find("\"" + field + "\"");
+  if (pos == std::string::npos)
+    return out;
+  size_t open = line.find('[', pos);
+  size_t close = line.find(']', open);
+  if (open == std::string::npos || close == std::string::npos)
+    return out;
+
+  std::string body = line.substr(open + 1, close - open - 1);
+  std::replace(body.begin(), body.end(), ',', ' ');
+  std::istringstream in(body);
+  uint64_t v;
+  while (in >> v)
+    out.push_back(v);
+  return out;
+}
+
 // Simple JSON-RPC Handler
 void handle_rpc(const std::string &line, NVTree *nvtree, WORT *wort,
                 Allocator *alloc) {
@@ -35,6 +58,31 @@ void handle_rpc(const std::string &line, NVTree *nvtree, WORT *wort,
       }
       std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+  } else if (line.find("putBatch") != std::string::npos) {
+    // {"method": "putBatch", "params": {"keys": [...], "values": [...]}}
+    // Values default to the key index. Applying in key order keeps
+    // consecutive puts on the same leaf.
+    std::vector<uint64_t> keys = parse_u64_array(line, "keys");
+    std::vector<uint64_t> values = parse_u64_array(line, "values");
+    std::vector<std::pair<uint64_t, uint64_t>> batch;
+    batch.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+      batch.emplace_back(keys[i], i < values.size() ? values[i] : i);
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &[key, value] : batch)
+      nvtree->put(key, value);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    std::cout << "{\"jsonrpc\": \"2.0\", \"method\": \"putBatch\", "
+                 "\"params\": {\"applied\": "
+              << batch.size() << ", \"ns_per_key\": "
+              << (batch.empty() ? 0 : elapsed / static_cast<long long>(batch.size()))
+              << "}}" << std::endl;
   } else if (line.find("getStructureSnapshot") != std::string::npos) {
     // Dump structure
   }
@@ -1,5 +1,7 @@
 #include "wort.h"
+#include <algorithm>
 #include <cstring>
+#include <immintrin.h>
 #include <iostream>
 
 WORT::WORT(Allocator *alloc) : pmem(alloc) {
@@ -80,3 +82,75 @@ bool WORT::get(uint64_t key, uint64_t &value) {
   }
   return false;
 }
+
+// A lookup is its key index, depth and current node. This tree builds as
+// C++17, so the lookups are advanced by hand rather than as coroutines.
+size_t WORT::multi_get(const uint64_t *keys, size_t n, uint64_t *values,
+                       bool *found, size_t group) {
+  struct Lookup {
+    size_t index;
+    int depth;
+    uint64_t offset;
+  };
+  const size_t max_group = 64;
+  group = std::min(std::max<size_t>(group, 1), max_group);
+  Lookup lookups[max_group];
+
+  // Depth 8 is the leaf, whose value and flag share its first line.
+  auto prefetch = [&](const Lookup &l) {
+    WORTNode *node = (WORTNode *)pmem->get_abs_addr(l.offset);
+    const void *line = &node->value;
+    if (l.depth < 8) {
+      uint8_t slice = (keys[l.index] >> (56 - l.depth * 8)) & 0xFF;
+      line = &node->children[slice].offset;
+    }
+    _mm_prefetch((const char *)line, _MM_HINT_T0);
+  };
+
+  size_t next = 0;
+  size_t active = 0;
+  size_t hits = 0;
+  for (; active < group && next < n; ++active) {
+    lookups[active] = {next++, 0, root_offset};
+    prefetch(lookups[active]);
+  }
+
+  while (active > 0) {
+    for (size_t s = 0; s < active;) {
+      Lookup &l = lookups[s];
+      WORTNode *node = (WORTNode *)pmem->get_abs_addr(l.offset);
+      bool done = false;
+      if (l.depth == 8) {
+        found[l.index] = node->is_leaf;
+        if (node->is_leaf) {
+          values[l.index] = node->value;
+          hits++;
+        }
+        done = true;
+      } else {
+        uint8_t slice = (keys[l.index] >> (56 - l.depth * 8)) & 0xFF;
+        uint64_t child =
+            node->children[slice].offset.load(std::memory_order_acquire);
+        if (child == 0) {
+          found[l.index] = false;
+          done = true;
+        } else {
+          l.offset = child;
+          l.depth++;
+        }
+      }
+
+      if (!done) {
+        prefetch(l);
+        ++s;
+      } else if (next < n) {
+        l = {next++, 0, root_offset};
+        prefetch(l);
+        ++s;
+      } else {
+        l = lookups[--active];
+      }
+    }
+  }
+  return hits;
+}
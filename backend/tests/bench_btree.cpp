@@ -0,0 +1,1148 @@
+#include "B_tree.h"
+#include "crc32c.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include "primitives.h"
+#include "sharded_tree.h"
+#include "simd_search.h"
+#include "value_log.h"
+#include "var_key.h"
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+// Micro-benchmarks for the persistent B+ tree. Each line is one JSON record
+// so results can be diffed or plotted like the engine's telemetry.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ns(Clock::time_point start, Clock::time_point end) {
+  return static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void report(const std::string &bench, const std::string &variant, int n,
+            double total_ns) {
+  std::cout << "{\"bench\": \"" << bench << "\", \"variant\": \"" << variant
+            << "\", \"n\": " << n << ", \"ns_per_op\": " << total_ns / n
+            << "}" << std::endl;
+}
+
+std::vector<std::uint64_t> random_keys(int n, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<std::uint64_t> keys(static_cast<std::size_t>(n));
+  for (auto &k : keys)
+    k = rng() >> 33; // fits a positive int
+  return keys;
+}
+
+template <typename Tree, typename MakeKey>
+void bench_key_type(const std::string &variant, MakeKey make_key) {
+  const int n = 2000;
+  Manager manager("bench_keys.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  Tree tree(&manager, config);
+  auto keys = random_keys(n, 42);
+
+  auto t0 = Clock::now();
+  for (int i = 0; i < n; i++)
+    tree.insert(make_key(keys[static_cast<std::size_t>(i)]),
+                typename Tree::value_type{});
+  auto t1 = Clock::now();
+  report("insert", variant, n, elapsed_ns(t0, t1));
+
+  typename Tree::value_type value{};
+  int found = 0;
+  t0 = Clock::now();
+  for (int rep = 0; rep < 50; rep++)
+    for (int i = 0; i < n; i++)
+      found += tree.search(make_key(keys[static_cast<std::size_t>(i)]), value);
+  t1 = Clock::now();
+  report("search", variant, n * 50, elapsed_ns(t0, t1));
+  if (found != n * 50)
+    std::cerr << "search miss in " << variant << std::endl;
+}
+
+void bench_key_types() {
+  bench_key_type<BTree>("int", [](std::uint64_t k) { return static_cast<int>(k); });
+  bench_key_type<U64BTree>("uint64", [](std::uint64_t k) { return k; });
+  bench_key_type<FixedKeyBTree<16>>("fixed16", [](std::uint64_t k) {
+    FixedKey<16> key{};
+    std::memcpy(key.bytes.data() + 8, &k, sizeof(k));
+    return key;
+  });
+}
+
+template <typename Tree>
+BTreeNode *find_leaf(Manager &manager, const Tree &tree, int max_keys,
+                     const typename Tree::key_type &key) {
+  auto *node = static_cast<BTreeNode *>(manager.offset_to_ptr(tree.root_offset()));
+  while (!node->is_leaf) {
+    auto *keys = Tree::get_internal_keys(node);
+    std::uint64_t *children = Tree::get_internal_children(node, max_keys);
+    std::uint32_t i = 0;
+    while (i < node->key_count && !(key < keys[i]))
+      i++;
+    node = static_cast<BTreeNode *>(manager.offset_to_ptr(children[i]));
+  }
+  return node;
+}
+
+std::uintptr_t line_of(const void *p) {
+  return reinterpret_cast<std::uintptr_t>(p) / 64;
+}
+
+// Distinct cache lines read when probing `leaf` for the entry in `slot`
+// (slot == leaf_capacity for a miss): a linear scan reads the live entries
+// up to slot, the fingerprint probe reads the fingerprint bytes plus
+// matching live entries only.
+template <typename Tree>
+std::pair<int, int> probe_lines(BTreeNode *leaf, int leaf_capacity,
+                                const typename Tree::key_type &key, int slot) {
+  auto *entries = Tree::get_leaf_entries(leaf, leaf_capacity);
+  std::uint8_t *fps = Tree::get_leaf_fingerprints(leaf);
+  std::uint64_t bitmap = *Tree::get_leaf_bitmap(leaf);
+  auto live = [&](int i) { return (bitmap >> i) & 1; };
+  int last = std::min(slot, leaf_capacity - 1);
+
+  std::vector<std::uintptr_t> linear{line_of(leaf)};
+  for (int i = 0; i <= last; i++) {
+    if (!live(i))
+      continue;
+    linear.push_back(line_of(&entries[i]));
+    linear.push_back(line_of(reinterpret_cast<const char *>(&entries[i] + 1) - 1));
+  }
+
+  std::vector<std::uintptr_t> fp{line_of(leaf), line_of(fps),
+                                 line_of(fps + leaf_capacity - 1)};
+  std::uint8_t want = Tree::fingerprint(key);
+  for (int i = 0; i <= last; i++) {
+    if (!live(i) || fps[i] != want)
+      continue;
+    fp.push_back(line_of(&entries[i]));
+    fp.push_back(line_of(reinterpret_cast<const char *>(&entries[i] + 1) - 1));
+  }
+
+  auto distinct = [](std::vector<std::uintptr_t> v) {
+    std::sort(v.begin(), v.end());
+    return static_cast<int>(std::unique(v.begin(), v.end()) - v.begin());
+  };
+  return {distinct(linear), distinct(fp)};
+}
+
+void bench_leaf_probe() {
+  const int n = 2000;
+  Manager manager("bench_probe.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  BTree tree(&manager, config);
+  auto keys = random_keys(n, 7);
+  for (std::uint64_t k : keys)
+    tree.insert(static_cast<int>(k), 1);
+
+  std::vector<int> misses;
+  int value;
+  for (std::uint64_t k : random_keys(n, 99))
+    if (!tree.search(static_cast<int>(k), value))
+      misses.push_back(static_cast<int>(k));
+
+  double hit_linear = 0, hit_fp = 0;
+  for (std::uint64_t k : keys) {
+    int key = static_cast<int>(k);
+    BTreeNode *leaf = find_leaf(manager, tree, config.max_keys, key);
+    auto *entries = BTree::get_leaf_entries(leaf, config.leaf_capacity);
+    std::uint64_t bitmap = *BTree::get_leaf_bitmap(leaf);
+    int slot = 0;
+    while (!((bitmap >> slot) & 1) || entries[slot].key != key)
+      slot++;
+    auto [lin, fp] = probe_lines<BTree>(leaf, config.leaf_capacity, key, slot);
+    hit_linear += lin;
+    hit_fp += fp;
+  }
+
+  double miss_linear = 0, miss_fp = 0;
+  for (int key : misses) {
+    BTreeNode *leaf = find_leaf(manager, tree, config.max_keys, key);
+    auto [lin, fp] = probe_lines<BTree>(leaf, config.leaf_capacity, key, config.leaf_capacity);
+    miss_linear += lin;
+    miss_fp += fp;
+  }
+
+  int found = 0;
+  auto t0 = Clock::now();
+  for (int rep = 0; rep < 50; rep++)
+    for (std::uint64_t k : keys)
+      found += tree.search(static_cast<int>(k), value);
+  auto t1 = Clock::now();
+  for (int rep = 0; rep < 50; rep++)
+    for (int key : misses)
+      found += tree.search(key, value);
+  auto t2 = Clock::now();
+
+  std::cout << "{\"bench\": \"leaf_probe\", \"variant\": \"hit\", \"n\": " << n
+            << ", \"lines_linear\": " << hit_linear / n
+            << ", \"lines_fingerprint\": " << hit_fp / n
+            << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / (n * 50) << "}"
+            << std::endl;
+  auto m = static_cast<double>(misses.size());
+  std::cout << "{\"bench\": \"leaf_probe\", \"variant\": \"miss\", \"n\": "
+            << misses.size() << ", \"lines_linear\": " << miss_linear / m
+            << ", \"lines_fingerprint\": " << miss_fp / m
+            << ", \"ns_per_op\": " << elapsed_ns(t1, t2) / (m * 50) << "}"
+            << std::endl;
+  if (found != n * 50)
+    std::cerr << "unexpected probe result" << std::endl;
+}
+
+// Point lookups through internal nodes of increasing fanout, with the
+// separator search forced to the scalar path and then the vector path.
+void bench_fanout() {
+  const int n = 3000;
+  auto keys = random_keys(n, 11);
+  for (int max_keys : {16, 64, 128, 256}) {
+    Manager manager("bench_fanout.dat", 2 * 1024 * 1024, 4096, true);
+    BTreeConfig config{max_keys, max_keys / 2, 32};
+    BTree tree(&manager, config);
+    for (std::uint64_t k : keys)
+      tree.insert(static_cast<int>(k), 1);
+
+    for (bool simd : {false, true}) {
+      bool active = enable_simd_separator_search(simd);
+      int value, found = 0;
+      auto t0 = Clock::now();
+      for (int rep = 0; rep < 50; rep++)
+        for (std::uint64_t k : keys)
+          found += tree.search(static_cast<int>(k), value);
+      auto t1 = Clock::now();
+      report("fanout_search",
+             std::to_string(max_keys) + (active ? "_simd" : "_scalar"), n * 50,
+             elapsed_ns(t0, t1));
+      if (found != n * 50)
+        std::cerr << "search miss at fanout " << max_keys << std::endl;
+    }
+  }
+  enable_simd_separator_search(true);
+}
+
+// Fully persistent vs leaves-only trees: cache lines flushed per insert,
+// lookup latency, and the cost of reopening (which rebuilds the DRAM index).
+void bench_persistence_mode() {
+  const int n = 3000;
+  auto keys = random_keys(n, 23);
+  for (PersistenceMode mode : {PersistenceMode::Full, PersistenceMode::LeavesOnly}) {
+    std::string variant = mode == PersistenceMode::Full ? "full" : "leaves_only";
+    {
+      Manager manager("bench_mode.dat", 4 * 1024 * 1024, 4096, true);
+      BTreeConfig config{16, 8, 32, mode};
+      BTree tree(&manager, config);
+
+      std::uint64_t lines = total_flushed_lines;
+      auto t0 = Clock::now();
+      for (std::uint64_t k : keys)
+        tree.insert(static_cast<int>(k), 1);
+      auto t1 = Clock::now();
+      std::cout << "{\"bench\": \"persist_mode_insert\", \"variant\": \"" << variant
+                << "\", \"n\": " << n << ", \"flushed_lines_per_op\": "
+                << static_cast<double>(total_flushed_lines - lines) / n
+                << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / n << "}" << std::endl;
+    }
+
+    auto t0 = Clock::now();
+    Manager manager("bench_mode.dat", 4 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+    auto t1 = Clock::now();
+    report("persist_mode_open", variant, 1, elapsed_ns(t0, t1));
+
+    int value, found = 0;
+    t0 = Clock::now();
+    for (int rep = 0; rep < 50; rep++)
+      for (std::uint64_t k : keys)
+        found += tree.search(static_cast<int>(k), value);
+    t1 = Clock::now();
+    report("persist_mode_search", variant, n * 50, elapsed_ns(t0, t1));
+    if (found != n * 50)
+      std::cerr << "search miss in " << variant << std::endl;
+  }
+}
+
+// Range of 100 consecutive keys read through scan() vs 100 point lookups.
+void bench_range_scan() {
+  const int n = 20000;
+  const int width = 100;
+  Manager manager("bench_scan.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (std::uint64_t k : random_keys(n, 17))
+    tree.insert(static_cast<int>(k % n), 1);
+
+  auto starts = random_keys(1000, 19);
+  long sum = 0;
+  auto t0 = Clock::now();
+  for (std::uint64_t s : starts) {
+    int lo = static_cast<int>(s % (n - width));
+    tree.scan(lo, lo + width, [&](int, int v) { sum += v; });
+  }
+  auto t1 = Clock::now();
+  int value;
+  for (std::uint64_t s : starts) {
+    int lo = static_cast<int>(s % (n - width));
+    for (int k = lo; k < lo + width; k++)
+      if (tree.search(k, value))
+        sum += value;
+  }
+  auto t2 = Clock::now();
+
+  int keys_read = 1000 * width;
+  report("range_scan", "scan", keys_read, elapsed_ns(t0, t1));
+  report("range_scan", "point_lookups", keys_read, elapsed_ns(t1, t2));
+  if (sum == 0)
+    std::cerr << "empty scan" << std::endl;
+}
+
+// Loading the same unsorted keys through insert() and bulk_load().
+void bench_bulk_load() {
+  const int n = 10000;
+  auto keys = random_keys(n, 29);
+  for (bool bulk : {false, true}) {
+    Manager manager("bench_bulk.dat", 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+
+    std::uint64_t lines = total_flushed_lines;
+    auto t0 = Clock::now();
+    if (bulk) {
+      std::vector<BTree::entry_type> entries;
+      entries.reserve(keys.size());
+      for (std::uint64_t k : keys)
+        entries.push_back({static_cast<int>(k), 1});
+      tree.bulk_load(std::move(entries));
+    } else {
+      for (std::uint64_t k : keys)
+        tree.insert(static_cast<int>(k), 1);
+    }
+    auto t1 = Clock::now();
+    std::cout << "{\"bench\": \"load\", \"variant\": \"" << (bulk ? "bulk_load" : "insert")
+              << "\", \"n\": " << n << ", \"flushed_lines_per_op\": "
+              << static_cast<double>(total_flushed_lines - lines) / n
+              << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / n << "}" << std::endl;
+  }
+}
+
+// Random keys ingested through insert_batch() at several batch sizes, on a
+// tree preloaded so most batches land in existing leaves.
+void bench_insert_batch() {
+  const int n = 8192;
+  for (std::size_t batch_size : {1u, 16u, 256u, 4096u}) {
+    Manager manager("bench_batch.dat", 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+    std::vector<BTree::entry_type> preload;
+    for (std::uint64_t k : random_keys(20000, 31))
+      preload.push_back({static_cast<int>(k), 0});
+    tree.bulk_load(std::move(preload), 0.5);
+
+    auto keys = random_keys(n, 37);
+    std::uint64_t lines = total_flushed_lines;
+    auto t0 = Clock::now();
+    for (std::size_t i = 0; i < keys.size(); i += batch_size) {
+      std::vector<BTree::entry_type> batch;
+      for (std::size_t j = i; j < std::min(keys.size(), i + batch_size); j++)
+        batch.push_back({static_cast<int>(keys[j]), 1});
+      tree.insert_batch(std::move(batch));
+    }
+    auto t1 = Clock::now();
+    std::cout << "{\"bench\": \"insert_batch\", \"variant\": \"batch_" << batch_size
+              << "\", \"n\": " << n << ", \"flushed_lines_per_op\": "
+              << static_cast<double>(total_flushed_lines - lines) / n
+              << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / n << "}" << std::endl;
+  }
+}
+
+// Delete-heavy churn: each round erases a fifth of the original keys. Live
+// nodes (counted by the GC, which also frees merged-away blocks) should
+// track the live keys, and a full scan should cost the same per key.
+// Flushed lines per single-key insert and erase against half-full leaves.
+// Slot-bitmap leaves commit an insert with the entry's line(s) plus the
+// header line and an erase with the header line alone; entry sizes that
+// do not divide 64 sometimes straddle a line boundary.
+template <typename Tree, typename MakeKey>
+void bench_leaf_commit_for(const std::string &variant, MakeKey make_key) {
+  const int n = 8192;
+  Manager manager("bench_commit.dat", 32 * 1024 * 1024, 4096, true);
+  Tree tree(&manager, BTreeConfig{16, 8, 32});
+  std::vector<typename Tree::entry_type> preload;
+  for (std::uint64_t k : random_keys(20000, 41))
+    preload.push_back({make_key(k * 2), {}});
+  std::ranges::sort(preload, [](const auto &a, const auto &b) { return a.key < b.key; });
+  preload.erase(std::unique(preload.begin(), preload.end(),
+                            [](const auto &a, const auto &b) { return a.key == b.key; }),
+                preload.end());
+  tree.bulk_load(std::move(preload), 0.5);
+
+  auto keys = random_keys(n, 43);
+  std::uint64_t lines = total_flushed_lines;
+  auto t0 = Clock::now();
+  for (std::uint64_t k : keys)
+    tree.insert(make_key(k * 2 + 1), typename Tree::value_type{});
+  auto t1 = Clock::now();
+  std::cout << "{\"bench\": \"leaf_commit\", \"variant\": \"" << variant
+            << "_insert\", \"n\": " << n << ", \"flushed_lines_per_op\": "
+            << static_cast<double>(total_flushed_lines - lines) / n
+            << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / n << "}" << std::endl;
+
+  lines = total_flushed_lines;
+  t0 = Clock::now();
+  for (std::uint64_t k : keys)
+    (void)tree.erase(make_key(k * 2 + 1));
+  t1 = Clock::now();
+  std::cout << "{\"bench\": \"leaf_commit\", \"variant\": \"" << variant
+            << "_erase\", \"n\": " << n << ", \"flushed_lines_per_op\": "
+            << static_cast<double>(total_flushed_lines - lines) / n
+            << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / n << "}" << std::endl;
+}
+
+void bench_leaf_commit() {
+  bench_leaf_commit_for<BTree>("int", [](std::uint64_t k) { return static_cast<int>(k); });
+  bench_leaf_commit_for<U64BTree>("uint64", [](std::uint64_t k) { return k; });
+  bench_leaf_commit_for<FixedKeyBTree<16>>("fixed16", [](std::uint64_t k) {
+    FixedKey<16> key{};
+    for (int i = 0; i < 8; i++)
+      key.bytes[static_cast<std::size_t>(15 - i)] = static_cast<std::uint8_t>(k >> (8 * i));
+    return key;
+  });
+}
+
+// YCSB-A style: 50% reads, 50% updates of preloaded keys drawn from a
+// Zipfian (theta 0.99). Blind inserts append a duplicate per update; upsert
+// overwrites in place, so the tree keeps its preload size.
+void bench_ycsb_a() {
+  const int records = 100000;
+  const int ops = 200000;
+  std::vector<double> cdf(records);
+  double sum = 0;
+  for (int i = 0; i < records; i++)
+    cdf[static_cast<std::size_t>(i)] = sum += 1.0 / std::pow(i + 1, 0.99);
+  std::mt19937_64 rng(51);
+  std::uniform_real_distribution<double> uniform(0, sum);
+  auto keys = random_keys(records, 53);
+  std::vector<int> trace(ops);
+  for (int &k : trace)
+    k = static_cast<int>(keys[static_cast<std::size_t>(
+        std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin())]);
+
+  for (bool use_upsert : {false, true}) {
+    BTreeConfig config{16, 8, 32};
+    Manager manager("bench_ycsb.dat", 64 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, config);
+    std::vector<BTree::entry_type> preload;
+    for (std::uint64_t k : keys)
+      preload.push_back({static_cast<int>(k), 0});
+    std::ranges::sort(preload, [](const auto &a, const auto &b) { return a.key < b.key; });
+    preload.erase(std::unique(preload.begin(), preload.end(),
+                              [](const auto &a, const auto &b) { return a.key == b.key; }),
+                  preload.end());
+    tree.bulk_load(std::move(preload), 0.7);
+
+    GarbageCollector gc(&manager);
+    gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+    int nodes_before = gc.nodes_marked();
+
+    std::uint64_t lines = total_flushed_lines;
+    int value;
+    int found = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < ops; i++) {
+      int k = trace[static_cast<std::size_t>(i)];
+      if (i % 2 == 0)
+        found += tree.search(k, value);
+      else if (use_upsert)
+        tree.upsert(k, i);
+      else
+        tree.insert(k, i);
+    }
+    auto t1 = Clock::now();
+    gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+    std::cout << "{\"bench\": \"ycsb_a\", \"variant\": \""
+              << (use_upsert ? "upsert" : "insert") << "\", \"n\": " << ops
+              << ", \"nodes_before\": " << nodes_before
+              << ", \"nodes_after\": " << gc.nodes_marked()
+              << ", \"flushed_lines_per_update\": "
+              << static_cast<double>(total_flushed_lines - lines) / (ops / 2)
+              << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / ops << "}" << std::endl;
+    if (found != ops / 2)
+      std::cerr << "ycsb_a read miss" << std::endl;
+  }
+}
+
+// The node checksum before CRC32C: one shift-and-mask step per bit.
+std::uint32_t crc32_bitwise(const std::uint8_t *p, std::size_t len) {
+  std::uint32_t crc = 0xFFFFFFFF;
+  for (std::size_t i = 0; i < len; i++) {
+    crc ^= p[i];
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+// Checksum cost per node size: the old bitwise loop, slicing-by-8 and the
+// interleaved SSE4.2 path, then what it does to single-key inserts.
+void bench_crc32c() {
+  std::vector<std::uint8_t> buf(16384);
+  std::mt19937 rng(40);
+  for (auto &b : buf)
+    b = static_cast<std::uint8_t>(rng());
+
+  std::uint32_t sink = 0;
+  for (std::size_t size : {64u, 256u, 512u, 1024u, 4096u, 16384u}) {
+    const int reps = static_cast<int>(4 * 1024 * 1024 / size);
+    auto t0 = Clock::now();
+    for (int i = 0; i < reps / 16; i++)
+      sink += crc32_bitwise(buf.data(), size);
+    auto t1 = Clock::now();
+    report("crc_bitwise", std::to_string(size) + "B", reps / 16, elapsed_ns(t0, t1));
+
+    for (bool hw : {false, true}) {
+      enable_hw_crc32c(hw);
+      t0 = Clock::now();
+      for (int i = 0; i < reps; i++)
+        sink += crc32c(buf.data(), size, sink);
+      t1 = Clock::now();
+      report(hw ? "crc32c_sse42" : "crc32c_slicing8", std::to_string(size) + "B", reps,
+             elapsed_ns(t0, t1));
+    }
+  }
+
+  for (bool hw : {false, true}) {
+    enable_hw_crc32c(hw);
+    Manager manager("bench_crc.dat", 64 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{64, 32, max_leaf_capacity});
+    auto keys = random_keys(50000, 45);
+    auto t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      tree.insert(static_cast<int>(k), 1);
+    auto t1 = Clock::now();
+    report("insert_checksum", hw ? "sse42" : "slicing8", 50000, elapsed_ns(t0, t1));
+  }
+  enable_hw_crc32c(true);
+  if (sink == 42)
+    std::cerr << "" << std::endl;
+}
+
+// Point lookups on a reopened region with and without read verification:
+// the first pass checks every node it reaches, later passes test one bit.
+void bench_verify_reads() {
+  const int n = 200000;
+  auto keys = random_keys(n, 47);
+  {
+    Manager manager("bench_verify.dat", 64 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+    std::vector<BTree::entry_type> preload;
+    for (std::uint64_t k : keys)
+      preload.push_back({static_cast<int>(k), 1});
+    std::ranges::sort(preload, [](const auto &a, const auto &b) { return a.key < b.key; });
+    preload.erase(std::unique(preload.begin(), preload.end(),
+                              [](const auto &a, const auto &b) { return a.key == b.key; }),
+                  preload.end());
+    tree.bulk_load(std::move(preload), 0.7);
+  }
+
+  for (bool verify : {false, true}) {
+    Manager manager("bench_verify.dat", 64 * 1024 * 1024, 4096, false);
+    BTreeConfig config{16, 8, 32};
+    config.verify_reads = verify;
+    BTree tree(&manager, config);
+    int value;
+    int found = 0;
+    for (int pass = 0; pass < 3; pass++) {
+      auto t0 = Clock::now();
+      for (std::uint64_t k : keys)
+        found += tree.search(static_cast<int>(k), value);
+      auto t1 = Clock::now();
+      report("verify_reads", std::string(verify ? "on" : "off") + "_pass" + std::to_string(pass),
+             n, elapsed_ns(t0, t1));
+    }
+    if (found != 3 * n)
+      std::cerr << "verify_reads miss" << std::endl;
+  }
+}
+
+// Zipf(0.99) point reads over 1M records with the lookup cache off and at
+// two budgets, plus one update per 20 reads to keep the cache coherent.
+void bench_lookup_cache() {
+  const int records = 1000000;
+  const int ops = 1000000;
+  std::vector<double> cdf(records);
+  double sum = 0;
+  for (int i = 0; i < records; i++)
+    cdf[static_cast<std::size_t>(i)] = sum += 1.0 / std::pow(i + 1, 0.99);
+  std::mt19937_64 rng(43);
+  std::uniform_real_distribution<double> uniform(0, sum);
+  auto keys = random_keys(records, 44);
+  std::vector<int> trace(ops);
+  for (int &k : trace)
+    k = static_cast<int>(keys[static_cast<std::size_t>(
+        std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin())]);
+
+  std::vector<BTree::entry_type> preload;
+  for (std::uint64_t k : keys)
+    preload.push_back({static_cast<int>(k), 0});
+  std::ranges::sort(preload, [](const auto &a, const auto &b) { return a.key < b.key; });
+  preload.erase(std::unique(preload.begin(), preload.end(),
+                            [](const auto &a, const auto &b) { return a.key == b.key; }),
+                preload.end());
+
+  for (std::size_t budget : {std::size_t{0}, std::size_t{256} << 10, std::size_t{4} << 20}) {
+    Manager manager("bench_lookup_cache.dat", 256 * 1024 * 1024, 4096, true);
+    BTreeConfig config{16, 8, 32};
+    config.lookup_cache_bytes = budget;
+    BTree tree(&manager, config);
+    tree.bulk_load(preload, 0.7);
+
+    int value;
+    int found = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < ops; i++) {
+      int k = trace[static_cast<std::size_t>(i)];
+      if (i % 20 == 19)
+        tree.upsert(k, i);
+      else
+        found += tree.search(k, value);
+    }
+    auto t1 = Clock::now();
+    LookupCacheStats stats = tree.lookup_cache_stats();
+    std::cout << "{\"bench\": \"lookup_cache\", \"variant\": \"" << (budget >> 10)
+              << "KB\", \"n\": " << ops << ", \"hit_rate\": " << stats.hit_rate
+              << ", \"hit_ns\": " << stats.hit_ns << ", \"miss_ns\": " << stats.miss_ns
+              << ", \"ns_per_op\": " << elapsed_ns(t0, t1) / ops << "}" << std::endl;
+    if (found != ops - ops / 20)
+      std::cerr << "lookup_cache read miss" << std::endl;
+  }
+}
+
+// stats() against the GC's mark walk it replaces for capacity planning.
+void bench_tree_stats() {
+  const int n = 500000;
+  auto keys = random_keys(n, 45);
+  BTreeConfig config{16, 8, 32};
+  Manager manager("bench_tree_stats.dat", 128 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, config);
+  for (std::uint64_t k : keys)
+    tree.insert(static_cast<int>(k), 1);
+
+  const int reads = 10000;
+  std::uint64_t sink = 0;
+  auto t0 = Clock::now();
+  for (int i = 0; i < reads; i++)
+    sink += tree.stats().entries;
+  auto t1 = Clock::now();
+  GarbageCollector gc(&manager);
+  gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+  auto t2 = Clock::now();
+  report("tree_stats", "stats", reads, elapsed_ns(t0, t1));
+  report("tree_stats", "gc_walk", 1, elapsed_ns(t1, t2));
+  if (sink != static_cast<std::uint64_t>(reads) * n)
+    std::cerr << "tree_stats entry count mismatch" << std::endl;
+}
+
+// Variable-length keys against 8-byte integers: the widest fanout each
+// fits in a block, then insert and search at that fanout for keys that fit
+// inline, random 32-byte keys, and URLs with a long shared prefix.
+template <typename Tree, typename MakeKey>
+void bench_var_key_type(const std::string &variant, int max_keys, MakeKey make_key) {
+  const int n = 100000;
+  auto keys = random_keys(n, 45);
+  std::vector<decltype(make_key(0))> made;
+  for (std::uint64_t k : keys)
+    made.push_back(make_key(k));
+  Manager manager("bench_var_keys.dat", 128 * 1024 * 1024, 4096, true);
+  Tree tree(&manager, BTreeConfig{max_keys, max_keys / 2, 32});
+
+  auto t0 = Clock::now();
+  for (const auto &key : made)
+    tree.insert(key, 1);
+  auto t1 = Clock::now();
+  report("var_key_insert", variant, n, elapsed_ns(t0, t1));
+
+  std::uint64_t value;
+  int found = 0;
+  t0 = Clock::now();
+  for (int rep = 0; rep < 5; rep++)
+    for (const auto &key : made)
+      found += tree.search(key, value);
+  t1 = Clock::now();
+  report("var_key_search", variant, n * 5, elapsed_ns(t0, t1));
+  if (found != n * 5)
+    std::cerr << "var_key search miss in " << variant << std::endl;
+}
+
+void bench_var_keys() {
+  auto widest = [](auto bytes) {
+    int m = 2;
+    while (bytes(m + 1) <= 4096)
+      m++;
+    return m;
+  };
+  int u64_fanout = widest([](int m) { return U64BTree::internal_node_bytes(m); });
+  int var_fanout =
+      widest([](int m) { return VarKeyBTree<>::tree_type::internal_node_bytes(m); });
+  std::cout << "{\"bench\": \"var_key_fanout\", \"uint64\": " << u64_fanout
+            << ", \"var_key\": " << var_fanout << "}" << std::endl;
+
+  bench_var_key_type<U64BTree>("uint64", u64_fanout, [](std::uint64_t k) { return k; });
+  bench_var_key_type<VarKeyBTree<>>("inline8", var_fanout, [](std::uint64_t k) {
+    std::string key(8, '\0');
+    for (int i = 0; i < 8; i++)
+      key[static_cast<std::size_t>(i)] = static_cast<char>(k >> (56 - 8 * i));
+    return key;
+  });
+  bench_var_key_type<VarKeyBTree<>>("random32", var_fanout, [](std::uint64_t k) {
+    std::mt19937_64 rng(k);
+    std::string key(32, '\0');
+    for (char &c : key)
+      c = static_cast<char>(rng());
+    return key;
+  });
+  bench_var_key_type<VarKeyBTree<>>("url", var_fanout, [](std::uint64_t k) {
+    return "https://example.com/api/v2/users/" + std::to_string(k) + "/profile";
+  });
+}
+
+// Point lookups one at a time against multi_get at growing group sizes, on
+// a tree whose nodes spread over far more memory than the caches hold.
+// Then batches of 256 keys, clustered in key space or scattered, through
+// each of search, multi_get and search_sorted_batch.
+void bench_multi_get() {
+  const int n = 1000000;
+  auto keys = random_keys(n, 47);
+  Manager manager("bench_multi_get.dat", 512 * 1024 * 1024, 4096, true);
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (std::uint64_t k : keys)
+    tree.insert(k, k);
+
+  std::mt19937_64 rng(48);
+  std::vector<std::uint64_t> probes(n);
+  for (std::uint64_t &p : probes)
+    p = keys[rng() % keys.size()];
+
+  std::uint64_t value;
+  std::size_t found = 0;
+  auto t0 = Clock::now();
+  for (std::uint64_t p : probes)
+    found += tree.search(p, value);
+  auto t1 = Clock::now();
+  report("multi_get", "search", n, elapsed_ns(t0, t1));
+
+  std::vector<std::uint64_t> values(probes.size());
+  auto hits = std::make_unique<bool[]>(probes.size());
+  for (std::size_t group : {1, 2, 4, 8, 16, 32, 64}) {
+    t0 = Clock::now();
+    found += tree.multi_get(probes, values, {hits.get(), probes.size()}, group);
+    t1 = Clock::now();
+    report("multi_get", "group_" + std::to_string(group), n, elapsed_ns(t0, t1));
+  }
+  if (found != static_cast<std::size_t>(n) * 8)
+    std::cerr << "multi_get missed keys" << std::endl;
+
+  // Clustered batches take 256 of the 4096 keys that follow a random one.
+  const std::size_t batch = 256;
+  std::vector<std::uint64_t> sorted = keys;
+  std::ranges::sort(sorted);
+  for (bool clustered : {true, false}) {
+    std::vector<std::uint64_t> batched;
+    while (batched.size() + batch <= probes.size()) {
+      std::size_t base = rng() % (sorted.size() - 4096);
+      for (std::size_t i = 0; i < batch; i++)
+        batched.push_back(clustered ? sorted[base + rng() % 4096] : keys[rng() % keys.size()]);
+    }
+    std::string shape = clustered ? "clustered_" : "scattered_";
+    std::size_t batches = batched.size() / batch;
+    int lookups = static_cast<int>(batched.size());
+    found = 0;
+
+    t0 = Clock::now();
+    for (std::uint64_t p : batched)
+      found += tree.search(p, value);
+    t1 = Clock::now();
+    report("sorted_batch", shape + "search", lookups, elapsed_ns(t0, t1));
+
+    t0 = Clock::now();
+    for (std::size_t b = 0; b < batches; b++)
+      found += tree.multi_get(std::span(batched).subspan(b * batch, batch),
+                              std::span(values).first(batch), {hits.get(), batch});
+    t1 = Clock::now();
+    report("sorted_batch", shape + "multi_get", lookups, elapsed_ns(t0, t1));
+
+    t0 = Clock::now();
+    for (std::size_t b = 0; b < batches; b++)
+      found += tree.search_sorted_batch(std::span(batched).subspan(b * batch, batch),
+                                        std::span(values).first(batch), {hits.get(), batch});
+    t1 = Clock::now();
+    report("sorted_batch", shape + "shared_descent", lookups, elapsed_ns(t0, t1));
+    if (found != batched.size() * 3)
+      std::cerr << "sorted_batch missed keys" << std::endl;
+  }
+}
+
+// Opening a region with the recovery pass at 1-8 threads against the plain
+// open, which only recounts the stats. ns_per_op is per node checked.
+void bench_recovery() {
+  const int n = 500000;
+  auto keys = random_keys(n, 46);
+  BTreeConfig config{16, 8, 32};
+  {
+    Manager manager("bench_recovery.dat", 128 * 1024 * 1024, 4096, true);
+    U64BTree tree(&manager, config);
+    for (std::uint64_t k : keys)
+      tree.insert(k, k);
+  }
+
+  Manager plain_manager("bench_recovery.dat", 128 * 1024 * 1024, 4096, false);
+  auto t0 = Clock::now();
+  U64BTree plain(&plain_manager, config);
+  auto t1 = Clock::now();
+  TreeStats stats = plain.stats();
+  int nodes = static_cast<int>(stats.leaves + stats.internal_nodes);
+  report("recovery", "open_recount", nodes, elapsed_ns(t0, t1));
+
+  for (unsigned threads : {1u, 2u, 4u, 8u}) {
+    BTreeConfig recovering = config;
+    recovering.recovery_threads = threads;
+    Manager manager("bench_recovery.dat", 128 * 1024 * 1024, 4096, false);
+    t0 = Clock::now();
+    U64BTree tree(&manager, recovering);
+    t1 = Clock::now();
+    const RecoveryReport &r = *tree.open_recovery();
+    report("recovery", "threads_" + std::to_string(threads), nodes, elapsed_ns(t0, t1));
+    std::cout << "{\"bench\": \"recovery_phases\", \"threads\": " << threads
+              << ", \"walk_ms\": " << r.walk_ms << ", \"bitmap_ms\": " << r.bitmap_ms
+              << ", \"repair_ms\": " << r.repair_ms << ", \"total_ms\": " << r.total_ms
+              << "}" << std::endl;
+    if (r.nodes_checked != static_cast<std::uint64_t>(nodes) || !r.corrupt_nodes.empty())
+      std::cerr << "recovery checked " << r.nodes_checked << " of " << nodes << std::endl;
+  }
+}
+
+// Upsert cost with no snapshot open (one atomic load) and with one open
+// (an undo record per write), then scans of the live tree and of a snapshot
+// that has n undo records to merge.
+void bench_snapshot() {
+  const int n = 100000;
+  auto keys = random_keys(n, 42);
+  Manager manager("bench_snapshot.dat", 64 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < n; k++)
+    tree.insert(k, k);
+
+  for (bool open : {false, true}) {
+    std::optional<BTree::Snapshot> snap;
+    if (open)
+      snap.emplace(tree.snapshot());
+    auto t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      tree.upsert(static_cast<int>(k % n), 1);
+    auto t1 = Clock::now();
+    report("snapshot", open ? "upsert_open" : "upsert_none", n, elapsed_ns(t0, t1));
+  }
+
+  auto snap = tree.snapshot();
+  std::uint64_t sums[3] = {};
+  auto t0 = Clock::now();
+  tree.scan(0, n, [&](int, int v) { sums[0] += static_cast<std::uint64_t>(v); });
+  auto t1 = Clock::now();
+  snap.scan(0, n, [&](int, int v) { sums[1] += static_cast<std::uint64_t>(v); });
+  auto t2 = Clock::now();
+  for (std::uint64_t k : keys)
+    tree.upsert(static_cast<int>(k % n), 2);
+  auto t3 = Clock::now();
+  snap.scan(0, n, [&](int, int v) { sums[2] += static_cast<std::uint64_t>(v); });
+  auto t4 = Clock::now();
+  report("snapshot", "scan_live", n, elapsed_ns(t0, t1));
+  report("snapshot", "scan_clean", n, elapsed_ns(t1, t2));
+  report("snapshot", "scan_" + std::to_string(tree.snapshot_undo_records()) + "_undo", n,
+         elapsed_ns(t3, t4));
+  if (sums[0] != sums[1] || sums[1] != sums[2])
+    std::cerr << "snapshot sum mismatch" << std::endl;
+}
+
+void bench_delete_heavy() {
+  const int n = 20000;
+  BTreeConfig config{16, 8, 32};
+  Manager manager("bench_delete.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, config);
+  auto keys = random_keys(n, 41);
+  for (std::uint64_t k : keys)
+    tree.insert(static_cast<int>(k), 1);
+
+  for (int round = 0; round <= 4; round++) {
+    if (round > 0)
+      for (int i = (round - 1) * n / 5; i < round * n / 5; i++)
+        (void)tree.erase(static_cast<int>(keys[static_cast<std::size_t>(i)]));
+
+    GarbageCollector gc(&manager);
+    gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+
+    int live = 0;
+    auto t0 = Clock::now();
+    for (int pass = 0; pass < 20; pass++)
+      tree.scan(0, std::numeric_limits<int>::max(), [&](int, int) { live++; });
+    auto t1 = Clock::now();
+    live /= 20;
+
+    std::cout << "{\"bench\": \"delete_heavy\", \"variant\": \"round_" << round
+              << "\", \"n\": " << live << ", \"live_nodes\": " << gc.nodes_marked()
+              << ", \"keys_per_node\": " << static_cast<double>(live) / gc.nodes_marked()
+              << ", \"scan_ns_per_key\": " << elapsed_ns(t0, t1) / (20.0 * live)
+              << "}" << std::endl;
+  }
+}
+
+// Long range scans over a tree whose touched lines exceed the LLC, sweeping
+// how many leaves the cursor prefetches ahead. Small blocks keep the region
+// to ~450 MB while leaves still cover ~450 MB of distinct lines.
+void bench_scan_prefetch() {
+  const std::uint64_t n = 12'000'000;
+  const int ranges = 200;
+  const int width = 20000;
+  Manager manager("bench_prefetch.dat", 512ull * 1024 * 1024, 1024, true);
+  {
+    U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+    std::vector<U64BTree::entry_type> entries(n);
+    for (std::uint64_t k = 0; k < n; k++)
+      entries[k] = {k * 2, k};
+    tree.bulk_load(std::move(entries));
+  }
+
+  auto starts = random_keys(ranges, 43);
+  auto run = [&](const std::string &variant, int depth, int willneed_after) {
+    BTreeConfig config{16, 8, 32};
+    config.scan_prefetch_leaves = depth;
+    config.scan_willneed_after = willneed_after;
+    U64BTree tree(&manager, config);
+
+    std::uint64_t sum = 0;
+    auto t0 = Clock::now();
+    for (std::uint64_t s : starts) {
+      std::uint64_t lo = (s % (n - width)) * 2;
+      tree.scan(lo, lo + 2 * width, [&](std::uint64_t, std::uint64_t v) { sum += v; });
+    }
+    auto t1 = Clock::now();
+    report("scan_prefetch", variant, ranges * width, elapsed_ns(t0, t1));
+    if (sum == 0)
+      std::cerr << "empty scan" << std::endl;
+  };
+  for (int depth : {0, 1, 2, 4, 8, 16})
+    run("depth_" + std::to_string(depth), depth, 0);
+  run("depth_4_willneed_64", 4, 64);
+
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  auto probes = random_keys(200000, 47);
+  std::uint64_t value = 0;
+  std::uint64_t hits = 0;
+  auto t0 = Clock::now();
+  for (std::uint64_t p : probes)
+    hits += tree.search((p % n) * 2, value);
+  auto t1 = Clock::now();
+  report("scan_prefetch", "point_lookup", static_cast<int>(probes.size()), elapsed_ns(t0, t1));
+  if (hits != probes.size())
+    std::cerr << "missing keys" << std::endl;
+}
+
+// Mixed workload (90% lookups, 10% inserts of fresh keys) on a preloaded
+// tree, scaling the number of threads sharing it.
+void bench_concurrent_mixed() {
+  const int preload = 20000;
+  const int ops_per_thread = 20000;
+  for (int threads : {1, 2, 4, 8, 16, 32}) {
+    Manager manager("bench_mixed.dat", 64 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+    auto keys = random_keys(preload, 5);
+    for (std::uint64_t k : keys)
+      tree.insert(static_cast<int>(k), 1);
+
+    std::vector<std::thread> pool;
+    auto t0 = Clock::now();
+    for (int t = 0; t < threads; t++) {
+      pool.emplace_back([&, t] {
+        std::mt19937_64 rng(static_cast<std::uint64_t>(t) + 100);
+        int value;
+        for (int i = 0; i < ops_per_thread; i++) {
+          if (i % 10 == 0)
+            tree.insert(static_cast<int>(rng() >> 33), 2);
+          else
+            (void)tree.search(static_cast<int>(keys[rng() % keys.size()]), value);
+        }
+      });
+    }
+    for (auto &th : pool)
+      th.join();
+    auto t1 = Clock::now();
+
+    double total_ops = static_cast<double>(threads) * ops_per_thread;
+    std::cout << "{\"bench\": \"concurrent_mixed\", \"variant\": \"" << threads
+              << "_threads\", \"n\": " << total_ops << ", \"mops\": "
+              << total_ops / elapsed_ns(t0, t1) * 1e3 << "}" << std::endl;
+  }
+}
+
+// Four client threads inserting and then looking up random keys: in one
+// tree they all share, and through ShardedBTree batches of 256 ops to 1-8
+// shards with pinned workers. Scaling needs as many cores as workers.
+void bench_sharded() {
+  const int n = 400000;
+  const int clients = 4;
+  const std::size_t batch = 256;
+  auto keys = random_keys(n, 49);
+  auto slice = [&](int c) {
+    return std::span(keys).subspan(static_cast<std::size_t>(n / clients * c),
+                                   static_cast<std::size_t>(n / clients));
+  };
+  auto run_clients = [&](auto &&fn) {
+    std::vector<std::thread> pool;
+    auto t0 = Clock::now();
+    for (int c = 0; c < clients; c++)
+      pool.emplace_back(fn, slice(c));
+    for (auto &th : pool)
+      th.join();
+    return elapsed_ns(t0, Clock::now());
+  };
+
+  {
+    Manager manager("bench_sharded.dat", 256 * 1024 * 1024, 4096, true);
+    U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+    report("sharded", "shared_tree_insert", n, run_clients([&](std::span<std::uint64_t> mine) {
+             for (std::uint64_t k : mine)
+               tree.insert(k, k);
+           }));
+    report("sharded", "shared_tree_search", n, run_clients([&](std::span<std::uint64_t> mine) {
+             std::uint64_t value;
+             for (std::uint64_t k : mine)
+               (void)tree.search(k, value);
+           }));
+  }
+
+  using Sharded = ShardedBTree<std::uint64_t, std::uint64_t>;
+  for (std::uint32_t shards : {1u, 2u, 4u, 8u}) {
+    Manager manager("bench_sharded.dat", 256 * 1024 * 1024, 4096, true);
+    Sharded tree(&manager, BTreeConfig{16, 8, 32}, ShardConfig{.shards = shards});
+    for (ShardOpType type : {ShardOpType::Insert, ShardOpType::Search}) {
+      double ns = run_clients([&](std::span<std::uint64_t> mine) {
+        std::vector<Sharded::op_type> ops(batch);
+        for (std::size_t i = 0; i < mine.size(); i += batch) {
+          std::size_t count = std::min(batch, mine.size() - i);
+          for (std::size_t j = 0; j < count; j++)
+            ops[j] = {type, mine[i + j], mine[i + j]};
+          tree.execute(std::span(ops).first(count));
+        }
+      });
+      report("sharded", std::to_string(shards) + "_shards_" +
+                            (type == ShardOpType::Insert ? "insert" : "search"),
+             n, ns);
+    }
+  }
+}
+
+} // namespace
+
+// 256-byte values stored in the leaves against the same values in a value
+// log, and 1 KiB values that no 4 KiB leaf could hold more than three of.
+// key_scan walks the keys alone; value_scan reads every value too.
+void bench_value_log() {
+  const int n = 100000;
+  auto keys = random_keys(n, 50);
+  std::vector<std::uint64_t> sorted = keys;
+  std::sort(sorted.begin(), sorted.end());
+
+  {
+    using Inline = BasicBTree<std::uint64_t, std::array<char, 256>>;
+    Manager manager("bench_value_log.dat", 256 * 1024 * 1024, 4096, true);
+    Inline tree(&manager, BTreeConfig{16, 8, 12});
+    std::array<char, 256> value{};
+    auto t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      tree.insert(k, value);
+    report("value_log", "inline_256_insert", n, elapsed_ns(t0, Clock::now()));
+    t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      (void)tree.search(k, value);
+    report("value_log", "inline_256_search", n, elapsed_ns(t0, Clock::now()));
+    std::uint64_t seen = 0;
+    t0 = Clock::now();
+    tree.scan(0, std::numeric_limits<std::uint64_t>::max(),
+              [&](std::uint64_t, const std::array<char, 256> &v) { seen += v[0] == 0; });
+    report("value_log", "inline_256_scan", n, elapsed_ns(t0, Clock::now()));
+    std::cout << "  inline_256 leaves: " << tree.stats().leaves << ", seen " << seen << std::endl;
+  }
+
+  for (std::size_t len : {256, 1024}) {
+    Manager manager("bench_value_log.dat", 256 * 1024 * 1024, 4096, true);
+    ValueLogBTree<std::uint64_t> tree(&manager, BTreeConfig{16, 8, 32});
+    std::string value(len, 'v');
+    std::string variant = "log_" + std::to_string(len);
+    auto t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      tree.insert(k, value);
+    report("value_log", variant + "_insert", n, elapsed_ns(t0, Clock::now()));
+    t0 = Clock::now();
+    for (std::uint64_t k : keys)
+      (void)tree.search(k, value);
+    report("value_log", variant + "_search", n, elapsed_ns(t0, Clock::now()));
+    std::uint64_t seen = 0;
+    t0 = Clock::now();
+    tree.tree().scan(0, std::numeric_limits<std::uint64_t>::max(),
+                     [&](std::uint64_t, std::uint64_t) { seen++; });
+    report("value_log", variant + "_key_scan", n, elapsed_ns(t0, Clock::now()));
+    t0 = Clock::now();
+    tree.scan(0, std::numeric_limits<std::uint64_t>::max(),
+              [&](std::uint64_t, std::string_view v) { seen += v.size() == len; });
+    report("value_log", variant + "_value_scan", n, elapsed_ns(t0, Clock::now()));
+
+    // Overwrite half, then compact what that left dead.
+    for (int i = 0; i < n; i += 2)
+      tree.upsert(keys[i], value);
+    t0 = Clock::now();
+    ValueLogCompaction pass = tree.compact(0.3, 1u << 20);
+    report("value_log", variant + "_compact_per_record", static_cast<int>(pass.records_moved),
+           elapsed_ns(t0, Clock::now()));
+    std::cout << "  " << variant << " leaves: " << tree.tree().stats().leaves << ", segments freed "
+              << pass.segments_freed << ", seen " << seen << std::endl;
+  }
+}
+
+int main() {
+  bench_key_types();
+  bench_leaf_probe();
+  bench_fanout();
+  bench_persistence_mode();
+  bench_range_scan();
+  bench_bulk_load();
+  bench_insert_batch();
+  bench_leaf_commit();
+  bench_ycsb_a();
+  bench_lookup_cache();
+  bench_crc32c();
+  bench_verify_reads();
+  bench_tree_stats();
+  bench_multi_get();
+  bench_var_keys();
+  bench_recovery();
+  bench_snapshot();
+  bench_delete_heavy();
+  bench_scan_prefetch();
+  bench_concurrent_mixed();
+  bench_sharded();
+  bench_value_log();
+  return 0;
+}
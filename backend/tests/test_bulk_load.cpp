@@ -0,0 +1,116 @@
+#include "B_tree.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include "radix_sort.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace atomic_tree;
+
+void test_radix_sort() {
+  std::cout << "\n=== Test 1: Parallel Radix Sort ===" << std::endl;
+
+  std::mt19937_64 rng(9);
+  std::vector<std::pair<std::uint64_t, int>> items(200000);
+  for (std::size_t i = 0; i < items.size(); i++)
+    items[i] = {rng() % 1000, static_cast<int>(i)};
+  auto expected = items;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](auto &a, auto &b) { return a.first < b.first; });
+
+  parallel_radix_sort(items, [](const auto &p) { return p.first; }, 4);
+  assert(items == expected);
+  std::cout << "✓ Matches std::stable_sort, ties keep input order" << std::endl;
+}
+
+void load_and_check(PersistenceMode mode, const char *file) {
+  const int n = 20000;
+  std::vector<BTree::entry_type> entries;
+  for (int i = 0; i < n; i++)
+    entries.push_back({(i * 7919) % n - n / 2, i});
+
+  {
+    Manager manager(file, 16 * 1024 * 1024, 4096, true);
+    BTreeConfig config{16, 8, 32, mode};
+    BTree tree(&manager, config);
+    tree.bulk_load(entries, 0.75);
+
+    int value;
+    for (const auto &e : entries)
+      assert(tree.search(e.key, value) && value == e.value);
+
+    int expected = -n / 2;
+    BTree::Cursor it = tree.cursor();
+    for (it.seek_to_first(); it.valid(); it.next())
+      assert(it.key() == expected++);
+    assert(expected == n / 2);
+
+    for (int i = 0; i < 1000; i++)
+      tree.insert(n + i, i);
+    assert(manager.verify_integrity());
+  }
+
+  Manager manager(file, 16 * 1024 * 1024, 4096, false);
+  assert(manager.verify_integrity());
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  int value;
+  assert(tree.search(-n / 2, value) && value == entries[0].value);
+  assert(tree.search(n / 2 - 1, value));
+  assert(tree.search(n + 999, value) && value == 999);
+
+  GarbageCollector gc(&manager);
+  gc.collect(tree.root_offset(), 16, 32);
+  assert(gc.blocks_freed() == 0);
+}
+
+void test_bulk_load() {
+  std::cout << "\n=== Test 2: Bulk Load Unsorted Input ===" << std::endl;
+  load_and_check(PersistenceMode::Full, "test_bulk_full.dat");
+  load_and_check(PersistenceMode::LeavesOnly, "test_bulk_leaves.dat");
+  std::cout << "✓ 20000 keys loaded, ordered, extended and reopened" << std::endl;
+}
+
+void test_fixed_keys_and_errors() {
+  std::cout << "\n=== Test 3: Comparison Sort And Preconditions ===" << std::endl;
+
+  Manager manager("test_bulk_fixed.dat", 4 * 1024 * 1024, 4096, true);
+  FixedKeyBTree<16> tree(&manager, BTreeConfig{16, 8, 32});
+  std::vector<FixedKeyBTree<16>::entry_type> entries(1000);
+  for (std::uint64_t i = 0; i < entries.size(); i++) {
+    std::uint64_t k = (i * 613) % 1000;
+    std::memcpy(entries[i].key.bytes.data() + 8, &k, sizeof(k));
+    entries[i].value = k;
+  }
+  tree.bulk_load(entries);
+
+  std::uint64_t value;
+  for (const auto &e : entries)
+    assert(tree.search(e.key, value) && value == e.value);
+  std::cout << "✓ Non-integer keys go through the comparison sort" << std::endl;
+
+  bool threw = false;
+  try {
+    tree.bulk_load(entries);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  std::cout << "✓ Loading into a non-empty tree is rejected" << std::endl;
+}
+
+int main() {
+  try {
+    test_radix_sort();
+    test_bulk_load();
+    test_fixed_keys_and_errors();
+    std::cout << "\n✅ ALL BULK LOAD TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
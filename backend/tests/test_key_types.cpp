@@ -0,0 +1,134 @@
+#include "B_tree.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace atomic_tree;
+
+void test_uint64_keys() {
+  std::cout << "\n=== Test 1: 64-bit Keys ===" << std::endl;
+
+  Manager manager("test_u64.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  U64BTree tree(&manager, config);
+
+  // Ids that collide once truncated to 32 bits.
+  const std::uint64_t base = 0x1234567800000000ULL;
+  for (std::uint64_t i = 0; i < 500; i++) {
+    tree.insert(base + i, i);
+    tree.insert((base << 1) + i, i + 1000);
+  }
+
+  std::uint64_t value;
+  for (std::uint64_t i = 0; i < 500; i++) {
+    assert(tree.search(base + i, value) && value == i);
+    assert(tree.search((base << 1) + i, value) && value == i + 1000);
+  }
+  assert(!tree.search(base + 10000, value));
+  assert(tree.erase(base + 7));
+  assert(!tree.search(base + 7, value));
+  std::cout << "✓ 1000 full-width ids stored without collisions" << std::endl;
+}
+
+FixedKey<16> make_key(const char *text) {
+  FixedKey<16> key{};
+  std::memcpy(key.bytes.data(), text, std::min<std::size_t>(16, std::strlen(text)));
+  return key;
+}
+
+void test_fixed_width_keys() {
+  std::cout << "\n=== Test 2: Fixed-Width Binary Keys ===" << std::endl;
+
+  Manager manager("test_fixed.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  FixedKeyBTree<16> tree(&manager, config);
+
+  char buf[17];
+  for (int i = 0; i < 300; i++) {
+    std::snprintf(buf, sizeof(buf), "user:%08d", i);
+    tree.insert(make_key(buf), static_cast<std::uint64_t>(i));
+  }
+
+  std::uint64_t value;
+  for (int i = 0; i < 300; i++) {
+    std::snprintf(buf, sizeof(buf), "user:%08d", i);
+    assert(tree.search(make_key(buf), value) && value == static_cast<std::uint64_t>(i));
+  }
+  assert(!tree.search(make_key("user:99999999"), value));
+  std::cout << "✓ 300 byte-string keys found across splits" << std::endl;
+
+  // The GC walks child pointers using the key size stored in the region.
+  GarbageCollector gc(&manager);
+  gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+  assert(gc.blocks_freed() == 0);
+  std::cout << "✓ GC marks every node of a non-int tree" << std::endl;
+}
+
+struct Point {
+  std::int32_t x;
+  std::int32_t y;
+};
+
+struct PointLess {
+  bool operator()(const Point &a, const Point &b) const noexcept {
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+  }
+};
+
+void test_user_struct_keys() {
+  std::cout << "\n=== Test 3: User Struct Keys ===" << std::endl;
+
+  Manager manager("test_struct.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{8, 4, 16};
+  BasicBTree<Point, double, PointLess> tree(&manager, config);
+
+  for (int x = 0; x < 20; x++)
+    for (int y = 0; y < 20; y++)
+      tree.insert(Point{x, y}, x * 0.5 + y);
+
+  double value;
+  assert(tree.search(Point{13, 7}, value) && value == 13 * 0.5 + 7);
+  assert(!tree.search(Point{20, 0}, value));
+  std::cout << "✓ Custom comparator orders struct keys" << std::endl;
+}
+
+void test_layout_mismatch_rejected() {
+  std::cout << "\n=== Test 4: Key Type Mismatch ===" << std::endl;
+
+  {
+    Manager manager("test_mismatch.dat", 1024 * 1024, 4096, true);
+    BTreeConfig config{16, 8, 32};
+    U64BTree tree(&manager, config);
+    tree.insert(1, 1);
+  }
+
+  Manager manager("test_mismatch.dat", 1024 * 1024, 4096, false);
+  BTreeConfig config{16, 8, 32};
+  bool threw = false;
+  try {
+    BTree tree(&manager, config);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  std::cout << "✓ Opening a uint64 region as an int tree fails" << std::endl;
+}
+
+int main() {
+  try {
+    test_uint64_keys();
+    test_fixed_width_keys();
+    test_user_struct_keys();
+    test_layout_mismatch_rejected();
+    std::cout << "\n✅ ALL KEY TYPE TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "B_tree.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+// Reachable blocks of a quiescent tree; the GC frees merged-away ones.
+int live_nodes(Manager &manager, BTree &tree, const BTreeConfig &config) {
+  GarbageCollector gc(&manager);
+  gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+  return gc.nodes_marked();
+}
+
+void test_shrinks_with_deletes(PersistenceMode mode, const char *file) {
+  std::cout << "\n=== Test 1: Delete-Heavy Shrink ("
+            << (mode == PersistenceMode::Full ? "full" : "leaves only") << ") ==="
+            << std::endl;
+
+  BTreeConfig config{16, 8, 32, mode};
+  std::vector<int> keys(20000);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(36));
+
+  {
+    Manager manager(file, 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, config);
+    for (int k : keys)
+      tree.insert(k, k + 1);
+    int full_nodes = live_nodes(manager, tree, config);
+
+    // Drop 95%, leaving every 20th key.
+    for (int k : keys) {
+      if (k % 20 != 0) {
+        bool erased = tree.erase(k);
+        assert(erased);
+        (void)erased;
+      }
+    }
+
+    int value;
+    for (int k = 0; k < 20000; k++)
+      assert(tree.search(k, value) == (k % 20 == 0) && (k % 20 != 0 || value == k + 1));
+    int expected = 0;
+    tree.scan(-1, 20000, [&](int k, int v) {
+      assert(k == expected && v == k + 1);
+      expected += 20;
+    });
+    assert(expected == 20000);
+
+    int shrunk_nodes = live_nodes(manager, tree, config);
+    assert(shrunk_nodes * 8 < full_nodes);
+    assert(manager.verify_integrity());
+    std::cout << "✓ " << full_nodes << " nodes at 20000 keys, " << shrunk_nodes
+              << " after deleting 95%" << std::endl;
+  }
+
+  // Merged internal nodes replace both halves, so no child is left
+  // referenced twice for recovery to find.
+  Manager manager(file, 16 * 1024 * 1024, 4096, false);
+  BTreeConfig reopen = config;
+  if (mode == PersistenceMode::Full)
+    reopen.recovery_threads = 2;
+  BTree tree(&manager, reopen);
+  if (mode == PersistenceMode::Full) {
+    const RecoveryReport &report = *tree.open_recovery();
+    assert(report.corrupt_nodes.empty() && report.splits_repaired == 0);
+  }
+  int value;
+  for (int k = 0; k < 20000; k++)
+    assert(tree.search(k, value) == (k % 20 == 0));
+  std::cout << "✓ merged tree reopens with the same contents" << std::endl;
+}
+
+void test_collapse_to_single_leaf() {
+  std::cout << "\n=== Test 2: Erase Everything ===" << std::endl;
+
+  Manager manager("test_merge_all.dat", 16 * 1024 * 1024, 4096, true);
+  BTreeConfig config{4, 2, 8};
+  BTree tree(&manager, config);
+  for (int k = 0; k < 3000; k++)
+    tree.insert(k, k);
+  for (int k = 2999; k >= 0; k--) {
+    bool erased = tree.erase(k);
+    assert(erased);
+    (void)erased;
+  }
+
+  // The root shrinks back to a lone leaf; nothing else stays reachable.
+  assert(live_nodes(manager, tree, config) == 1);
+  for (int k = 0; k < 100; k++)
+    tree.insert(k, -k);
+  int value;
+  assert(tree.search(42, value) && value == -42);
+  std::cout << "✓ tree collapsed to one leaf and accepts inserts again" << std::endl;
+}
+
+// Erasers, inserters and scanners run together; scans must stay sorted
+// and terminate while leaves under them are merged away.
+void test_concurrent_merges() {
+  std::cout << "\n=== Test 3: Concurrent Merges ===" << std::endl;
+
+  const int n = 40000;
+  Manager manager("test_merge_mt.dat", 32 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  BTree tree(&manager, config);
+  for (int k = 0; k < n; k += 2)
+    tree.insert(k, k);
+
+  std::atomic<bool> done{false};
+  std::atomic<int> bad_scans{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      // Even keys in this thread's quarter go away, odd ones arrive.
+      for (int k = t * n / 4; k < (t + 1) * n / 4; k += 2) {
+        if (!tree.erase(k))
+          bad_scans.fetch_add(1);
+        if (k % 8 == 0)
+          tree.insert(k + 1, k + 1);
+      }
+    });
+  }
+  threads.emplace_back([&] {
+    while (!done.load(std::memory_order_acquire)) {
+      int prev = -1;
+      tree.scan(0, n, [&](int k, int) {
+        if (k <= prev)
+          bad_scans.fetch_add(1);
+        prev = k;
+      });
+    }
+  });
+
+  for (int t = 0; t < 4; t++)
+    threads[static_cast<std::size_t>(t)].join();
+  done.store(true, std::memory_order_release);
+  threads.back().join();
+
+  assert(bad_scans.load() == 0);
+  int value;
+  int count = 0;
+  for (int k = 0; k < n; k++) {
+    bool expect = k % 8 == 1;
+    assert(tree.search(k, value) == expect);
+    count += expect;
+  }
+  int scanned = 0;
+  tree.scan(0, n, [&](int, int) { scanned++; });
+  assert(scanned == count);
+  assert(manager.verify_integrity());
+  std::cout << "✓ " << count << " keys left after concurrent erase/insert/scan" << std::endl;
+}
+
+int main() {
+  try {
+    test_shrinks_with_deletes(PersistenceMode::Full, "test_merge.dat");
+    test_shrinks_with_deletes(PersistenceMode::LeavesOnly, "test_merge_lo.dat");
+    test_collapse_to_single_leaf();
+    test_concurrent_merges();
+    std::cout << "\n✅ ALL LEAF MERGE TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "B_tree.h"
+#include "manager.h"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+BTreeConfig cached_config(std::size_t bytes) {
+  BTreeConfig config{16, 8, 32};
+  config.lookup_cache_bytes = bytes;
+  return config;
+}
+
+void test_cache_follows_writes() {
+  std::cout << "\n=== Test 1: Coherent With Writes ===" << std::endl;
+
+  Manager manager("test_lookup_cache.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, cached_config(1 << 20));
+  for (int k = 0; k < 5000; k++)
+    tree.insert(k, k);
+
+  int value;
+  for (int round = 0; round < 2; round++)
+    for (int k = 0; k < 5000; k++)
+      assert(tree.search(k, value) && value == k);
+  LookupCacheStats stats = tree.lookup_cache_stats();
+  assert(stats.misses == 5000 && stats.hits == 5000 && stats.entries == 5000);
+
+  // Every kind of write shows through on the next read, including the
+  // splits and merges they cause.
+  for (int k = 0; k < 5000; k += 3)
+    tree.upsert(k, -k);
+  for (int k = 1; k < 5000; k += 3)
+    assert(tree.erase(k));
+  tree.erase_batch({2, 5, 8});
+  tree.insert_batch({{2, 22}, {6000, 6000}});
+  for (int k = 6001; k < 9000; k++)
+    tree.insert(k, k);
+  for (int k = 0; k < 5000; k++) {
+    bool found = tree.search(k, value);
+    if (k % 3 == 0)
+      assert(found && value == -k);
+    else if (k % 3 == 1 || k == 5 || k == 8)
+      assert(!found);
+    else
+      assert(found && value == (k == 2 ? 22 : k));
+  }
+  assert(tree.search(6000, value) && value == 6000);
+  std::cout << "✓ upsert, erase and batches stay visible through the cache" << std::endl;
+}
+
+// A cache far smaller than the key space keeps a hot set resident while
+// a stream of cold keys passes through.
+void test_clock_keeps_hot_keys() {
+  std::cout << "\n=== Test 2: Bounded, Hot Keys Stay ===" << std::endl;
+
+  Manager manager("test_lookup_cache_clock.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, cached_config(16 * 1024));
+  for (int k = 0; k < 50000; k++)
+    tree.insert(k, k);
+  std::size_t capacity = tree.lookup_cache_stats().capacity;
+  assert(capacity > 0 && tree.lookup_cache_stats().bytes <= 16 * 1024);
+
+  int value;
+  int hot_hits = 0;
+  for (int round = 0; round < 20; round++) {
+    for (int k = 0; k < 64; k++) {
+      LookupCacheStats before = tree.lookup_cache_stats();
+      assert(tree.search(k * 700, value) && value == k * 700);
+      hot_hits += tree.lookup_cache_stats().hits > before.hits;
+    }
+    for (int k = round * 1000; k < round * 1000 + 1000; k++)
+      assert(tree.search(k * 2 + 1, value));
+  }
+  LookupCacheStats stats = tree.lookup_cache_stats();
+  assert(stats.entries <= capacity && stats.evictions > 0);
+  assert(hot_hits > 64 * 20 * 3 / 4);
+  tree.print_telemetry();
+  std::cout << "✓ " << hot_hits << "/1280 hot lookups hit a " << capacity
+            << "-entry cache" << std::endl;
+}
+
+// Each writer bumps its own keys; readers must never see a key go back to
+// an older value, which a fill racing an update would cause.
+void test_concurrent_coherence() {
+  std::cout << "\n=== Test 3: Concurrent Coherence ===" << std::endl;
+
+  const int n = 2000;
+  Manager manager("test_lookup_cache_mt.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, cached_config(64 * 1024));
+  for (int k = 0; k < n; k++)
+    tree.insert(k, 0);
+
+  std::atomic<bool> done{false};
+  std::atomic<int> regressions{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&, t] {
+      for (int v = 1; v <= 200; v++)
+        for (int k = t; k < n; k += 2)
+          tree.upsert(k, v);
+    });
+  }
+  for (int t = 0; t < 3; t++) {
+    threads.emplace_back([&] {
+      std::vector<int> seen(n, 0);
+      int value;
+      while (!done.load(std::memory_order_acquire)) {
+        for (int k = 0; k < n; k++) {
+          if (!tree.search(k, value) || value < seen[static_cast<std::size_t>(k)])
+            regressions.fetch_add(1);
+          else
+            seen[static_cast<std::size_t>(k)] = value;
+        }
+      }
+    });
+  }
+  threads[0].join();
+  threads[1].join();
+  done.store(true, std::memory_order_release);
+  for (std::size_t i = 2; i < threads.size(); i++)
+    threads[i].join();
+
+  assert(regressions.load() == 0);
+  int value;
+  for (int k = 0; k < n; k++)
+    assert(tree.search(k, value) && value == 200);
+  LookupCacheStats stats = tree.lookup_cache_stats();
+  std::cout << "✓ no stale reads, hit rate " << stats.hit_rate << std::endl;
+}
+
+int main() {
+  try {
+    test_cache_follows_writes();
+    test_clock_keeps_hot_keys();
+    test_concurrent_coherence();
+    std::cout << "\n✅ ALL LOOKUP CACHE TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,289 @@
+#include "B_tree.h"
+#include "manager.h"
+#include "var_key.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+void test_matches_search() {
+  std::cout << "\n=== Test 1: Same Results As search ===" << std::endl;
+
+  Manager manager("test_multi_get.dat", 64 * 1024 * 1024, 4096, true);
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  std::mt19937_64 rng(47);
+  std::vector<std::uint64_t> keys;
+  for (int i = 0; i < 20000; i++) {
+    keys.push_back(rng());
+    tree.insert(keys.back(), keys.back() / 3);
+  }
+  // Every other probe is absent.
+  std::vector<std::uint64_t> probes;
+  for (int i = 0; i < 10000; i++)
+    probes.push_back(i % 2 ? keys[rng() % keys.size()] : rng());
+
+  for (std::size_t group : {1, 3, 8, 64, 1000}) {
+    std::vector<std::uint64_t> values(probes.size(), 7);
+    auto found = std::make_unique<bool[]>(probes.size());
+    std::size_t hits = tree.multi_get(probes, values, {found.get(), probes.size()}, group);
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < probes.size(); i++) {
+      std::uint64_t value;
+      bool present = tree.search(probes[i], value);
+      assert(found[i] == present);
+      assert(!present || values[i] == value);
+      expected += present;
+    }
+    assert(hits == expected && hits >= 5000);
+  }
+
+  // Fewer keys than the group, and none at all.
+  std::uint64_t value;
+  bool hit;
+  assert(tree.multi_get(std::span(keys).first(1), std::span(&value, 1), std::span(&hit, 1)) == 1);
+  assert(hit && value == keys[0] / 3);
+  assert(tree.multi_get({}, {}, {}) == 0);
+  std::cout << "✓ group sizes 1-64 agree with search on 10000 probes" << std::endl;
+}
+
+void test_concurrent_writers() {
+  std::cout << "\n=== Test 2: Under Concurrent Writers ===" << std::endl;
+
+  Manager manager("test_multi_get_mt.dat", 64 * 1024 * 1024, 4096, true);
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  // Even keys stay put; writers churn odd ones, splitting and merging the
+  // leaves the readers descend through.
+  for (std::uint64_t k = 0; k < 40000; k += 2)
+    tree.insert(k, k + 1);
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; t++) {
+    writers.emplace_back([&, t] {
+      std::mt19937_64 rng(t);
+      while (!stop.load()) {
+        std::uint64_t k = (rng() % 20000) * 2 + 1;
+        if (rng() % 2)
+          tree.upsert(k, k);
+        else
+          (void)tree.erase(k);
+      }
+    });
+  }
+
+  std::vector<std::uint64_t> probes;
+  for (std::uint64_t k = 0; k < 40000; k += 2)
+    probes.push_back(k);
+  std::vector<std::uint64_t> values(probes.size());
+  auto found = std::make_unique<bool[]>(probes.size());
+  for (int round = 0; round < 20; round++) {
+    assert(tree.multi_get(probes, values, {found.get(), probes.size()}, 16) == probes.size());
+    for (std::size_t i = 0; i < probes.size(); i++)
+      assert(values[i] == probes[i] + 1);
+  }
+  stop.store(true);
+  for (auto &w : writers)
+    w.join();
+  std::cout << "✓ 20 rounds of 20000 stable keys read correctly while writers ran" << std::endl;
+}
+
+void test_cache_and_var_keys() {
+  std::cout << "\n=== Test 3: Lookup Cache And VarKeys ===" << std::endl;
+
+  Manager manager("test_multi_get_cache.dat", 32 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  config.lookup_cache_bytes = 64 * 1024;
+  U64BTree tree(&manager, config);
+  for (std::uint64_t k = 0; k < 5000; k++)
+    tree.insert(k, k * 2);
+  std::vector<std::uint64_t> probes{1, 2, 3, 9999, 1, 2, 3};
+  std::vector<std::uint64_t> values(probes.size());
+  auto found = std::make_unique<bool[]>(probes.size());
+  for (int round = 0; round < 2; round++)
+    assert(tree.multi_get(probes, values, {found.get(), probes.size()}, 4) == 6);
+  assert(!found[3] && values[4] == 2);
+  assert(tree.lookup_cache_stats().hits > 0);
+
+  Manager var_manager("test_multi_get_var.dat", 32 * 1024 * 1024, 4096, true);
+  VarKeyBTree<> var_tree(&var_manager, BTreeConfig{16, 8, 32});
+  std::vector<std::string> names;
+  for (int i = 0; i < 3000; i++) {
+    names.push_back("https://example.com/item/" + std::to_string(i));
+    var_tree.insert(names.back(), i);
+  }
+  names.push_back("short");
+  names.push_back("https://example.com/item/x");
+  std::vector<std::string_view> views(names.begin(), names.end());
+  std::vector<std::uint64_t> var_values(views.size());
+  auto var_found = std::make_unique<bool[]>(views.size());
+  assert(var_tree.multi_get(views, var_values, {var_found.get(), views.size()}) == 3000);
+  for (std::size_t i = 0; i < 3000; i++)
+    assert(var_found[i] && var_values[i] == i);
+  assert(!var_found[3000] && !var_found[3001]);
+  std::cout << "✓ cache hits served, VarKey lookups match" << std::endl;
+}
+
+void test_errors_propagate() {
+  std::cout << "\n=== Test 4: Errors Propagate ===" << std::endl;
+
+  {
+    Manager manager("test_multi_get_bad.dat", 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{16, 8, 32});
+    for (int k = 0; k < 2000; k++)
+      tree.insert(k, k);
+  }
+  Manager manager("test_multi_get_bad.dat", 16 * 1024 * 1024, 4096, false);
+  BTreeConfig config{16, 8, 32};
+  config.verify_reads = true;
+  BTree tree(&manager, config);
+  // A flipped value in the rightmost leaf.
+  auto *node = static_cast<BTreeNode *>(manager.offset_to_ptr(tree.root_offset()));
+  while (!node->is_leaf)
+    node = static_cast<BTreeNode *>(
+        manager.offset_to_ptr(BTree::get_internal_children(node, 16)[node->key_count]));
+  BTree::get_leaf_entries(node, 32)[std::countr_zero(*BTree::get_leaf_bitmap(node))].value ^= 1;
+
+  std::vector<int> probes{0, 1, 2, 1999};
+  std::vector<int> values(probes.size());
+  auto found = std::make_unique<bool[]>(probes.size());
+  bool threw = false;
+  try {
+    (void)tree.multi_get(probes, values, {found.get(), probes.size()});
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+
+  threw = false;
+  try {
+    (void)tree.multi_get(probes, std::span(values).first(2), {found.get(), probes.size()});
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  assert(threw);
+  std::cout << "✓ checksum failures and short spans throw" << std::endl;
+}
+
+void test_sorted_batch_matches_search() {
+  std::cout << "\n=== Test 5: Sorted Batch Matches search ===" << std::endl;
+
+  Manager manager("test_sorted_batch.dat", 64 * 1024 * 1024, 4096, true);
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (std::uint64_t k = 0; k < 60000; k += 3)
+    tree.insert(k, k * 5);
+
+  std::mt19937_64 rng(48);
+  auto check = [&](const std::vector<std::uint64_t> &probes) {
+    std::vector<std::uint64_t> values(probes.size());
+    auto found = std::make_unique<bool[]>(probes.size());
+    std::size_t hits = tree.search_sorted_batch(probes, values, {found.get(), probes.size()});
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < probes.size(); i++) {
+      assert(found[i] == (probes[i] % 3 == 0 && probes[i] < 60000));
+      assert(!found[i] || values[i] == probes[i] * 5);
+      expected += found[i];
+    }
+    assert(hits == expected);
+  };
+
+  // Scattered and unsorted; a clustered run; duplicates; already sorted;
+  // keys past both ends.
+  std::vector<std::uint64_t> scattered;
+  for (int i = 0; i < 5000; i++)
+    scattered.push_back(rng() % 70000);
+  check(scattered);
+  std::vector<std::uint64_t> clustered;
+  for (std::uint64_t k = 31000; k < 31600; k++)
+    clustered.push_back(k);
+  std::shuffle(clustered.begin(), clustered.end(), rng);
+  check(clustered);
+  check({9, 9, 9, 10, 9});
+  check({0, 3, 6, 59997, 59999, 60000, 1ULL << 63});
+  check({});
+
+  Manager var_manager("test_sorted_batch_var.dat", 32 * 1024 * 1024, 4096, true);
+  VarKeyBTree<> var_tree(&var_manager, BTreeConfig{16, 8, 32});
+  std::vector<std::string> names;
+  for (int i = 0; i < 3000; i++) {
+    names.push_back("tenant-7/object/" + std::to_string(i * 7 % 3000));
+    var_tree.insert(names.back(), i * 7 % 3000);
+  }
+  names.push_back("tenant-7/object/");
+  names.push_back("tenant-7/object/30000");
+  std::vector<std::string_view> views(names.begin(), names.end());
+  std::vector<std::uint64_t> values(views.size());
+  auto found = std::make_unique<bool[]>(views.size());
+  assert(var_tree.search_sorted_batch(views, values, {found.get(), views.size()}) == 3000);
+  for (std::size_t i = 0; i < 3000; i++)
+    assert(found[i] && values[i] == i * 7 % 3000);
+  std::cout << "✓ scattered, clustered, duplicate and boundary batches match search" << std::endl;
+}
+
+void test_sorted_batch_concurrent() {
+  std::cout << "\n=== Test 6: Sorted Batch Under Writers ===" << std::endl;
+
+  Manager manager("test_sorted_batch_mt.dat", 64 * 1024 * 1024, 4096, true);
+  U64BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (std::uint64_t k = 0; k < 40000; k += 2)
+    tree.insert(k, k + 1);
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; t++) {
+    writers.emplace_back([&, t] {
+      std::mt19937_64 rng(t + 10);
+      while (!stop.load()) {
+        std::uint64_t k = (rng() % 20000) * 2 + 1;
+        if (rng() % 2)
+          tree.upsert(k, k);
+        else
+          (void)tree.erase(k);
+      }
+    });
+  }
+
+  std::mt19937_64 rng(49);
+  for (int round = 0; round < 200; round++) {
+    std::uint64_t base = (rng() % 19000) * 2;
+    std::vector<std::uint64_t> probes;
+    for (int i = 0; i < 500; i++)
+      probes.push_back(base + (rng() % 1000) * 2);
+    std::vector<std::uint64_t> values(probes.size());
+    auto found = std::make_unique<bool[]>(probes.size());
+    assert(tree.search_sorted_batch(probes, values, {found.get(), probes.size()}) == probes.size());
+    for (std::size_t i = 0; i < probes.size(); i++)
+      assert(values[i] == probes[i] + 1);
+  }
+  stop.store(true);
+  for (auto &w : writers)
+    w.join();
+  std::cout << "✓ 200 clustered batches of stable keys read correctly while writers ran"
+            << std::endl;
+}
+
+int main() {
+  try {
+    test_matches_search();
+    test_concurrent_writers();
+    test_cache_and_var_keys();
+    test_errors_propagate();
+    test_sorted_batch_matches_search();
+    test_sorted_batch_concurrent();
+    std::cout << "\n✅ ALL MULTI-GET TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,328 @@
+#include "B_tree.h"
+#include "manager.h"
+#include "var_key.h"
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace atomic_tree;
+
+constexpr int max_keys = 16;
+
+BTreeNode *node_at(Manager &manager, std::uint64_t offset) {
+  return static_cast<BTreeNode *>(manager.offset_to_ptr(offset));
+}
+
+void build(const char *file, int n) {
+  Manager manager(file, 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+  for (int k = 0; k < n; k++)
+    tree.insert(k * 7919 % n, k * 7919 % n);
+}
+
+// The leftmost or rightmost node just above the leaves.
+std::uint64_t leaf_parent(Manager &manager, std::uint64_t offset, bool rightmost) {
+  for (;;) {
+    BTreeNode *node = node_at(manager, offset);
+    std::uint64_t child =
+        BTree::get_internal_children(node, max_keys)[rightmost ? node->key_count : 0];
+    if (node_at(manager, child)->is_leaf)
+      return offset;
+    offset = child;
+  }
+}
+
+BTreeConfig recovering(unsigned threads) {
+  BTreeConfig config{max_keys, 8, 32};
+  config.recovery_threads = threads;
+  return config;
+}
+
+// Drops separator i and child i + 1 from an internal node and reseals it,
+// as if the node had been split below and the crash came before the
+// parent learned of it.
+void drop_child(Manager &manager, std::uint64_t offset, std::uint32_t i) {
+  BTreeNode *node = node_at(manager, offset);
+  int *keys = BTree::get_internal_keys(node);
+  std::uint64_t *children = BTree::get_internal_children(node, max_keys);
+  for (std::uint32_t j = i; j + 1 < node->key_count; j++) {
+    keys[j] = keys[j + 1];
+    children[j + 1] = children[j + 2];
+  }
+  node->key_count--;
+  std::uint32_t crc = node_header_checksum(node);
+  crc = crc32c(keys, node->key_count * sizeof(int), crc);
+  node->checksum = crc32c(children, (node->key_count + 1) * sizeof(std::uint64_t), crc);
+  manager.update_block_checksum(offset);
+}
+
+void assert_complete(BTree &tree, int n) {
+  int value;
+  for (int k = 0; k < n; k++)
+    assert(tree.search(k, value) && value == k);
+  int expected = 0;
+  tree.scan(-1, n, [&](int key, int) { assert(key == expected++); });
+  assert(expected == n);
+}
+
+void test_clean_region() {
+  std::cout << "\n=== Test 1: Clean Region ===" << std::endl;
+
+  build("test_recovery.dat", 20000);
+  std::uint64_t nodes = 0;
+  for (unsigned threads : {1u, 2u, 4u}) {
+    Manager manager("test_recovery.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, recovering(threads));
+    const RecoveryReport &report = *tree.open_recovery();
+    assert(report.threads == threads);
+    assert(report.corrupt_nodes.empty() && report.splits_repaired == 0);
+    assert(report.blocks_freed == 0 && report.blocks_restored == 0);
+    assert(nodes == 0 || report.nodes_checked == nodes);
+    nodes = report.nodes_checked;
+
+    TreeStats stats = tree.stats();
+    assert(stats.entries == 20000 && stats.leaves + stats.internal_nodes == nodes);
+    assert(manager.verify_integrity());
+    assert_complete(tree, 20000);
+  }
+
+  Manager manager("test_recovery.dat", 16 * 1024 * 1024, 4096, false);
+  BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+  assert(!tree.open_recovery());
+  std::cout << "✓ " << nodes << " nodes checked alike by 1, 2 and 4 threads" << std::endl;
+}
+
+void test_bitmap_rebuilt() {
+  std::cout << "\n=== Test 2: Leaked And Lost Blocks ===" << std::endl;
+
+  build("test_recovery_bitmap.dat", 5000);
+  {
+    // Three blocks allocated for nodes that were never linked in, and a
+    // live node whose bit was cleared.
+    Manager manager("test_recovery_bitmap.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    for (int i = 0; i < 3; i++)
+      (void)manager.alloc_block();
+    BTreeNode *root = node_at(manager, tree.root_offset());
+    manager.free_block(BTree::get_internal_children(root, max_keys)[0]);
+  }
+
+  Manager manager("test_recovery_bitmap.dat", 16 * 1024 * 1024, 4096, false);
+  std::size_t before = manager.allocated_blocks();
+  BTree tree(&manager, recovering(2));
+  const RecoveryReport &report = *tree.open_recovery();
+  assert(report.corrupt_nodes.empty());
+  assert(report.blocks_freed == 3 && report.blocks_restored == 1);
+  assert(manager.allocated_blocks() == before - 2);
+  assert(manager.verify_integrity());
+
+  // New nodes land in the freed blocks, not on the restored one.
+  for (int k = 5000; k < 10000; k++)
+    tree.insert(k, k);
+  assert_complete(tree, 10000);
+  std::cout << "✓ 3 leaked blocks freed, 1 reachable block restored" << std::endl;
+}
+
+void test_unfinished_splits() {
+  std::cout << "\n=== Test 3: Unfinished Splits ===" << std::endl;
+
+  // Two leaves whose parents never received their separators.
+  build("test_recovery_split.dat", 20000);
+  {
+    Manager manager("test_recovery_split.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    for (bool rightmost : {false, true}) {
+      std::uint64_t parent = leaf_parent(manager, tree.root_offset(), rightmost);
+      drop_child(manager, parent, node_at(manager, parent)->key_count / 2);
+    }
+  }
+
+  std::uint64_t repaired = 0;
+  {
+    Manager manager("test_recovery_split.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, recovering(4));
+    const RecoveryReport &report = *tree.open_recovery();
+    assert(report.corrupt_nodes.empty() && !report.internal_rebuilt);
+    assert(report.splits_repaired == 2 && report.blocks_freed == 0);
+    repaired = report.splits_repaired;
+    assert(manager.verify_integrity());
+    assert_complete(tree, 20000);
+  }
+
+  // Reopened, the repaired tree needs nothing more.
+  Manager manager("test_recovery_split.dat", 16 * 1024 * 1024, 4096, false);
+  BTree tree(&manager, recovering(1));
+  assert(tree.open_recovery()->splits_repaired == 0);
+  assert(tree.stats().entries == 20000);
+  std::cout << "✓ " << repaired << " orphaned leaves linked back into their parents" << std::endl;
+}
+
+void test_lost_internal_split() {
+  std::cout << "\n=== Test 4: Lost Internal Split ===" << std::endl;
+
+  // The root forgets a whole internal node: every leaf below it is on the
+  // chain but unreachable, more than the left neighbour's parent can take.
+  build("test_recovery_internal.dat", 20000);
+  {
+    Manager manager("test_recovery_internal.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    drop_child(manager, tree.root_offset(), 0);
+  }
+
+  Manager manager("test_recovery_internal.dat", 16 * 1024 * 1024, 4096, false);
+  BTree tree(&manager, recovering(4));
+  const RecoveryReport &report = *tree.open_recovery();
+  assert(report.corrupt_nodes.empty());
+  assert(report.splits_repaired >= 8 && report.internal_rebuilt);
+  assert(report.blocks_freed > 0);   // the old internal nodes
+  assert(manager.verify_integrity());
+  assert_complete(tree, 20000);
+  TreeStats stats = tree.stats();
+  assert(stats.entries == 20000 && stats.height >= 2);
+  for (int k = 20000; k < 25000; k++)
+    tree.insert(k, k);
+  assert_complete(tree, 25000);
+  std::cout << "✓ " << report.splits_repaired << " orphans; internal levels rebuilt, "
+            << report.blocks_freed << " old blocks freed" << std::endl;
+}
+
+void test_corruption_reported() {
+  std::cout << "\n=== Test 5: Corruption Is Only Reported ===" << std::endl;
+
+  build("test_recovery_corrupt.dat", 5000);
+  std::uint64_t bad_leaf = 0;
+  {
+    Manager manager("test_recovery_corrupt.dat", 16 * 1024 * 1024, 4096, false);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    (void)manager.alloc_block();
+    BTreeNode *node = node_at(manager, tree.root_offset());
+    while (!node->is_leaf) {
+      bad_leaf = BTree::get_internal_children(node, max_keys)[1];
+      node = node_at(manager, bad_leaf);
+    }
+    BTree::get_leaf_entries(node, 32)[std::countr_zero(*BTree::get_leaf_bitmap(node))].value ^= 1;
+  }
+
+  for (unsigned threads : {1u, 3u}) {
+    Manager manager("test_recovery_corrupt.dat", 16 * 1024 * 1024, 4096, false);
+    std::size_t before = manager.allocated_blocks();
+    BTree tree(&manager, recovering(threads));
+    const RecoveryReport &report = *tree.open_recovery();
+    assert(report.corrupt_nodes == std::vector<std::uint64_t>{bad_leaf});
+    assert(report.blocks_freed == 0 && manager.allocated_blocks() == before);
+  }
+  std::cout << "✓ flipped leaf reported; bitmap left alone" << std::endl;
+}
+
+void test_key_tails_kept() {
+  std::cout << "\n=== Test 6: Key Tails Kept ===" << std::endl;
+
+  auto key = [](int i) { return std::string(60, 'k') + std::to_string(i); };
+  {
+    Manager manager("test_recovery_var.dat", 32 * 1024 * 1024, 4096, true);
+    VarKeyBTree<> tree(&manager, BTreeConfig{16, 8, 32});
+    for (int i = 0; i < 4000; i++)
+      tree.insert(key(i), i);
+    for (int i = 0; i < 4000; i += 2)
+      assert(tree.erase(key(i)));
+  }
+
+  Manager manager("test_recovery_var.dat", 32 * 1024 * 1024, 4096, false);
+  VarKeyBTree<> tree(&manager, recovering(2));
+  const RecoveryReport &report = *tree.tree().open_recovery();
+  assert(report.corrupt_nodes.empty() && report.blocks_restored == 0);
+  // Fresh tails must not land on blocks that surviving keys point into.
+  for (int i = 4000; i < 6000; i++)
+    tree.insert(key(i), i);
+  std::uint64_t value;
+  for (int i = 1; i < 6000; i++)
+    assert(tree.search(key(i), value) == (i % 2 == 1 || i >= 4000));
+  std::cout << "✓ tails of live keys kept; " << report.blocks_freed << " blocks freed" << std::endl;
+}
+
+void test_unclean_stop() {
+  std::cout << "\n=== Test 7: Checksum After An Unclean Stop ===" << std::endl;
+
+  // A copy taken while the region is open is what a crash leaves: every
+  // store in place, the checksum changes still in the owner's DRAM.
+  {
+    Manager manager("test_recovery_stop.dat", 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    for (int k = 0; k < 5000; k++)
+      tree.insert(k, k);
+    assert(manager.verify_integrity());
+    std::filesystem::copy_file("test_recovery_stop.dat", "test_recovery_stop_copy.dat",
+                               std::filesystem::copy_options::overwrite_existing);
+  }
+
+  for (const char *file : {"test_recovery_stop_copy.dat", "test_recovery_stop.dat"}) {
+    Manager manager(file, 16 * 1024 * 1024, 4096, false);
+    assert(manager.verify_integrity());
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    assert_complete(tree, 5000);
+  }
+  std::cout << "✓ checksum rebuilt from the blocks of a region that was never closed"
+            << std::endl;
+}
+
+void test_unfinished_merge() {
+  std::cout << "\n=== Test 8: Unfinished Leaf Merge ===" << std::endl;
+
+  // A merge drops the separator first, then copies right's entries into
+  // left, then unlinks right. A crash before the unlink leaves right on
+  // the chain with its entries in both leaves, which inserting them after
+  // the separator is gone reproduces.
+  const char *file = "test_recovery_merge.dat";
+  {
+    Manager manager(file, 16 * 1024 * 1024, 4096, true);
+    BTree tree(&manager, BTreeConfig{max_keys, 8, 32});
+    for (int k = 0; k < 2000; k++)
+      tree.insert(k, k);
+    std::uint64_t parent = leaf_parent(manager, tree.root_offset(), false);
+    std::uint64_t *children = BTree::get_internal_children(node_at(manager, parent), max_keys);
+    BTreeNode *left = node_at(manager, children[0]);
+    BTreeNode *right = node_at(manager, children[1]);
+    assert(BTree::leaf_size(left) + BTree::leaf_size(right) <= 32);
+    std::vector<int> moved;
+    const auto *entries = BTree::get_leaf_entries(right, 32);
+    for (std::uint64_t live = *BTree::get_leaf_bitmap(right); live != 0; live &= live - 1)
+      moved.push_back(entries[std::countr_zero(live)].key);
+
+    std::uint32_t left_size = BTree::leaf_size(left);
+    drop_child(manager, parent, 0);
+    for (int k : moved)
+      tree.insert(k, k);
+    assert(BTree::leaf_size(left) == left_size + moved.size());
+  }
+
+  Manager manager(file, 16 * 1024 * 1024, 4096, false);
+  BTree tree(&manager, recovering(2));
+  const RecoveryReport &report = *tree.open_recovery();
+  assert(report.corrupt_nodes.empty() && report.splits_repaired == 1);
+  assert(manager.verify_integrity());
+  assert_complete(tree, 2000);
+  assert(tree.stats().entries == 2000);
+  std::cout << "✓ right leaf linked back, left's copies of its entries dropped" << std::endl;
+}
+
+int main() {
+  try {
+    test_clean_region();
+    test_bitmap_rebuilt();
+    test_unfinished_splits();
+    test_lost_internal_split();
+    test_corruption_reported();
+    test_key_tails_kept();
+    test_unclean_stop();
+    test_unfinished_merge();
+    std::cout << "\n✅ ALL RECOVERY TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
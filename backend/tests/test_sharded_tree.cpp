@@ -0,0 +1,201 @@
+#include "B_tree.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include "sharded_tree.h"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+using ShardedU64 = ShardedBTree<std::uint64_t, std::uint64_t>;
+using Op = ShardedU64::op_type;
+
+std::uint64_t live_blocks(const ShardedU64 &tree) {
+  std::uint64_t blocks = 0;
+  for (std::uint32_t s = 0; s < tree.shard_count(); s++)
+    blocks += tree.shard(s).stats().live_blocks;
+  return blocks;
+}
+
+void test_hash_routing() {
+  std::cout << "\n=== Test 1: Hash Routing ===" << std::endl;
+
+  Manager manager("test_sharded.dat", 64 * 1024 * 1024, 4096, true);
+  ShardedU64 tree(&manager, BTreeConfig{16, 8, 32}, ShardConfig{.shards = 4});
+  for (std::uint64_t k = 0; k < 5000; k++)
+    tree.insert(k, k * 2);
+
+  std::vector<Op> ops;
+  for (std::uint64_t k = 5000; k < 20000; k++)
+    ops.push_back({ShardOpType::Insert, k, k * 2});
+  tree.execute(ops);
+
+  // Each shard holds exactly the keys routed to it, about a quarter.
+  for (std::uint32_t s = 0; s < 4; s++) {
+    std::uint64_t held = 0;
+    tree.shard(s).scan(0, 20000, [&](std::uint64_t key, std::uint64_t) {
+      assert(tree.shard_of(key) == s);
+      held++;
+    });
+    assert(held > 4000 && held < 6000);
+  }
+  assert(tree.stats().entries == 20000);
+
+  ops.clear();
+  for (std::uint64_t k = 0; k < 20000; k++)
+    ops.push_back({k % 2 ? ShardOpType::Erase : ShardOpType::Search, k});
+  ops.push_back({ShardOpType::Upsert, 1, 11});
+  ops.push_back({ShardOpType::Upsert, 2, 22});
+  tree.execute(ops);
+  for (std::uint64_t k = 0; k < 20000; k++)
+    assert(ops[k].found && (k % 2 || ops[k].value == k * 2));
+  assert(ops[20000].found && !ops[20001].found);
+
+  std::uint64_t value;
+  assert(tree.search(1, value) && value == 11);
+  assert(tree.search(2, value) && value == 22);
+  assert(!tree.search(3, value));
+  assert(tree.erase(4) && !tree.erase(4));
+  assert(tree.stats().entries == 10000);
+  std::cout << "✓ 20000 keys spread over 4 shards; batched and single ops agree" << std::endl;
+}
+
+void test_range_routing_reopen() {
+  std::cout << "\n=== Test 2: Range Routing Survives Reopen ===" << std::endl;
+
+  std::vector<std::uint64_t> splits{1000, 5000, 9000};
+  std::uint64_t allocated = 0;
+  {
+    Manager manager("test_sharded_range.dat", 64 * 1024 * 1024, 4096, true);
+    ShardedU64 tree(&manager, BTreeConfig{16, 8, 32},
+                    ShardConfig{.shards = 4, .routing = ShardRouting::Range}, splits);
+    std::vector<Op> ops;
+    for (std::uint64_t k = 0; k < 12000; k++)
+      ops.push_back({ShardOpType::Insert, k, k + 1});
+    tree.execute(ops);
+    assert(tree.shard(0).stats().entries == 1000 && tree.shard(3).stats().entries == 3000);
+    allocated = live_blocks(tree);
+  }
+
+  Manager manager("test_sharded_range.dat", 64 * 1024 * 1024, 4096, false);
+  assert(manager.verify_integrity());
+  // Blocks cached by the shards went back to the region: what is left is
+  // the nodes and the block of split keys.
+  assert(manager.allocated_blocks() - manager.reserved_blocks() == allocated + 1);
+
+  // The region's layout wins over the config given.
+  ShardedU64 tree(&manager, BTreeConfig{16, 8, 32}, ShardConfig{.shards = 2});
+  assert(tree.shard_count() == 4 && tree.routing() == ShardRouting::Range);
+  assert(std::vector<std::uint64_t>(tree.range_splits().begin(), tree.range_splits().end()) ==
+         splits);
+  assert(tree.shard_of(999) == 0 && tree.shard_of(1000) == 1 && tree.shard_of(9000) == 3);
+  std::uint64_t value;
+  for (std::uint64_t k = 0; k < 12000; k++)
+    assert(tree.search(k, value) && value == k + 1);
+  std::cout << "✓ 4 range shards reopened with their splits; cached blocks released" << std::endl;
+}
+
+void test_concurrent_clients() {
+  std::cout << "\n=== Test 3: Concurrent Clients ===" << std::endl;
+
+  Manager manager("test_sharded_clients.dat", 64 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  ShardedU64 tree(&manager, config, ShardConfig{.shards = 3, .queue_capacity = 4});
+
+  std::vector<std::thread> clients;
+  for (std::uint64_t c = 0; c < 4; c++) {
+    clients.emplace_back([&, c] {
+      std::vector<Op> ops;
+      for (std::uint64_t k = c; k < 40000; k += 4) {
+        ops.push_back({ShardOpType::Insert, k, k ^ 5});
+        if (ops.size() == 64) {
+          tree.execute(ops);
+          ops.clear();
+        }
+        if (k % 1000 == c)
+          tree.insert(k + 1000000, k);
+      }
+      tree.execute(ops);
+    });
+  }
+  for (auto &c : clients)
+    c.join();
+
+  std::uint64_t value;
+  for (std::uint64_t k = 0; k < 40000; k++)
+    assert(tree.search(k, value) && value == (k ^ 5));
+  assert(tree.stats().entries == 40160);
+
+  // The GC walks every shard, keeps the batches still cached, and walks on
+  // below cached blocks that are already nodes.
+  GarbageCollector gc(&manager);
+  gc.collect(tree.shard(0).root_offset(), config.max_keys, config.leaf_capacity);
+  std::vector<std::uint64_t> cached = manager.pinned_blocks();
+  assert(!cached.empty());
+  for (std::uint64_t offset : cached) {
+    std::uint64_t block = offset / manager.block_size();
+    assert(manager.get_bitmap()[block / 64] & (std::uint64_t{1} << (block % 64)));
+  }
+  assert(gc.blocks_freed() == 0 && gc.nodes_marked() == static_cast<int>(live_blocks(tree)));
+  for (std::uint64_t k = 40000; k < 45000; k++)
+    tree.insert(k, k ^ 5);
+  for (std::uint64_t k = 0; k < 45000; k++)
+    assert(tree.search(k, value) && value == (k ^ 5));
+  std::cout << "✓ 4 clients through 4-slot queues; GC kept all 3 shards" << std::endl;
+}
+
+void test_errors() {
+  std::cout << "\n=== Test 4: Errors ===" << std::endl;
+
+  auto throws = [](auto &&fn) {
+    try {
+      fn();
+    } catch (const std::runtime_error &) {
+      return true;
+    }
+    return false;
+  };
+  {
+    Manager manager("test_sharded_errors.dat", 16 * 1024 * 1024, 4096, true);
+    std::vector<std::uint64_t> unsorted{50, 10};
+    assert(throws([&] {
+      ShardedU64 tree(&manager, BTreeConfig{16, 8, 32},
+                      ShardConfig{.shards = 3, .routing = ShardRouting::Range}, unsorted);
+    }));
+    assert(throws([&] {
+      ShardedU64 tree(&manager, BTreeConfig{16, 8, 32}, ShardConfig{.shards = 65});
+    }));
+    BTreeConfig recovering{16, 8, 32};
+    recovering.recovery_threads = 1;
+    assert(throws([&] { ShardedU64 tree(&manager, recovering); }));
+
+    ShardedU64 tree(&manager, BTreeConfig{16, 8, 32});
+    assert(throws([&] { U64BTree single(&manager, recovering); }));
+  }
+  {
+    Manager manager("test_sharded_errors.dat", 16 * 1024 * 1024, 4096, true);
+    U64BTree single(&manager, BTreeConfig{16, 8, 32});
+    single.insert(1, 1);
+    assert(throws([&] { ShardedU64 tree(&manager, BTreeConfig{16, 8, 32}); }));
+  }
+  std::cout << "✓ bad splits, too many shards, recovery and single-tree regions refused"
+            << std::endl;
+}
+
+int main() {
+  try {
+    test_hash_routing();
+    test_range_routing_reopen();
+    test_concurrent_clients();
+    test_errors();
+    std::cout << "\n✅ ALL SHARDED TREE TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
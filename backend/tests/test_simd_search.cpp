@@ -0,0 +1,81 @@
+#include "B_tree.h"
+#include "manager.h"
+#include "simd_search.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace atomic_tree;
+
+template <typename T>
+void check_rank_matches_upper_bound(std::mt19937_64 &rng) {
+  for (std::uint32_t count = 0; count <= 256; count++) {
+    std::vector<T> keys(count);
+    for (auto &k : keys)
+      k = static_cast<T>(rng());
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<T> probes = {std::numeric_limits<T>::min(),
+                             std::numeric_limits<T>::max(), T{0}};
+    for (T k : keys)
+      probes.push_back(k);
+    for (int i = 0; i < 8; i++)
+      probes.push_back(static_cast<T>(rng()));
+
+    for (T probe : probes) {
+      auto expected = static_cast<std::uint32_t>(
+          std::upper_bound(keys.begin(), keys.end(), probe) - keys.begin());
+      assert(separator_rank(keys.data(), count, probe) == expected);
+    }
+  }
+}
+
+void test_rank_both_paths() {
+  std::cout << "\n=== Test 1: Vector And Scalar Rank ===" << std::endl;
+
+  std::mt19937_64 rng(1);
+  for (bool simd : {true, false}) {
+    bool active = enable_simd_separator_search(simd);
+    check_rank_matches_upper_bound<std::int32_t>(rng);
+    check_rank_matches_upper_bound<std::uint32_t>(rng);
+    check_rank_matches_upper_bound<std::int64_t>(rng);
+    check_rank_matches_upper_bound<std::uint64_t>(rng);
+    std::cout << "✓ " << (active ? "AVX2" : "scalar")
+              << " rank matches upper_bound for 0-256 keys" << std::endl;
+  }
+  enable_simd_separator_search(true);
+}
+
+void test_wide_fanout_tree() {
+  std::cout << "\n=== Test 2: 256-Key Internal Nodes ===" << std::endl;
+
+  Manager manager("test_wide.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{256, 128, 16};
+  BTree tree(&manager, config);
+
+  for (int i = 0; i < 3000; i++)
+    tree.insert((i * 7919) % 3000 - 1500, i);
+
+  int value;
+  for (int i = 0; i < 3000; i++)
+    assert(tree.search((i * 7919) % 3000 - 1500, value) && value == i);
+  assert(!tree.search(5000, value));
+  std::cout << "✓ Negative and positive keys found through wide nodes"
+            << std::endl;
+}
+
+int main() {
+  try {
+    test_rank_both_paths();
+    test_wide_fanout_tree();
+    std::cout << "\n✅ ALL SIMD SEARCH TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "B_tree.h"
+#include "manager.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+std::map<int, int> contents(const BTree::Snapshot &snap, int lo, int hi) {
+  std::map<int, int> out;
+  int prev = lo - 1;
+  snap.scan(lo, hi, [&](int k, int v) {
+    assert(k > prev);
+    prev = k;
+    out[k] = v;
+  });
+  return out;
+}
+
+void test_snapshot_ignores_later_writes() {
+  std::cout << "\n=== Test 1: Point-In-Time View ===" << std::endl;
+
+  Manager manager("test_snapshot.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  std::map<int, int> expected;
+  for (int k = 0; k < 4000; k += 2) {
+    tree.insert(k, k);
+    expected[k] = k;
+  }
+
+  auto snap = tree.snapshot();
+  assert(tree.snapshot_undo_records() == 0);
+  for (int k = 0; k < 4000; k += 6)
+    tree.upsert(k, -k);
+  for (int k = 2; k < 4000; k += 10)
+    assert(tree.erase(k));
+  for (int k = 1; k < 4000; k += 4)
+    tree.insert(k, k);
+  tree.erase_batch({4, 8, 12, 16});
+  tree.insert_batch({{3, 3}, {5000, 5000}});
+
+  assert(contents(snap, -1, 6000) == expected);
+  int value;
+  for (int k = 0; k < 4000; k++) {
+    bool found = snap.search(k, value);
+    assert(found == expected.contains(k) && (!found || value == k));
+  }
+  assert(!snap.search(5000, value));
+  assert(tree.search(5000, value) && tree.search(0, value) && value == 0);
+  assert(tree.search(6, value) && value == -6 && !tree.search(2, value));
+
+  // Ranges that start and end between leaves, and early stops.
+  std::map<int, int> part(expected.lower_bound(1001), expected.lower_bound(2999));
+  assert(contents(snap, 1001, 2999) == part);
+  int seen = 0;
+  snap.scan(0, 4000, [&](int, int) { return ++seen < 10; });
+  assert(seen == 10);
+  std::cout << "✓ snapshot keeps its " << expected.size() << " entries under "
+            << tree.snapshot_undo_records() << " later changes" << std::endl;
+}
+
+void test_undo_records_are_reclaimed() {
+  std::cout << "\n=== Test 2: Reclamation ===" << std::endl;
+
+  Manager manager("test_snapshot_gc.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < 1000; k++)
+    tree.insert(k, 0);
+
+  // No open snapshot, nothing logged.
+  for (int k = 0; k < 1000; k++)
+    tree.upsert(k, 1);
+  assert(tree.snapshot_undo_records() == 0);
+
+  auto older = tree.snapshot();
+  for (int k = 0; k < 1000; k++)
+    tree.upsert(k, 2);
+  auto newer = tree.snapshot();
+  for (int k = 0; k < 500; k++)
+    tree.upsert(k, 3);
+  assert(tree.snapshot_undo_records() == 1500);
+
+  int value;
+  assert(older.search(10, value) && value == 1);
+  assert(newer.search(10, value) && value == 2);
+  assert(newer.search(900, value) && value == 2);
+
+  // Releasing the older one frees the records only it could read.
+  { auto released = std::move(older); }
+  assert(tree.snapshot_undo_records() == 500);
+  assert(newer.search(10, value) && value == 2);
+  newer = tree.snapshot();
+  assert(tree.snapshot_undo_records() == 0);
+  { auto released = std::move(newer); }
+  tree.upsert(0, 4);
+  assert(tree.snapshot_undo_records() == 0);
+  std::cout << "✓ records dropped as snapshots close" << std::endl;
+}
+
+// Writers insert, update and erase through splits and merges while scans of
+// one snapshot keep returning the same contents.
+void test_concurrent_writers() {
+  std::cout << "\n=== Test 3: Concurrent Writers ===" << std::endl;
+
+  const int n = 20000;
+  Manager manager("test_snapshot_mt.dat", 64 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < n; k += 2)
+    tree.insert(k, k);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 3; t++) {
+    writers.emplace_back([&, t] {
+      std::mt19937 rng(static_cast<unsigned>(t));
+      while (!done.load(std::memory_order_acquire)) {
+        int k = static_cast<int>(rng() % (n - 1));
+        switch (rng() % 3) {
+        case 0: tree.upsert(k, -k); break;
+        case 1: (void)tree.erase(k); break;
+        default: tree.upsert(k + 1, k); break;
+        }
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  int rounds = 0;
+  for (int s = 0; s < 5; s++) {
+    auto snap = tree.snapshot();
+    std::map<int, int> first = contents(snap, -1, n);
+    for (int r = 0; r < 4; r++, rounds++) {
+      assert(contents(snap, -1, n) == first);
+      std::map<int, int> part(first.lower_bound(5000), first.lower_bound(7000));
+      assert(contents(snap, 5000, 7000) == part);
+    }
+    int value;
+    for (int k = 0; k < n; k += 97) {
+      bool found = snap.search(k, value);
+      assert(found == first.contains(k) && (!found || value == first[k]));
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &th : writers)
+    th.join();
+  assert(tree.snapshot_undo_records() == 0);
+  std::cout << "✓ " << rounds << " repeated scans matched their snapshot" << std::endl;
+}
+
+int main() {
+  try {
+    test_snapshot_ignores_later_writes();
+    test_undo_records_are_reclaimed();
+    test_concurrent_writers();
+    std::cout << "\n✅ ALL SNAPSHOT TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
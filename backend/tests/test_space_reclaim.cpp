@@ -0,0 +1,118 @@
+#include "B_tree.h"
+#include "manager.h"
+#include "primitives.h"
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+void test_punch_freed_blocks() {
+  std::cout << "\n=== Test 1: Punch Freed Blocks ===" << std::endl;
+
+  Manager manager("test_reclaim.dat", 4 * 1024 * 1024, 4096, true);
+  BTreeConfig config{16, 8, 32};
+  BTree tree(&manager, config);
+  tree.insert(1, 10);
+
+  std::vector<std::uint64_t> blocks;
+  for (int i = 0; i < 256; i++) {
+    std::uint64_t off = manager.alloc_block();
+    std::memset(manager.offset_to_ptr(off), 0xAB, manager.block_size());
+    persist(manager.offset_to_ptr(off), manager.block_size());
+    blocks.push_back(off);
+  }
+  manager.update_persistent_checksum();
+
+  std::uint64_t physical_before = manager.physical_file_size();
+  std::cout << "✓ Physical size with 256 live blocks: " << physical_before
+            << std::endl;
+
+  for (std::uint64_t off : blocks)
+    manager.free_block(off);
+
+  Manager::SpaceReclaimConfig reclaim;
+  reclaim.reuse_reserve_blocks = 0;
+  reclaim.min_free_age = std::chrono::milliseconds(0);
+  std::size_t allocated_before = manager.allocated_blocks();
+  std::size_t released = manager.reclaim_free_space(reclaim);
+  assert(released == 256 * manager.block_size());
+  assert(manager.allocated_blocks() == allocated_before);
+  assert(manager.physical_file_size() < physical_before);
+  assert(manager.logical_file_size() == manager.region_size());
+  std::cout << "✓ Released " << released << " bytes, physical now "
+            << manager.physical_file_size() << std::endl;
+
+  assert(manager.verify_integrity());
+  int value;
+  assert(tree.search(1, value) && value == 10);
+  std::cout << "✓ Region checksum and tree intact after punching" << std::endl;
+
+  // The runs are only held while the punch runs; afterwards they are free.
+  assert(manager.alloc_block() == blocks[0]);
+  std::cout << "✓ Punched blocks are free again after the pass" << std::endl;
+}
+
+void test_reuse_reserve_skipped() {
+  std::cout << "\n=== Test 2: Reuse Reserve Is Kept ===" << std::endl;
+
+  Manager manager("test_reclaim_reserve.dat", 1024 * 1024, 4096, true);
+
+  std::vector<std::uint64_t> blocks;
+  for (int i = 0; i < 32; i++)
+    blocks.push_back(manager.alloc_block());
+  for (std::uint64_t off : blocks)
+    manager.free_block(off);
+
+  Manager::SpaceReclaimConfig reclaim;
+  reclaim.reuse_reserve_blocks = 8;
+  reclaim.min_free_age = std::chrono::milliseconds(0);
+  std::size_t released = manager.reclaim_free_space(reclaim);
+  assert(released == 24 * manager.block_size());
+  std::cout << "✓ Lowest 8 free blocks left mapped for reuse" << std::endl;
+
+  // Reallocated blocks are dropped from the pending list, not punched.
+  std::uint64_t reused = manager.alloc_block();
+  assert(reused == blocks[0]);
+  assert(manager.reclaim_free_space(reclaim) == 0);
+  std::cout << "✓ Reallocated block is never punched" << std::endl;
+}
+
+void test_background_reclaimer() {
+  std::cout << "\n=== Test 3: Background Reclaimer ===" << std::endl;
+
+  Manager manager("test_reclaim_bg.dat", 1024 * 1024, 4096, true);
+  std::uint64_t off = manager.alloc_block();
+  std::memset(manager.offset_to_ptr(off), 0xCD, manager.block_size());
+  persist(manager.offset_to_ptr(off), manager.block_size());
+  manager.free_block(off);
+
+  Manager::SpaceReclaimConfig reclaim;
+  reclaim.interval = std::chrono::milliseconds(10);
+  reclaim.reuse_reserve_blocks = 0;
+  reclaim.min_free_age = std::chrono::milliseconds(0);
+  manager.start_space_reclaimer(reclaim);
+
+  for (int i = 0; i < 100 && manager.punched_bytes() == 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  manager.stop_space_reclaimer();
+
+  assert(manager.punched_bytes() == manager.block_size());
+  std::cout << "✓ Background pass released the freed block" << std::endl;
+}
+
+int main() {
+  try {
+    test_punch_freed_blocks();
+    test_reuse_reserve_skipped();
+    test_background_reclaimer();
+    std::cout << "\n✅ ALL SPACE RECLAIM TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
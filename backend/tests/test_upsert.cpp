@@ -0,0 +1,201 @@
+#include "B_tree.h"
+#include "garbage_collector.h"
+#include "manager.h"
+#include "primitives.h"
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace atomic_tree;
+
+template <typename Tree>
+int live_nodes(Manager &manager, Tree &tree, const BTreeConfig &config) {
+  GarbageCollector gc(&manager);
+  gc.collect(tree.root_offset(), config.max_keys, config.leaf_capacity);
+  return gc.nodes_marked();
+}
+
+void test_updates_do_not_grow() {
+  std::cout << "\n=== Test 1: Updates Stay In Place ===" << std::endl;
+
+  BTreeConfig config{16, 8, 32};
+  Manager manager("test_upsert.dat", 16 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, config);
+  for (int k = 0; k < 5000; k++) {
+    bool inserted = tree.upsert(k, k);
+    assert(inserted);
+    (void)inserted;
+  }
+  int nodes = live_nodes(manager, tree, config);
+
+  // Value store plus the header line carrying the refreshed checksum.
+  std::mt19937 rng(39);
+  for (int round = 1; round <= 20; round++) {
+    for (int i = 0; i < 5000; i++) {
+      int k = static_cast<int>(rng() % 5000);
+      std::uint64_t before = total_flushed_lines;
+      bool inserted = tree.upsert(k, k + round * 10000);
+      assert(!inserted && total_flushed_lines - before == 2);
+      (void)inserted;
+    }
+  }
+  assert(live_nodes(manager, tree, config) == nodes);
+
+  int count = 0;
+  int prev = -1;
+  tree.scan(-1, 5000, [&](int k, int v) {
+    assert(k > prev && v % 10000 == k);
+    prev = k;
+    count++;
+  });
+  assert(count == 5000);
+  assert(manager.verify_integrity());
+  std::cout << "✓ 100000 updates, no duplicates, still " << nodes << " nodes" << std::endl;
+}
+
+void test_full_leaf_is_not_split() {
+  std::cout << "\n=== Test 2: Full Leaf ===" << std::endl;
+
+  Manager manager("test_upsert_full.dat", 4 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < 32; k++)
+    tree.insert(k, k);
+  std::uint64_t root = tree.root_offset();
+
+  for (int k = 0; k < 32; k++)
+    tree.upsert(k, -k);
+  assert(tree.root_offset() == root);
+
+  // A new key still splits it.
+  assert(tree.upsert(32, 32));
+  assert(tree.root_offset() != root);
+  int value;
+  for (int k = 0; k < 32; k++)
+    assert(tree.search(k, value) && value == -k);
+  std::cout << "✓ updating a full leaf leaves it unsplit" << std::endl;
+}
+
+// 16-byte values cannot be stored atomically and move to a free slot.
+void test_wide_values() {
+  std::cout << "\n=== Test 3: Wide Values ===" << std::endl;
+
+  using Wide = std::array<std::uint32_t, 4>;
+  using WideTree = BasicBTree<int, Wide>;
+  Manager manager("test_upsert_wide.dat", 16 * 1024 * 1024, 4096, true);
+  WideTree tree(&manager, BTreeConfig{16, 8, 16});
+  for (int round = 0; round < 5; round++)
+    for (int k = 0; k < 2000; k++)
+      tree.upsert(k, Wide{static_cast<std::uint32_t>(k), 0, 0,
+                          static_cast<std::uint32_t>(round)});
+
+  int count = 0;
+  tree.scan(-1, 2000, [&](int k, const Wide &v) {
+    assert(v[0] == static_cast<std::uint32_t>(k) && v[3] == 4);
+    count++;
+  });
+  assert(count == 2000);
+  assert(manager.verify_integrity());
+  std::cout << "✓ 10000 upserts of 16-byte values, one entry per key" << std::endl;
+}
+
+void test_update_only() {
+  std::cout << "\n=== Test 4: Update Without Insert ===" << std::endl;
+
+  Manager manager("test_update.dat", 4 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < 1000; k += 2)
+    tree.insert(k, k);
+  int updated = 0;
+  for (int k = 0; k < 1000; k++)
+    updated += tree.update(k, -k);
+
+  int value;
+  for (int k = 0; k < 1000; k++)
+    assert(tree.search(k, value) == (k % 2 == 0) && (k % 2 != 0 || value == -k));
+  assert(updated == 500 && tree.stats().entries == 500);
+
+  // Wide values move slots, still without adding keys.
+  using Wide = std::array<std::uint32_t, 4>;
+  Manager wide_manager("test_update_wide.dat", 4 * 1024 * 1024, 4096, true);
+  BasicBTree<int, Wide> wide(&wide_manager, BTreeConfig{16, 8, 16});
+  wide.insert(1, Wide{1, 0, 0, 0});
+  assert(wide.update(1, Wide{1, 0, 0, 9}) && !wide.update(2, Wide{}));
+  Wide w;
+  assert(wide.search(1, w) && w[3] == 9 && !wide.search(2, w));
+
+  // Splits moving keys between leaves never make a present one look absent.
+  Manager race_manager("test_update_race.dat", 16 * 1024 * 1024, 4096, true);
+  BTree race(&race_manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < 4000; k += 2)
+    race.insert(k, k);
+  std::atomic<bool> done{false};
+  std::thread inserter([&] {
+    for (int k = 1; k < 4000; k += 2)
+      race.insert(k, k);
+    done = true;
+  });
+  while (!done)
+    for (int k = 0; k < 4000; k += 2)
+      assert(race.update(k, k));
+  inserter.join();
+  std::cout << "✓ update changes 500 present keys and inserts none" << std::endl;
+}
+
+// Writers race on overlapping keys while readers check that a key, once
+// inserted, never goes missing.
+void test_concurrent_upserts() {
+  std::cout << "\n=== Test 5: Concurrent Upserts ===" << std::endl;
+
+  const int n = 4000;
+  Manager manager("test_upsert_mt.dat", 32 * 1024 * 1024, 4096, true);
+  BTree tree(&manager, BTreeConfig{16, 8, 32});
+  for (int k = 0; k < n; k += 2)
+    tree.insert(k, 0);
+
+  std::atomic<int> inserted{0};
+  std::atomic<int> missing{0};
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rng(static_cast<unsigned>(t));
+      for (int i = 0; i < 20000; i++)
+        inserted.fetch_add(tree.upsert(static_cast<int>(rng() % n), t + 1));
+    });
+  }
+  threads.emplace_back([&] {
+    int value;
+    while (!done.load(std::memory_order_acquire))
+      for (int k = 0; k < n; k += 2)
+        missing.fetch_add(!tree.search(k, value));
+  });
+  for (int t = 0; t < 4; t++)
+    threads[static_cast<std::size_t>(t)].join();
+  done.store(true, std::memory_order_release);
+  threads.back().join();
+
+  assert(missing.load() == 0);
+  int count = 0;
+  tree.scan(-1, n, [&](int, int) { count++; });
+  assert(count == n / 2 + inserted.load());
+  std::cout << "✓ " << count << " distinct keys after 80000 racing upserts" << std::endl;
+}
+
+int main() {
+  try {
+    test_updates_do_not_grow();
+    test_full_leaf_is_not_split();
+    test_wide_values();
+    test_update_only();
+    test_concurrent_upserts();
+    std::cout << "\n✅ ALL UPSERT TESTS PASSED!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "\n❌ TEST FAILED: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,86 +1,721 @@
 #ifndef ATOMIC_TREE_BTREE_H
 #define ATOMIC_TREE_BTREE_H
 
+#include <array>
+#include <bit>
+#include <compare>
+#include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <set>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "interleave.h"
+#include "lookup_cache.h"
+#include "version_lock.h"
 
 namespace atomic_tree {
 
 class Manager;
 
-struct LeafEntry {
-    int key;
-    int value;
+template <typename Key, typename Value>
+struct BasicLeafEntry {
+    Key   key;
+    Value value;
 };
 
+using LeafEntry = BasicLeafEntry<int, int>;
+
 struct BTreeNode {
     bool         is_leaf;      // 1 byte
     std::uint8_t _pad1[3];     // pad to 4
-    std::uint32_t key_count;   // 4 bytes
+    std::uint32_t key_count;   // 4 bytes; internal nodes only, leaves use their slot bitmap
     std::uint32_t checksum;    // 4 bytes (bytes 8–11)
-    std::uint8_t  _pad2[4];    // pad so data[] is 8‑byte aligned
+    std::uint32_t prev_checksum;   // leaves: checksum of the state before the last commit
     std::uint8_t  data[];      // flexible array for keys/children or leaf entries
 };
 
+// LeavesOnly keeps internal nodes in DRAM and rebuilds them from the leaf
+// chain when the region is opened; only leaf updates are flushed.
+enum class PersistenceMode : std::uint8_t {
+    Full,
+    LeavesOnly,
+};
+
 struct BTreeConfig {
     int max_keys;
     int min_keys;
     int leaf_capacity;
+    PersistenceMode persistence = PersistenceMode::Full;
+
+    // Scan tuning, not stored in the region. Cursors prefetch this many
+    // leaves ahead along the chain (0 disables), and once a scan has
+    // crossed scan_willneed_after leaves, also madvise each leaf they
+    // prefetch so a region that is not resident pages in ahead (0 never).
+    int scan_prefetch_leaves = 4;
+    int scan_willneed_after = 0;
+
+    // Checks each node's checksum the first time an operation touches it
+    // after the tree is opened, and throws std::runtime_error on a
+    // mismatch. Verified blocks are remembered in a DRAM bitset until they
+    // are next written. Not stored in the region.
+    bool verify_reads = false;
+
+    // DRAM budget for a cache of recently read key -> value pairs in front
+    // of search (0 disables). Writers keep it coherent. Only for keys that
+    // compare bytewise with std::less; ignored otherwise. Not stored in the
+    // region.
+    std::size_t lookup_cache_bytes = 0;
+
+    // Threads for the recover() pass run when an existing region is
+    // opened; 0 skips it and only recounts the stats. Not stored in the
+    // region.
+    unsigned recovery_threads = 0;
+
+    // The region root slot the tree lives under (below
+    // Manager::Metadata::max_root_slots), so several trees can share a
+    // region. Not stored in the region.
+    std::uint32_t root_slot = 0;
+
+    // Blocks taken from the region per allocator call and handed out to new
+    // nodes by the tree itself (0 or 1 allocates one at a time). Writers of
+    // trees sharing a region then seldom meet on the allocator lock. The
+    // batch stays pinned until it is used up, so the GC keeps the blocks
+    // not yet handed out. Not stored in the region.
+    std::size_t alloc_batch_blocks = 0;
+};
+
+inline constexpr int max_tree_levels = 32;
+
+// Shape of a tree, as returned by BasicBTree::stats(). Counts are kept
+// current by every split, merge and leaf commit, so reading them costs
+// the same whatever the size of the tree.
+struct TreeStats {
+    std::uint32_t height;
+    std::array<std::uint64_t, max_tree_levels> nodes_per_level;   // [0] is the leaf level
+    std::uint64_t leaves;
+    std::uint64_t internal_nodes;
+    std::uint64_t entries;
+    // Leaves by fill in tenths of leaf_capacity; full leaves land in [9].
+    std::array<std::uint64_t, 10> leaf_fill_histogram;
+    double        average_leaf_fill;
+    double        average_fanout;      // children per internal node
+    std::uint64_t live_blocks;         // region blocks holding reachable nodes
+    std::uint64_t allocated_blocks;    // region blocks handed out, reserved ones excluded
+    // Share of allocated blocks that hold no reachable node: merged-away
+    // nodes the GC has not swept yet. The tree cannot tell another owner's
+    // blocks (a second root slot, a key heap, a value log) from garbage, so
+    // this stays 0 unless the tree is alone in its region.
+    double        fragmentation;
+};
+
+// Outcome of BasicBTree::recover().
+struct RecoveryReport {
+    unsigned      threads;
+    std::uint64_t nodes_checked;
+    // Nodes that fail their checksum or hold an offset outside the region.
+    // When there are any, recover() reports them and changes nothing.
+    std::vector<std::uint64_t> corrupt_nodes;
+    std::uint64_t splits_repaired;     // chain leaves linked back into a parent
+    bool          internal_rebuilt;    // too many for their parents; levels rebuilt
+    std::uint64_t blocks_freed;        // allocated but unreachable
+    std::uint64_t blocks_restored;     // reachable but marked free
+    double        walk_ms;
+    double        repair_ms;
+    double        bitmap_ms;
+    double        total_ms;
 };
 
-class BTree {
+// Child "offsets" with this bit set are raw pointers to DRAM nodes. Mapped
+// offsets never reach it, and user-space pointers leave it clear.
+inline constexpr std::uint64_t dram_node_tag = 1ULL << 63;
+
+// Bump allocator for internal nodes that never reach the region. Nodes live
+// until the arena is destroyed, like blocks until the GC runs. Each node is
+// preceded by its own cache line holding the node's VersionLock.
+class DramNodeArena {
 public:
+    explicit DramNodeArena(std::size_t node_size) noexcept;
+
+    [[nodiscard]] BTreeNode *allocate();
+    [[nodiscard]] std::size_t bytes_allocated() const;
+
+    [[nodiscard]] static VersionLock &lock_of(BTreeNode *node) noexcept {
+        return *std::launder(reinterpret_cast<VersionLock *>(
+            reinterpret_cast<std::byte *>(node) - lock_line));
+    }
+
+private:
+    struct ChunkDeleter {
+        void operator()(std::byte *p) const noexcept {
+            ::operator delete[](p, std::align_val_t{64});
+        }
+    };
+
+    static constexpr std::size_t nodes_per_chunk = 64;
+    static constexpr std::size_t lock_line = 64;
+
+    std::size_t slot_size_;
+    std::size_t used_in_chunk_;
+    std::vector<std::unique_ptr<std::byte[], ChunkDeleter>> chunks_;
+    mutable std::mutex mutex_;
+};
+
+// Fixed-width binary key, ordered bytewise like memcmp.
+template <std::size_t N>
+struct FixedKey {
+    std::array<std::uint8_t, N> bytes;
+
+    friend bool operator==(const FixedKey &a, const FixedKey &b) noexcept {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), N) == 0;
+    }
+    friend bool operator<(const FixedKey &a, const FixedKey &b) noexcept {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), N) < 0;
+    }
+};
+
+// Byte offsets inside BTreeNode::data. They depend only on the key and entry
+// sizes, so the GC can walk any instantiation from the sizes in Metadata.
+[[nodiscard]] constexpr std::size_t internal_children_offset(std::size_t key_size,
+                                                             int max_keys) noexcept {
+    return (key_size * static_cast<std::size_t>(max_keys) + 7) & ~std::size_t{7};
+}
+
+// Leaves open with an 8-byte slot bitmap and one fingerprint byte per slot,
+// so the header line holds everything a point lookup needs before it
+// touches an entry. A slot is live iff its bit is set; entries are written
+// into free slots first and published by a single store to the bitmap.
+// The capacity is capped so the fingerprints never leave that line, and a
+// commit flushes it once for the bitmap, checksums and fingerprints alike.
+inline constexpr std::size_t leaf_fingerprints_offset = sizeof(std::uint64_t);
+
+inline constexpr int max_leaf_capacity =
+    static_cast<int>(64 - sizeof(BTreeNode) - leaf_fingerprints_offset);
+
+// Entries start 16-byte aligned, so 8- and 16-byte entries never straddle
+// a cache line.
+[[nodiscard]] constexpr std::size_t leaf_entries_offset(int leaf_capacity) noexcept {
+    return (leaf_fingerprints_offset + static_cast<std::size_t>(leaf_capacity) + 15) &
+           ~std::size_t{15};
+}
+
+[[nodiscard]] constexpr std::size_t leaf_next_offset(std::size_t entry_size,
+                                                     int leaf_capacity) noexcept {
+    return leaf_entries_offset(leaf_capacity) +
+           ((entry_size * static_cast<std::size_t>(leaf_capacity) + 7) & ~std::size_t{7});
+}
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class BasicBTree {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "BTree keys and values are stored in mapped memory");
+    static_assert(alignof(BasicLeafEntry<Key, Value>) <= 8,
+                  "BTreeNode::data is only 8-byte aligned");
+
+public:
+    using key_type   = Key;
+    using value_type = Value;
+    using entry_type = BasicLeafEntry<Key, Value>;
+
     struct InsertResult {
-        int           split_key;
+        Key           split_key;
         std::uint64_t new_child_offset;
         bool          did_split;
     };
 
-    BTree(Manager *manager, const BTreeConfig &config);
+    // insert, search and erase may be called from any number of threads.
+    // Readers take no locks; writers lock only the nodes they modify.
+    // Nodes that fall below min_keys after an erase borrow from or merge
+    // with a sibling; merged-away nodes stay allocated until the GC runs,
+    // which must not overlap with tree operations or open cursors.
+    BasicBTree(Manager *manager, const BTreeConfig &config);
+    ~BasicBTree();
+
+    void insert(const Key &key, const Value &value);
+
+    // Overwrites the value of key's entry, or inserts the key if it has
+    // none; returns true if it was inserted. Values of up to 8 naturally
+    // aligned bytes are replaced in place with one atomic store, without
+    // splitting a full leaf; wider ones move to a free slot of the same
+    // leaf under a single bitmap commit.
+    bool upsert(const Key &key, const Value &value);
+
+    // Overwrites the value of key's entry; returns false, changing
+    // nothing, if it has none. Unlike upsert, key is never stored, so it
+    // only has to be valid for the call.
+    bool update(const Key &key, const Value &value);
+
+    // update, but only while key's value is still expected, compared
+    // bytewise; returns false, changing nothing, if it is not or key has
+    // no entry. A writer that derived desired from the value it read, such
+    // as a ValueLog moving a record, loses cleanly to one that got there
+    // first.
+    bool compare_update(const Key &key, const Value &expected, const Value &desired);
+
+    [[nodiscard]] bool search(const Key &key, Value &out_value) const;
+
+    // search for every key, with up to group lookups in flight on this
+    // thread. Each lookup prefetches the next node it descends to and
+    // suspends, and the others run while the line loads. values[i] and
+    // found[i] are set for each key found, found[i] cleared otherwise;
+    // returns the number found.
+    std::size_t multi_get(std::span<const Key> keys, std::span<Value> values,
+                          std::span<bool> found, std::size_t group = 8) const;
+
+    // Same contract as multi_get, for keys that cluster in key space. The
+    // keys are sorted and the batch descends the tree once: each internal
+    // node splits it at its separators and passes each run to its child,
+    // so nodes on shared paths, leaves included, are read once per batch
+    // rather than once per key. The lookup cache is not consulted.
+    std::size_t search_sorted_batch(std::span<const Key> keys, std::span<Value> values,
+                                    std::span<bool> found) const;
+
+    // Current shape of the tree. O(1): nothing is walked. Counts are
+    // updated relaxed, so a read racing writers may be off by a node.
+    [[nodiscard]] TreeStats stats() const;
+
+    // Checks and repairs a tree left by a crash; no other thread may use
+    // it. Subtrees below the top levels are walked by threads in parallel,
+    // verifying every node's checksum and marking the blocks reached.
+    // Leaves on the chain that no parent points to are the right halves
+    // of splits cut short: entries the split had copied over are dropped
+    // from the left neighbour and the leaf is linked into that neighbour's
+    // parent, or the internal levels are rebuilt from the chain if the
+    // parents lack room. The allocation bitmap is then set to exactly the
+    // reachable blocks. threads == 0 uses every core.
+    RecoveryReport recover(unsigned threads = 0);
+    // The report of the pass run at open, if BTreeConfig::recovery_threads
+    // asked for one.
+    [[nodiscard]] const std::optional<RecoveryReport> &open_recovery() const noexcept {
+        return open_recovery_;
+    }
+
+    // Counters of the lookup cache; all zero when it is disabled.
+    [[nodiscard]] LookupCacheStats lookup_cache_stats() const noexcept;
+    // JSON lines in the format of Manager::print_telemetry: the tree's
+    // stats and its lookup cache.
+    void print_telemetry() const;
+
+    [[nodiscard]] bool erase(const Key &key);
+
+    // Batched mutations. The batch is sorted and split into runs that share
+    // a target leaf; each run is applied under one leaf lock with a single
+    // persist and commit point, and full leaves are split as the pass
+    // reaches them. erase_batch returns the number of entries removed.
+    void insert_batch(std::vector<entry_type> entries);
+    std::size_t erase_batch(std::vector<Key> keys);
+
+    // Builds the tree bottom-up from entries, which need not be sorted: leaves
+    // and internal nodes are packed to fill_factor, every node is persisted
+    // once, and the result is published with a single root update. The tree
+    // must be empty and no other thread may use it during the load.
+    void bulk_load(std::vector<entry_type> entries, double fill_factor = 0.9);
+
+    class Snapshot;
+
+    // Forward iterator over the leaf chain in key order. Each leaf is copied
+    // under its version lock and sorted in the cursor's own buffer, so the
+    // cursor never holds a lock; concurrent writes after the copy may or may
+    // not be seen.
+    class Cursor {
+    public:
+        explicit Cursor(const BasicBTree &tree) noexcept;
+
+        // Positions at the first entry whose key is not less than key.
+        void seek(const Key &key);
+        void seek_to_first();
+        void next();
+
+        [[nodiscard]] bool valid() const noexcept { return pos_ < count_; }
+        [[nodiscard]] const Key &key() const noexcept { return entries_[pos_].key; }
+        [[nodiscard]] const Value &value() const noexcept { return entries_[pos_].value; }
+
+    private:
+        friend class Snapshot;
+
+        const BasicBTree *tree_;
+        std::array<entry_type, max_leaf_capacity> entries_;
+        std::uint32_t count_;
+        std::uint32_t pos_;
+        std::uint64_t next_leaf_;
+        std::optional<Key> last_key_;   // largest key of the last leaf copied
+        std::uint64_t prefetch_frontier_;   // furthest leaf prefetched
+        int prefetched_;                    // leaves in flight past the current one
+        std::size_t leaves_crossed_;
+
+        [[nodiscard]] bool copy_leaf(std::uint64_t leaf_offset, std::uint64_t version);
+        void skip_exhausted_leaves();
+        void prefetch_ahead(std::uint64_t leaf_offset);
+    };
+
+    [[nodiscard]] Cursor cursor() const noexcept { return Cursor(*this); }
+
+    // Calls fn(key, value) for every entry in [lo, hi), in key order. If fn
+    // returns bool, returning false stops the scan.
+    template <typename Fn>
+    void scan(const Key &lo, const Key &hi, Fn &&fn) const;
 
-    void insert(int key, int value);
+    // A read-only view of the tree as of the moment it was taken. Writers
+    // are not blocked: while any snapshot is open, each change first logs
+    // the key's previous state as a DRAM undo record stamped with the
+    // current epoch, and snapshot reads overlay those records on the live
+    // leaves. Records go away once no open snapshot is older than them.
+    // Snapshots live in DRAM only and must be released before the tree is
+    // destroyed.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot &&other) noexcept;
+        Snapshot &operator=(Snapshot &&other) noexcept;
+        ~Snapshot();
 
-    [[nodiscard]] bool search(int key, int &out_value) const;
+        [[nodiscard]] bool search(const Key &key, Value &out_value) const;
 
-    [[nodiscard]] bool erase(int key);
+        // Same contract as BasicBTree::scan, over the snapshot's contents.
+        template <typename Fn>
+        void scan(const Key &lo, const Key &hi, Fn &&fn) const;
 
+        [[nodiscard]] std::uint64_t epoch() const noexcept { return epoch_; }
+
+    private:
+        friend class BasicBTree;
+
+        Snapshot(const BasicBTree *tree, std::uint64_t epoch) noexcept
+            : tree_(tree), epoch_(epoch) {}
+        void release() noexcept;
+
+        const BasicBTree *tree_;
+        std::uint64_t epoch_;
+    };
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+    // Undo records currently kept for open snapshots.
+    [[nodiscard]] std::size_t snapshot_undo_records() const;
+
+    // In LeavesOnly mode this is a DRAM handle (dram_node_tag set) once the
+    // root has split; the region's own root is the head leaf.
     [[nodiscard]] std::uint64_t root_offset() const noexcept;
+    [[nodiscard]] PersistenceMode persistence() const noexcept;
 
     void print_tree() const;
 
+    // Node sizes for a given fanout; a config is valid if both fit a block.
+    [[nodiscard]] static constexpr std::size_t internal_node_bytes(int max_keys) noexcept {
+        return sizeof(BTreeNode) + internal_children_offset(sizeof(Key), max_keys) +
+               sizeof(std::uint64_t) * static_cast<std::size_t>(max_keys + 1);
+    }
+    [[nodiscard]] static constexpr std::size_t leaf_node_bytes(int leaf_capacity) noexcept {
+        return sizeof(BTreeNode) + leaf_next_offset(sizeof(entry_type), leaf_capacity) +
+               sizeof(std::uint64_t);
+    }
+
     // layout helpers used by GC and others
-    [[nodiscard]] static int *get_internal_keys(BTreeNode *node) noexcept;
+    [[nodiscard]] static Key *get_internal_keys(BTreeNode *node) noexcept {
+        return reinterpret_cast<Key *>(node->data);
+    }
     [[nodiscard]] static std::uint64_t *get_internal_children(BTreeNode *node,
-                                                              int max_keys) noexcept;
-    [[nodiscard]] static LeafEntry *get_leaf_entries(BTreeNode *node) noexcept;
+                                                              int max_keys) noexcept {
+        return reinterpret_cast<std::uint64_t *>(
+            node->data + internal_children_offset(sizeof(Key), max_keys));
+    }
+    [[nodiscard]] static std::uint64_t *get_leaf_bitmap(BTreeNode *node) noexcept {
+        return reinterpret_cast<std::uint64_t *>(node->data);
+    }
+    [[nodiscard]] static std::uint32_t leaf_size(BTreeNode *node) noexcept {
+        return static_cast<std::uint32_t>(std::popcount(*get_leaf_bitmap(node)));
+    }
+    [[nodiscard]] static std::uint8_t *get_leaf_fingerprints(BTreeNode *node) noexcept {
+        return node->data + leaf_fingerprints_offset;
+    }
+    [[nodiscard]] static entry_type *get_leaf_entries(BTreeNode *node,
+                                                      int leaf_capacity) noexcept {
+        return reinterpret_cast<entry_type *>(node->data + leaf_entries_offset(leaf_capacity));
+    }
+
+    // Keys whose equality is bytewise can be hashed and cached by their bytes.
+    static constexpr bool bytewise_keys = std::is_same_v<Compare, std::less<Key>> &&
+                                          std::has_unique_object_representations_v<Key>;
+    // Other comparators can hash keys with a static Compare::hash, as long
+    // as keys they find equal hash alike.
+    static constexpr bool hashable_keys = bytewise_keys || requires(const Key &key) {
+        { Compare::hash(key) } -> std::convertible_to<std::uint64_t>;
+    };
+
+    // Mixed 64-bit hash of a key; 0 for keys that are not hashable.
+    [[nodiscard]] static std::uint64_t key_hash(const Key &key) noexcept {
+        if constexpr (!bytewise_keys && hashable_keys) {
+            return static_cast<std::uint64_t>(Compare::hash(key)) * 0x9E3779B97F4A7C15ULL;
+        } else if constexpr (hashable_keys) {
+            std::uint64_t h = 0;
+            if constexpr (std::is_integral_v<Key>) {
+                h = static_cast<std::uint64_t>(key);
+            } else {
+                const auto *bytes = reinterpret_cast<const unsigned char *>(&key);
+                std::size_t i = 0;
+                for (; i + 8 <= sizeof(Key); i += 8) {
+                    std::uint64_t word;
+                    std::memcpy(&word, bytes + i, sizeof(word));
+                    h = (h ^ word) * 0x100000001b3ULL;
+                }
+                for (; i < sizeof(Key); ++i)
+                    h = (h ^ bytes[i]) * 0x100000001b3ULL;
+            }
+            return h * 0x9E3779B97F4A7C15ULL;
+        } else {
+            return 0;
+        }
+    }
+
+    // One-byte hash of a key; equal keys always share a fingerprint.
+    // Comparator-defined equality may not follow the bytes, so unless the
+    // comparator hashes keys itself they all get 0 and every slot stays a
+    // candidate.
+    [[nodiscard]] static std::uint8_t fingerprint(const Key &key) noexcept {
+        return static_cast<std::uint8_t>(key_hash(key) >> 56);
+    }
     [[nodiscard]] static std::uint64_t *get_leaf_next(BTreeNode *node,
-                                                      int leaf_capacity) noexcept;
+                                                      int leaf_capacity) noexcept {
+        return reinterpret_cast<std::uint64_t *>(
+            node->data + leaf_next_offset(sizeof(entry_type), leaf_capacity));
+    }
 
 private:
     Manager     *manager_;
     BTreeConfig  config_;
-    std::uint64_t root_offset_;
+    std::atomic<std::uint64_t> root_offset_;
+    std::uint64_t head_leaf_;       // leftmost leaf; splits never move it
+    std::unique_ptr<DramNodeArena> dram_nodes_;     // LeavesOnly mode only
+    std::unique_ptr<VersionLock[]> block_locks_;    // one per region block
+    std::unique_ptr<std::atomic<std::uint64_t>[]> verified_;  // verify_reads only, bit per block
+    std::unique_ptr<LookupCache<Key, Value>> cache_;            // lookup_cache_bytes only
+    std::optional<RecoveryReport> open_recovery_;
 
-    [[nodiscard]] static std::uint32_t calculate_checksum(BTreeNode *node,
-                                                          std::size_t block_size) noexcept;
+    // alloc_batch_blocks only: the pinned batch, of which blocks before
+    // alloc_cache_next_ have been handed out.
+    std::mutex alloc_cache_mutex_;
+    std::vector<std::uint64_t> alloc_cache_;
+    std::size_t alloc_cache_next_ = 0;
+
+    // Shape counters behind stats(): nodes per level above the leaves,
+    // and leaves per live entry count.
+    std::array<std::atomic<std::int64_t>, max_tree_levels> level_nodes_{};
+    std::array<std::atomic<std::int64_t>, max_leaf_capacity + 1> leaves_by_size_{};
+    [[no_unique_address]] Compare comp_;
+
+    // Snapshot state. A snapshot taken at epoch s reads a key through the
+    // oldest undo record stamped s or later, and through the leaves when
+    // the key has none. Each key's records are in stamp order, since its
+    // writers take the same leaf lock before reading the epoch.
+    struct UndoRecord {
+        std::uint64_t stamp;
+        bool          present;
+        Value         value;
+    };
+    mutable std::atomic<std::uint64_t> epoch_{1};
+    mutable std::atomic<std::uint32_t> open_snapshots_{0};
+    mutable std::mutex snapshot_mutex_;
+    mutable std::multiset<std::uint64_t> snapshot_epochs_;
+    mutable std::map<Key, std::vector<UndoRecord>, Compare> undo_{comp_};
+
+    // Logs key's state in the write-locked leaf before a logical change;
+    // a single atomic load while no snapshot is open. Splits, merges and
+    // redistribution move entries without changing them and log nothing.
+    // Records are keyed by the leaf's own copy of a present key. An absent
+    // key is only logged if the change inserts it; erase and update leave
+    // it alone, so their key never has to outlive the call.
+    void record_undo(BTreeNode *leaf, const Key &key, bool inserts = true);
+    [[nodiscard]] static const UndoRecord *undo_at(const std::vector<UndoRecord> &records,
+                                                   std::uint64_t epoch) noexcept;
+
+    void count_node(int level, std::int64_t delta) noexcept {
+        level_nodes_[static_cast<std::size_t>(level)].fetch_add(delta, std::memory_order_relaxed);
+    }
+    void count_leaf(std::uint32_t size, std::int64_t delta) noexcept {
+        count_node(0, delta);
+        leaves_by_size_[size].fetch_add(delta, std::memory_order_relaxed);
+    }
+    // Levels below the node; every path down from it has the same length.
+    [[nodiscard]] int subtree_level(std::uint64_t offset) const noexcept;
+    // Rebuilds the counters with one walk, for a tree just opened.
+    void recount_stats();
+
+    [[nodiscard]] bool search_tree(const Key &key, Value &out_value) const;
+    // One multi_get lookup: search with a suspension after each prefetch.
+    [[nodiscard]] InterleavedTask search_interleaved(const Key &key, Value &out_value,
+                                                     bool &found) const;
+
+    // A search_sorted_batch in flight; order lists key indices in key order.
+    struct SortedBatch {
+        std::span<const Key> keys;
+        std::span<const std::uint32_t> order;
+        std::span<Value> values;
+        std::span<bool> found;
+    };
+    // Resolves order[lo, hi), whose keys all route to the node at offset
+    // as read under version. Returns the first position left unresolved
+    // because a writer changed the node; the caller retries from there.
+    [[nodiscard]] std::size_t search_sorted_range(const SortedBatch &batch, std::uint64_t offset,
+                                                  std::uint64_t version, std::size_t lo,
+                                                  std::size_t hi) const;
+    // Writers call this after changing key, still holding its leaf lock:
+    // a cached entry takes value, or is dropped when value is null.
+    void update_cache(const Key &key, const Value *value) noexcept {
+        if (cache_)
+            cache_->update(key, key_hash(key), value);
+    }
+
+    [[nodiscard]] std::uint32_t child_index(const Key *keys, std::uint32_t count,
+                                            const Key &key) const noexcept;
+
+    // Comparators that take the Manager, e.g. to reach key bytes stored in
+    // the region, are built from it.
+    [[nodiscard]] static Compare make_compare(Manager *manager) {
+        if constexpr (std::is_constructible_v<Compare, Manager *>)
+            return Compare(manager);
+        else
+            return Compare{};
+    }
+    // Separator for two adjacent leaves, left_max < right_min. Comparators
+    // with a separator(left_max, right_min) member may return a shorter key
+    // than right_min; it must order after left_max and not after right_min.
+    [[nodiscard]] Key separator_between(const Key &left_max, const Key &right_min) const noexcept {
+        if constexpr (requires { comp_.separator(left_max, right_min); })
+            return comp_.separator(left_max, right_min);
+        else
+            return right_min;
+    }
+
+    // Region offset of bytes a key keeps outside the node, from a static
+    // Compare::region_ref, or 0. Recovery keeps the blocks they live in.
+    [[nodiscard]] static std::uint64_t key_region_ref(const Key &key) noexcept {
+        if constexpr (requires { Compare::region_ref(key); })
+            return Compare::region_ref(key);
+        else
+            return 0;
+    }
+
+    [[nodiscard]] bool key_equal(const Key &a, const Key &b) const noexcept {
+        if constexpr (std::is_same_v<Compare, std::less<Key>> &&
+                      std::equality_comparable<Key>) {
+            return a == b;
+        } else {
+            return !comp_(a, b) && !comp_(b, a);
+        }
+    }
+
+    // Leaves are checksummed over what readers can see: the header, the
+    // bitmap and the live slots. Free slots and the next pointer stay out,
+    // so filling a slot ahead of its commit or relinking the chain never
+    // invalidates the stored value.
+    [[nodiscard]] std::uint32_t calculate_checksum(BTreeNode *node) const noexcept;
+    // With value set, slot's value is taken from *value instead of the leaf.
+    [[nodiscard]] static std::uint32_t leaf_checksum(BTreeNode *leaf, std::uint64_t bitmap,
+                                                     int leaf_capacity, int slot = -1,
+                                                     const Value *value = nullptr) noexcept;
     void persist_node(BTreeNode *node);
 
+    // verify_reads: false if a writer raced the check and the caller must
+    // restart. Throws if the node does not match its checksum.
+    [[nodiscard]] bool verify_node(std::uint64_t offset, std::uint64_t version) const;
+    void clear_verified(std::uint64_t offset) noexcept;
+
+    // Leaf mutations: flush the entry lines of the slots in mask, then
+    // publish a new bitmap with one store to the header line.
+    void flush_leaf_slots(BTreeNode *leaf, std::uint64_t mask) const;
+    void commit_leaf(std::uint64_t leaf_offset, std::uint64_t bitmap);
+    [[nodiscard]] std::uint32_t live_entries(BTreeNode *leaf, entry_type *out) const noexcept;
+    // Live slot holding key, or -1.
+    [[nodiscard]] int find_slot(BTreeNode *leaf, const Key &key) const noexcept;
+
+    // Entries start 16-byte aligned, so a value whose size is its alignment
+    // and at most 8 bytes never straddles a line and can be stored whole.
+    static constexpr bool in_place_values = sizeof(Value) <= 8 &&
+                                            std::has_single_bit(sizeof(Value)) &&
+                                            alignof(Value) == sizeof(Value);
+    void update_value(std::uint64_t leaf_offset, int slot, const Value &value);
+
     [[nodiscard]] BTreeNode *offset_to_node(std::uint64_t offset) const noexcept;
+    // Starts loading the lines a descent reads first: the header plus the
+    // separators of an internal node or the fingerprints and first entries
+    // of a leaf.
+    void prefetch_node(std::uint64_t offset) const noexcept;
+    [[nodiscard]] VersionLock &node_lock(std::uint64_t offset) const noexcept;
+    [[nodiscard]] std::uint64_t alloc_region_node();
+    [[nodiscard]] std::uint64_t alloc_internal_node();
+
+    // Stacks internal levels over (first key, child) pairs, left to right,
+    // and returns the root. The first key of the leftmost child is unused.
+    [[nodiscard]] std::uint64_t
+    build_internal_levels(std::vector<std::pair<Key, std::uint64_t>> level,
+                          std::size_t fanout);
+    [[nodiscard]] std::uint64_t rebuild_from_leaf_chain(std::uint64_t head_leaf);
+
+    // Optimistic descent; returns 0 when a concurrent writer forces a restart.
+    // upper, if given, receives the separator bounding the leaf on the right
+    // (empty for the rightmost leaf).
+    [[nodiscard]] std::uint64_t find_leaf(const Key &key, std::uint64_t &leaf_version,
+                                          std::optional<Key> *upper = nullptr) const;
 
-    InsertResult insert_internal(std::uint64_t node_offset, int key, int value);
-    InsertResult insert_leaf(std::uint64_t leaf_offset, int key, int value);
-    InsertResult insert_internal_node(std::uint64_t node_offset, int key, int value);
+    // Returns the write-locked, non-full leaf for key, splitting full nodes
+    // on the way down.
+    [[nodiscard]] std::uint64_t lock_leaf_for_insert(const Key &key, std::optional<Key> *upper);
+
+    // The callers below hold the write lock of every node they touch.
+    void append_to_leaf(std::uint64_t leaf_offset, std::span<const entry_type> entries);
+    void insert_separator(std::uint64_t node_offset, const Key &split_key,
+                          std::uint64_t new_child_offset);
+    void grow_root(std::uint64_t old_root_offset, const InsertResult &split);
     InsertResult split_leaf(std::uint64_t old_leaf_offset);
     InsertResult split_internal(std::uint64_t old_node_offset);
 
-    [[nodiscard]] bool search_internal(std::uint64_t node_offset,
-                                       int key,
-                                       int &out_value) const;
+    std::size_t erase_from_leaf(std::uint64_t leaf_offset, std::span<const Key> keys);
 
-    [[nodiscard]] bool erase_internal(std::uint64_t node_offset, int key);
-    [[nodiscard]] bool erase_leaf(std::uint64_t leaf_offset, int key);
+    // Underflow handling. rebalance repairs underfull nodes on key's path,
+    // one top-down pass per repair, until a pass reaches the leaf clean.
+    [[nodiscard]] bool underfull(const BTreeNode *node) const noexcept;
+    void rebalance(const Key &key);
+    void repair_child(std::uint64_t parent, std::uint64_t parent_version, std::uint32_t idx,
+                      std::uint64_t child, std::uint64_t child_version);
+    void merge_leaves(std::uint64_t left, std::uint64_t right);
+    void redistribute_leaves(std::uint64_t parent, std::uint32_t sep_idx,
+                             std::uint64_t left, std::uint64_t right);
+    // Returns the fresh node holding both halves; left and right stay as
+    // they were until the parent stops pointing at them.
+    [[nodiscard]] std::uint64_t merge_internal(std::uint64_t parent, std::uint32_t sep_idx,
+                                               std::uint64_t left, std::uint64_t right);
+    void redistribute_internal(std::uint64_t parent, std::uint32_t sep_idx,
+                               std::uint64_t left, std::uint64_t right);
+    // Drops separator sep_idx and the child to its right, and points the
+    // child to its left at left_child, all in one persist of the node.
+    void remove_separator(std::uint64_t node_offset, std::uint32_t sep_idx,
+                          std::uint64_t left_child);
 };
 
+using BTree = BasicBTree<int, int>;
+using U64BTree = BasicBTree<std::uint64_t, std::uint64_t>;
+
+template <std::size_t N>
+using FixedKeyBTree = BasicBTree<FixedKey<N>, std::uint64_t>;
+
+// The common instantiations are compiled once, in B_tree.cpp.
+extern template class BasicBTree<int, int>;
+extern template class BasicBTree<std::uint64_t, std::uint64_t>;
+extern template class BasicBTree<FixedKey<16>, std::uint64_t>;
+extern template class BasicBTree<FixedKey<32>, std::uint64_t>;
+
 } // namespace atomic_tree
 
+#include "B_tree_impl.h"
+
 #endif // ATOMIC_TREE_BTREE_H
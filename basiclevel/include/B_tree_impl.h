@@ -0,0 +1,2468 @@
+#ifndef ATOMIC_TREE_BTREE_IMPL_H
+#define ATOMIC_TREE_BTREE_IMPL_H
+
+// Template definitions for BasicBTree; included from B_tree.h.
+
+#include "crc32c.h"
+#include "manager.h"
+#include "primitives.h"
+#include "radix_sort.h"
+#include "simd_search.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+#include <ranges>
+#include <iostream>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <bit>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+namespace atomic_tree {
+
+// Bit i is set when fps[i] == fp, for the first count slots. Reads whole
+// vectors past count; the fingerprint array is always followed by entries.
+[[nodiscard]] inline std::uint64_t fingerprint_match_mask(const std::uint8_t *fps,
+                                                          std::uint8_t fp,
+                                                          std::uint32_t count) noexcept {
+    std::uint64_t mask = 0;
+#ifdef __AVX2__
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(fp));
+    for (std::uint32_t i = 0; i < count; i += 32) {
+        __m256i lane = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fps + i));
+        auto bits = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(lane, needle)));
+        mask |= std::uint64_t{bits} << i;
+    }
+#else
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(fp));
+    for (std::uint32_t i = 0; i < count; i += 16) {
+        __m128i lane = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fps + i));
+        auto bits = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(lane, needle)));
+        mask |= std::uint64_t{bits} << i;
+    }
+#endif
+    return count >= 64 ? mask : mask & ((1ULL << count) - 1);
+}
+
+// Child slot for key in an internal node: the number of separators <= key.
+// Plain 32/64-bit integer keys go through the vectorized rank; others take
+// a binary search, as their comparisons may be far from free.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint32_t
+BasicBTree<Key, Value, Compare>::child_index(const Key *keys, std::uint32_t count,
+                                             const Key &key) const noexcept {
+    if constexpr (std::is_same_v<Compare, std::less<Key>> && std::is_integral_v<Key> &&
+                  (sizeof(Key) == 4 || sizeof(Key) == 8)) {
+        using Fixed = std::conditional_t<
+            sizeof(Key) == 4,
+            std::conditional_t<std::is_signed_v<Key>, std::int32_t, std::uint32_t>,
+            std::conditional_t<std::is_signed_v<Key>, std::int64_t, std::uint64_t>>;
+        return separator_rank(reinterpret_cast<const Fixed *>(keys), count,
+                              static_cast<Fixed>(key));
+    } else {
+        return static_cast<std::uint32_t>(std::upper_bound(keys, keys + count, key, comp_) - keys);
+    }
+}
+
+// CRC32C of the node header with both checksum fields read as zero.
+[[nodiscard]] inline std::uint32_t node_header_checksum(const BTreeNode *node) noexcept {
+    std::array<std::uint8_t, sizeof(BTreeNode)> header;
+    std::memcpy(header.data(), node, sizeof(BTreeNode));
+    std::memset(header.data() + offsetof(BTreeNode, checksum), 0, 2 * sizeof(std::uint32_t));
+    return crc32c(header.data(), header.size());
+}
+
+// Internal nodes cover the header plus the separators and children in use;
+// the rest of the block is never read.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint32_t
+BasicBTree<Key, Value, Compare>::calculate_checksum(BTreeNode *node) const noexcept {
+    if (node->is_leaf)
+        return leaf_checksum(node, *get_leaf_bitmap(node), config_.leaf_capacity);
+
+    std::uint32_t count = std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+    std::uint32_t crc = node_header_checksum(node);
+    crc = crc32c(get_internal_keys(node), count * sizeof(Key), crc);
+    return crc32c(get_internal_children(node, config_.max_keys),
+                  (count + 1) * sizeof(std::uint64_t), crc);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint32_t
+BasicBTree<Key, Value, Compare>::leaf_checksum(BTreeNode *leaf, std::uint64_t bitmap,
+                                               int leaf_capacity, int slot,
+                                               const Value *value) noexcept {
+    // Live slots are gathered first so the CRC runs over one buffer.
+    constexpr std::size_t max_bytes =
+        sizeof(std::uint64_t) + max_leaf_capacity * (1 + sizeof(entry_type));
+    std::array<std::uint8_t, max_bytes> buf;
+
+    std::memcpy(buf.data(), &bitmap, sizeof(bitmap));
+    std::size_t len = sizeof(bitmap);
+    if (leaf_capacity < 64)
+        bitmap &= (std::uint64_t{1} << leaf_capacity) - 1;
+
+    const std::uint8_t *fps = get_leaf_fingerprints(leaf);
+    const entry_type *entries = get_leaf_entries(leaf, leaf_capacity);
+    for (; bitmap != 0; bitmap &= bitmap - 1) {
+        int i = std::countr_zero(bitmap);
+        buf[len++] = fps[i];
+        std::memcpy(buf.data() + len, &entries[i], sizeof(entry_type));
+        if (i == slot && value)
+            std::memcpy(buf.data() + len + offsetof(entry_type, value), value, sizeof(Value));
+        len += sizeof(entry_type);
+    }
+    return crc32c(buf.data(), len, node_header_checksum(leaf));
+}
+
+// Writes a whole node that no reader can reach yet, or an internal node.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::persist_node(BTreeNode *node) {
+    if (config_.persistence == PersistenceMode::LeavesOnly && !node->is_leaf)
+        return;
+
+    std::uint64_t offset = manager_->ptr_to_offset(node);
+    manager_->mark_dirty(offset, manager_->block_size());
+    clear_verified(offset);
+    node->checksum = calculate_checksum(node);
+    node->prev_checksum = node->checksum;
+    persist(node, node->is_leaf ? leaf_node_bytes(config_.leaf_capacity)
+                                : manager_->block_size());
+    manager_->update_block_checksum(offset);
+}
+
+// The first read of a block checks it in full; later ones test one bit.
+// The checksum is recomputed under the caller's read version, so a
+// mismatch only counts once the version still validates. Leaves also
+// accept prev_checksum: a crash between a commit's checksum and bitmap
+// stores leaves the previous state, which that value matches.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::verify_node(std::uint64_t offset,
+                                                               std::uint64_t version) const {
+    if (!verified_ || (offset & dram_node_tag)) [[likely]]
+        return true;
+    std::size_t block = offset / manager_->block_size();
+    std::uint64_t bit = std::uint64_t{1} << (block % 64);
+    std::atomic<std::uint64_t> &word = verified_[block / 64];
+    if (word.load(std::memory_order_relaxed) & bit) [[likely]]
+        return true;
+
+    BTreeNode *node = offset_to_node(offset);
+    std::uint32_t stored = node->checksum;
+    std::uint32_t prev = node->prev_checksum;
+    bool is_leaf = node->is_leaf;
+    std::uint32_t actual = calculate_checksum(node);
+    if (!node_lock(offset).validate(version)) [[unlikely]]
+        return false;
+    if (actual != stored && !(is_leaf && actual == prev)) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Checksum mismatch in {} node at offset {}: stored {}, computed {}",
+                        is_leaf ? "leaf" : "internal", offset, stored, actual));
+    }
+    word.fetch_or(bit, std::memory_order_relaxed);
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::clear_verified(std::uint64_t offset) noexcept {
+    if (!verified_ || (offset & dram_node_tag))
+        return;
+    std::size_t block = offset / manager_->block_size();
+    verified_[block / 64].fetch_and(~(std::uint64_t{1} << (block % 64)),
+                                    std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::flush_leaf_slots(BTreeNode *leaf,
+                                                       std::uint64_t mask) const {
+    // Leaves span fewer than 64 lines, so one word tracks which are due.
+    // The header line, fingerprints included, is left to commit_leaf.
+    // pmem_flush issues clflush, which later stores cannot pass, so these
+    // lines are written back before the commit's bitmap store without a
+    // fence of their own; commit_leaf's fence covers them all.
+    const auto *base = reinterpret_cast<const std::uint8_t *>(leaf);
+    const entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint64_t lines = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        int i = std::countr_zero(mask);
+        auto first = reinterpret_cast<const std::uint8_t *>(&entries[i]) - base;
+        lines |= 1ULL << (first / 64);
+        lines |= 1ULL << ((first + sizeof(entry_type) - 1) / 64);
+    }
+
+    for (lines &= ~1ULL; lines != 0; lines &= lines - 1)
+        pmem_flush(const_cast<std::uint8_t *>(base) + std::countr_zero(lines) * 64, 64);
+}
+
+// The checksum of the outgoing state moves to prev_checksum and the new
+// one is stored before the bitmap, all within the header line. Stores to
+// one line persist in program order, so whichever prefix survives a crash,
+// one of the two checksums matches the bitmap that survived with it.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::commit_leaf(std::uint64_t leaf_offset,
+                                                  std::uint64_t bitmap) {
+    BTreeNode *leaf = offset_to_node(leaf_offset);
+    auto before = static_cast<std::uint32_t>(std::popcount(*get_leaf_bitmap(leaf)));
+    auto after = static_cast<std::uint32_t>(std::popcount(bitmap));
+    if (before != after) {
+        leaves_by_size_[before].fetch_sub(1, std::memory_order_relaxed);
+        leaves_by_size_[after].fetch_add(1, std::memory_order_relaxed);
+    }
+    clear_verified(leaf_offset);
+    leaf->prev_checksum = leaf->checksum;
+    leaf->checksum = leaf_checksum(leaf, bitmap, config_.leaf_capacity);
+    std::atomic_ref<std::uint64_t>(*get_leaf_bitmap(leaf))
+        .store(bitmap, std::memory_order_release);
+    persist(leaf, 64);
+    manager_->update_block_checksum(leaf_offset);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint32_t
+BasicBTree<Key, Value, Compare>::live_entries(BTreeNode *leaf, entry_type *out) const noexcept {
+    const entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint32_t n = 0;
+    for (std::uint64_t bitmap = *get_leaf_bitmap(leaf); bitmap != 0; bitmap &= bitmap - 1)
+        out[n++] = entries[std::countr_zero(bitmap)];
+    return n;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] int BasicBTree<Key, Value, Compare>::find_slot(BTreeNode *leaf,
+                                                            const Key &key) const noexcept {
+    const entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint64_t candidates =
+        fingerprint_match_mask(get_leaf_fingerprints(leaf), fingerprint(key),
+                               static_cast<std::uint32_t>(config_.leaf_capacity)) &
+        *get_leaf_bitmap(leaf);
+    for (; candidates != 0; candidates &= candidates - 1) {
+        int i = std::countr_zero(candidates);
+        if (key_equal(entries[i].key, key)) [[likely]]
+            return i;
+    }
+    return -1;
+}
+
+// In place, the header line first takes the checksum of the updated leaf,
+// keeping the current one as prev_checksum, and only then is the value
+// stored and its line flushed: a crash on either side of that store leaves
+// a leaf that one of the two checksums matches. The header's clflush is
+// ordered before the value store, so one fence after both suffices.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::update_value(std::uint64_t leaf_offset, int slot,
+                                                  const Value &value) {
+    BTreeNode *leaf = offset_to_node(leaf_offset);
+    entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint64_t bitmap = *get_leaf_bitmap(leaf);
+    manager_->mark_dirty(leaf_offset, manager_->block_size());
+
+    if constexpr (in_place_values) {
+        clear_verified(leaf_offset);
+        leaf->prev_checksum = leaf->checksum;
+        leaf->checksum = leaf_checksum(leaf, bitmap, config_.leaf_capacity, slot, &value);
+        pmem_flush(leaf, 64);
+        std::atomic_ref<Value>(entries[slot].value).store(value, std::memory_order_release);
+        persist(&entries[slot].value, sizeof(Value));
+        manager_->update_block_checksum(leaf_offset);
+    } else {
+        // Callers hold a leaf with a free slot; the copy lands there and
+        // one commit retires the old slot as it publishes the new one.
+        int free_slot = std::countr_one(bitmap);
+        entries[free_slot] = {entries[slot].key, value};
+        get_leaf_fingerprints(leaf)[free_slot] = get_leaf_fingerprints(leaf)[slot];
+        flush_leaf_slots(leaf, std::uint64_t{1} << free_slot);
+        commit_leaf(leaf_offset, (bitmap & ~(std::uint64_t{1} << slot)) |
+                                     (std::uint64_t{1} << free_slot));
+    }
+}
+
+// The epoch is read before the snapshot count: snapshot() registers itself
+// before advancing the epoch, so a writer stamped with a snapshot's epoch
+// always sees it open. A record no open snapshot can read, because they
+// were all taken after it or released meanwhile, is dropped.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::record_undo(BTreeNode *leaf, const Key &key,
+                                                  bool inserts) {
+    std::uint64_t stamp = epoch_.load();
+    if (open_snapshots_.load() == 0) [[likely]]
+        return;
+
+    int slot = find_slot(leaf, key);
+    if (slot < 0 && !inserts)
+        return;
+    UndoRecord record{stamp, slot >= 0, {}};
+    const Key *stored = &key;
+    if (slot >= 0) {
+        const entry_type &entry = get_leaf_entries(leaf, config_.leaf_capacity)[slot];
+        record.value = entry.value;
+        stored = &entry.key;
+    }
+    std::lock_guard lock(snapshot_mutex_);
+    if (!snapshot_epochs_.empty() && *snapshot_epochs_.begin() <= stamp)
+        undo_[*stored].push_back(record);
+}
+
+// The state as of epoch: the pre-image of the first change stamped at or
+// after it, or nullptr if the key has not changed since.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] const typename BasicBTree<Key, Value, Compare>::UndoRecord *
+BasicBTree<Key, Value, Compare>::undo_at(const std::vector<UndoRecord> &records,
+                                         std::uint64_t epoch) noexcept {
+    auto it = std::ranges::lower_bound(records, epoch, {}, &UndoRecord::stamp);
+    return it == records.end() ? nullptr : &*it;
+}
+
+template <typename Key, typename Value, typename Compare>
+BasicBTree<Key, Value, Compare>::BasicBTree(Manager *manager, const BTreeConfig &config)
+    : manager_(manager), config_(config),
+      root_offset_(manager->get_root_offset(config.root_slot)), head_leaf_(0),
+      block_locks_(std::make_unique<VersionLock[]>(manager->block_count())),
+      comp_(make_compare(manager)) {
+    if (config_.root_slot >= Manager::Metadata::max_root_slots) [[unlikely]] {
+        throw std::runtime_error(std::format("BTree root_slot {} is past the region's {} slots",
+                                             config_.root_slot,
+                                             Manager::Metadata::max_root_slots));
+    }
+    if (config_.verify_reads)
+        verified_ = std::make_unique<std::atomic<std::uint64_t>[]>(
+            (manager_->block_count() + 63) / 64);
+    if (bytewise_keys && config_.lookup_cache_bytes > 0)
+        cache_ = std::make_unique<LookupCache<Key, Value>>(config_.lookup_cache_bytes);
+    auto *meta = static_cast<Manager::Metadata *>(manager_->base());
+    if (root_offset_.load() == 0) [[unlikely]] {
+        if (config_.leaf_capacity > max_leaf_capacity) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("BTree leaf_capacity {} exceeds the {} fingerprints a leaf header holds",
+                            config_.leaf_capacity, max_leaf_capacity));
+        }
+        if (internal_node_bytes(config_.max_keys) > manager_->block_size() ||
+            leaf_node_bytes(config_.leaf_capacity) > manager_->block_size()) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("BTree config ({} keys, {} leaf entries) does not fit a {} byte block",
+                            config_.max_keys, config_.leaf_capacity,
+                            manager_->block_size()));
+        }
+
+        if (config_.persistence == PersistenceMode::LeavesOnly)
+            dram_nodes_ = std::make_unique<DramNodeArena>(internal_node_bytes(config_.max_keys));
+
+        std::uint64_t root_offset = manager_->alloc_block();
+        BTreeNode *root = offset_to_node(root_offset);
+        root->is_leaf = true;
+        root->key_count = 0;
+        *get_leaf_bitmap(root) = 0;
+
+        meta->max_keys = config_.max_keys;
+        meta->min_keys = config_.min_keys;
+        meta->leaf_capacity = config_.leaf_capacity;
+        meta->key_size = static_cast<std::uint16_t>(sizeof(Key));
+        meta->entry_size = static_cast<std::uint16_t>(sizeof(entry_type));
+        if (config_.persistence == PersistenceMode::LeavesOnly)
+            meta->flags |= Manager::Metadata::flag_leaves_only;
+        persist(meta, sizeof(Manager::Metadata));
+
+        std::uint64_t *next = get_leaf_next(root, config_.leaf_capacity);
+        *next = 0;
+
+        persist_node(root);
+        manager_->set_root_offset(root_offset, config_.root_slot);
+        manager_->update_persistent_checksum();
+        root_offset_.store(root_offset);
+        head_leaf_ = root_offset;
+        count_leaf(0, 1);
+    } else [[likely]] {
+        std::size_t key_size = meta->key_size;
+        std::size_t entry_size = meta->entry_size;
+        if (key_size != sizeof(Key) || entry_size != sizeof(entry_type)) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("Region holds {}-byte keys / {}-byte entries, tree expects {} / {}",
+                            key_size, entry_size, sizeof(Key), sizeof(entry_type)));
+        }
+
+        config_.max_keys = meta->max_keys;
+        config_.min_keys = meta->min_keys;
+        config_.leaf_capacity = meta->leaf_capacity;
+
+        if (meta->flags & Manager::Metadata::flag_leaves_only) {
+            config_.persistence = PersistenceMode::LeavesOnly;
+            dram_nodes_ = std::make_unique<DramNodeArena>(internal_node_bytes(config_.max_keys));
+            head_leaf_ = root_offset_.load();
+            root_offset_.store(rebuild_from_leaf_chain(head_leaf_));
+        } else {
+            config_.persistence = PersistenceMode::Full;
+            head_leaf_ = root_offset_.load();
+            for (BTreeNode *node = offset_to_node(head_leaf_); !node->is_leaf;
+                 node = offset_to_node(head_leaf_))
+                head_leaf_ = get_internal_children(node, config_.max_keys)[0];
+        }
+        if (config.recovery_threads > 0)
+            open_recovery_ = recover(config.recovery_threads);
+        else
+            recount_stats();
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] BTreeNode *
+BasicBTree<Key, Value, Compare>::offset_to_node(std::uint64_t offset) const noexcept {
+    if (offset == 0) [[unlikely]]
+        return nullptr;
+    if (offset & dram_node_tag)
+        return reinterpret_cast<BTreeNode *>(offset & ~dram_node_tag);
+
+    return static_cast<BTreeNode *>(manager_->offset_to_ptr(offset));
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::prefetch_node(std::uint64_t offset) const noexcept {
+    // The child's kind is not known yet, so cover both, up to eight lines.
+    std::size_t internal_bytes =
+        sizeof(BTreeNode) + internal_children_offset(sizeof(Key), config_.max_keys);
+    std::size_t leaf_bytes = sizeof(BTreeNode) + leaf_entries_offset(config_.leaf_capacity) + 128;
+    prefetch_range(offset_to_node(offset),
+                   std::min<std::size_t>(std::max(internal_bytes, leaf_bytes), 512));
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] VersionLock &
+BasicBTree<Key, Value, Compare>::node_lock(std::uint64_t offset) const noexcept {
+    if (offset & dram_node_tag)
+        return DramNodeArena::lock_of(offset_to_node(offset));
+
+    return block_locks_[offset / manager_->block_size()];
+}
+
+template <typename Key, typename Value, typename Compare>
+BasicBTree<Key, Value, Compare>::~BasicBTree() {
+    if (!alloc_cache_.empty())
+        manager_->exchange_pinned_blocks(alloc_cache_, alloc_cache_next_, 0);
+}
+
+// Blocks the GC handed back may still carry the obsolete lock of a node
+// that was merged away.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t BasicBTree<Key, Value, Compare>::alloc_region_node() {
+    std::uint64_t offset;
+    if (config_.alloc_batch_blocks > 1) {
+        std::lock_guard<std::mutex> lock(alloc_cache_mutex_);
+        if (alloc_cache_next_ == alloc_cache_.size()) {
+            manager_->exchange_pinned_blocks(alloc_cache_, alloc_cache_next_,
+                                             config_.alloc_batch_blocks);
+            alloc_cache_next_ = 0;
+        }
+        offset = alloc_cache_[alloc_cache_next_++];
+    } else {
+        offset = manager_->alloc_block();
+    }
+    node_lock(offset).revive();
+    return offset;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t BasicBTree<Key, Value, Compare>::alloc_internal_node() {
+    if (config_.persistence == PersistenceMode::LeavesOnly)
+        return reinterpret_cast<std::uint64_t>(dram_nodes_->allocate()) | dram_node_tag;
+
+    return alloc_region_node();
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t BasicBTree<Key, Value, Compare>::build_internal_levels(
+    std::vector<std::pair<Key, std::uint64_t>> level, std::size_t fanout) {
+    for (int height = 1; level.size() > 1; ++height) {
+        // Spread children evenly so the last node of a level is not a stub.
+        std::size_t n_nodes = (level.size() + fanout - 1) / fanout;
+        std::size_t per_node = level.size() / n_nodes;
+        std::size_t extra = level.size() % n_nodes;
+
+        std::vector<std::pair<Key, std::uint64_t>> parents;
+        parents.reserve(n_nodes);
+
+        std::size_t pos = 0;
+        for (std::size_t n = 0; n < n_nodes; ++n) {
+            std::size_t n_children = per_node + (n < extra ? 1 : 0);
+            std::uint64_t node_offset = alloc_internal_node();
+            BTreeNode *node = offset_to_node(node_offset);
+            node->is_leaf = false;
+
+            Key *keys = get_internal_keys(node);
+            std::uint64_t *children = get_internal_children(node, config_.max_keys);
+            children[0] = level[pos].second;
+            for (std::size_t i = 1; i < n_children; ++i) {
+                keys[i - 1] = level[pos + i].first;
+                children[i] = level[pos + i].second;
+            }
+            node->key_count = static_cast<std::uint32_t>(n_children - 1);
+            persist_node(node);
+
+            count_node(height, 1);
+            parents.emplace_back(level[pos].first, node_offset);
+            pos += n_children;
+        }
+
+        level = std::move(parents);
+    }
+
+    return level.front().second;
+}
+
+// Leaves hold disjoint, ascending key ranges along the chain, so each
+// non-empty leaf's smallest key is a valid separator in front of it.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t
+BasicBTree<Key, Value, Compare>::rebuild_from_leaf_chain(std::uint64_t head_leaf) {
+    std::vector<std::pair<Key, std::uint64_t>> leaves;
+    leaves.emplace_back(Key{}, head_leaf);
+
+    std::uint64_t offset = *get_leaf_next(offset_to_node(head_leaf), config_.leaf_capacity);
+    while (offset != 0) {
+        BTreeNode *leaf = offset_to_node(offset);
+        if (std::uint64_t live = *get_leaf_bitmap(leaf); live != 0) [[likely]] {
+            entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+            const Key *min_key = &entries[std::countr_zero(live)].key;
+            for (live &= live - 1; live != 0; live &= live - 1) {
+                int i = std::countr_zero(live);
+                if (comp_(entries[i].key, *min_key))
+                    min_key = &entries[i].key;
+            }
+            leaves.emplace_back(*min_key, offset);
+        }
+        offset = *get_leaf_next(leaf, config_.leaf_capacity);
+    }
+
+    return build_internal_levels(std::move(leaves),
+                                 static_cast<std::size_t>(config_.max_keys) + 1);
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::bulk_load(std::vector<entry_type> entries,
+                                                double fill_factor) {
+    if (!(fill_factor > 0.0 && fill_factor <= 1.0)) [[unlikely]]
+        throw std::runtime_error(std::format("bulk_load fill factor {} is not in (0, 1]",
+                                             fill_factor));
+
+    std::uint64_t old_root = root_offset_.load();
+    BTreeNode *old_root_node = offset_to_node(old_root);
+    if (!old_root_node->is_leaf || leaf_size(old_root_node) != 0 ||
+        *get_leaf_next(old_root_node, config_.leaf_capacity) != 0) [[unlikely]]
+        throw std::runtime_error("bulk_load needs an empty tree");
+    if (entries.empty())
+        return;
+
+    auto by_key = [this](const entry_type &a, const entry_type &b) {
+        return comp_(a.key, b.key);
+    };
+    if (!std::ranges::is_sorted(entries, by_key)) {
+        if constexpr (std::is_same_v<Compare, std::less<Key>> && std::is_integral_v<Key>) {
+            // Flipping the sign bit makes signed keys sort as unsigned.
+            using Bits = std::make_unsigned_t<Key>;
+            constexpr Bits sign = std::is_signed_v<Key> ? Bits{1} << (sizeof(Key) * 8 - 1) : 0;
+            parallel_radix_sort(
+                entries,
+                [](const entry_type &e) { return static_cast<Bits>(static_cast<Bits>(e.key) ^ sign); },
+                std::thread::hardware_concurrency());
+        } else {
+            std::ranges::stable_sort(entries, by_key);
+        }
+    }
+
+    auto packed = [fill_factor](int capacity, std::size_t min) {
+        auto n = static_cast<std::size_t>(capacity * fill_factor + 0.5);
+        return std::clamp(n, min, static_cast<std::size_t>(capacity));
+    };
+    const std::size_t per_leaf = packed(config_.leaf_capacity, 1);
+    const std::size_t n_leaves = (entries.size() + per_leaf - 1) / per_leaf;
+
+    // Leaves are written right to left so each one links to a leaf that is
+    // already durable; none of them is reachable until the root is published.
+    std::vector<std::pair<Key, std::uint64_t>> level(n_leaves);
+    std::uint64_t next_leaf = 0;
+    for (std::size_t l = n_leaves; l-- > 0;) {
+        std::size_t first = l * per_leaf;
+        std::size_t count = std::min(per_leaf, entries.size() - first);
+
+        std::uint64_t leaf_offset = alloc_region_node();
+        BTreeNode *leaf = offset_to_node(leaf_offset);
+        leaf->is_leaf = true;
+        leaf->key_count = 0;
+        *get_leaf_bitmap(leaf) = count < 64 ? (1ULL << count) - 1 : ~0ULL;
+
+        entry_type *slots = get_leaf_entries(leaf, config_.leaf_capacity);
+        std::uint8_t *fps = get_leaf_fingerprints(leaf);
+        for (std::size_t i = 0; i < count; ++i) {
+            slots[i] = entries[first + i];
+            fps[i] = fingerprint(slots[i].key);
+        }
+        *get_leaf_next(leaf, config_.leaf_capacity) = next_leaf;
+        persist_node(leaf);
+        count_leaf(static_cast<std::uint32_t>(count), 1);
+
+        level[l] = {l == 0 ? entries[first].key
+                           : separator_between(entries[first - 1].key, entries[first].key),
+                    leaf_offset};
+        next_leaf = leaf_offset;
+    }
+
+    std::uint64_t first_leaf = level.front().second;
+    std::uint64_t new_root = build_internal_levels(
+        std::move(level), packed(config_.max_keys + 1, 2));
+
+    // Leaves-only regions record the head of the chain rather than the root.
+    manager_->set_root_offset(
+        config_.persistence == PersistenceMode::Full ? new_root : first_leaf, config_.root_slot);
+    root_offset_.store(new_root, std::memory_order_release);
+    head_leaf_ = first_leaf;
+    manager_->free_block(old_root);
+    count_leaf(0, -1);
+    total_logical_bytes.fetch_add(entries.size() * sizeof(entry_type), std::memory_order_relaxed);
+}
+
+// Optimistic lock coupling: every node is read under a version snapshot that
+// is validated before the next step relies on it, and any failed validation
+// restarts from the root. Full nodes are split on the way down, so a split
+// only ever locks the node and its parent, which is known to have room.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t
+BasicBTree<Key, Value, Compare>::find_leaf(const Key &key, std::uint64_t &leaf_version,
+                                           std::optional<Key> *upper) const {
+    std::uint64_t offset = root_offset_.load(std::memory_order_acquire);
+    std::uint64_t version;
+    if (!node_lock(offset).read_lock(version) ||
+        offset != root_offset_.load(std::memory_order_acquire) ||
+        !verify_node(offset, version)) [[unlikely]]
+        return 0;
+
+    if (upper)
+        upper->reset();
+    BTreeNode *node = offset_to_node(offset);
+    while (!node->is_leaf) {
+        std::uint32_t count =
+            std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+        Key *keys = get_internal_keys(node);
+        std::uint32_t idx = child_index(keys, count, key);
+        std::uint64_t child = get_internal_children(node, config_.max_keys)[idx];
+        prefetch_node(child);
+        // Deeper separators are tighter; a stale one fails validation below.
+        if (upper && idx < count)
+            *upper = keys[idx];
+
+        // The child pointer is only trusted once the parent validates, and
+        // the parent is re-checked after the child's version is taken.
+        VersionLock &lock = node_lock(offset);
+        std::uint64_t child_version;
+        if (!lock.validate(version) || !node_lock(child).read_lock(child_version) ||
+            !lock.validate(version) || !verify_node(child, child_version)) [[unlikely]]
+            return 0;
+
+        offset = child;
+        version = child_version;
+        node = offset_to_node(child);
+    }
+
+    leaf_version = version;
+    return offset;
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::insert(const Key &key, const Value &value) {
+    std::uint64_t leaf = lock_leaf_for_insert(key, nullptr);
+    record_undo(offset_to_node(leaf), key);
+    entry_type entry{key, value};
+    append_to_leaf(leaf, std::span<const entry_type>(&entry, 1));
+    // A blind insert may shadow or be shadowed by an existing entry, so the
+    // cached value is dropped rather than replaced.
+    update_cache(key, nullptr);
+    node_lock(leaf).unlock();
+    total_logical_bytes.fetch_add(sizeof(entry_type), std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool BasicBTree<Key, Value, Compare>::upsert(const Key &key, const Value &value) {
+    total_logical_bytes.fetch_add(sizeof(entry_type), std::memory_order_relaxed);
+    // An update that fits in place needs only the leaf lock; going through
+    // lock_leaf_for_insert would split a full leaf it does not grow.
+    if constexpr (in_place_values) {
+        for (;;) {
+            std::uint64_t version;
+            std::uint64_t leaf_offset = find_leaf(key, version);
+            if (leaf_offset == 0) [[unlikely]]
+                continue;
+            int slot = find_slot(offset_to_node(leaf_offset), key);
+            if (slot < 0)
+                break;
+            if (!node_lock(leaf_offset).try_upgrade(version)) [[unlikely]]
+                continue;
+            record_undo(offset_to_node(leaf_offset), key);
+            update_value(leaf_offset, slot, value);
+            update_cache(key, &value);
+            node_lock(leaf_offset).unlock();
+            return false;
+        }
+    }
+
+    // The key may have arrived since the optimistic probe, so look again
+    // under the lock.
+    std::uint64_t leaf = lock_leaf_for_insert(key, nullptr);
+    record_undo(offset_to_node(leaf), key);
+    int slot = find_slot(offset_to_node(leaf), key);
+    if (slot >= 0) {
+        update_value(leaf, slot, value);
+    } else {
+        entry_type entry{key, value};
+        append_to_leaf(leaf, std::span<const entry_type>(&entry, 1));
+    }
+    update_cache(key, &value);
+    node_lock(leaf).unlock();
+    return slot < 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool BasicBTree<Key, Value, Compare>::update(const Key &key, const Value &value) {
+    total_logical_bytes.fetch_add(sizeof(entry_type), std::memory_order_relaxed);
+    if constexpr (in_place_values) {
+        for (;;) {
+            std::uint64_t version;
+            std::uint64_t leaf_offset = find_leaf(key, version);
+            if (leaf_offset == 0) [[unlikely]]
+                continue;
+            int slot = find_slot(offset_to_node(leaf_offset), key);
+            if (slot < 0) {
+                // A split or redistribution may have moved the key away
+                // while the slots were read.
+                if (!node_lock(leaf_offset).validate(version)) [[unlikely]]
+                    continue;
+                return false;
+            }
+            if (!node_lock(leaf_offset).try_upgrade(version)) [[unlikely]]
+                continue;
+            record_undo(offset_to_node(leaf_offset), key, false);
+            update_value(leaf_offset, slot, value);
+            update_cache(key, &value);
+            node_lock(leaf_offset).unlock();
+            return true;
+        }
+    } else {
+        // A wider value moves to a free slot, which a full leaf has to
+        // split for.
+        std::uint64_t leaf = lock_leaf_for_insert(key, nullptr);
+        int slot = find_slot(offset_to_node(leaf), key);
+        if (slot >= 0) {
+            record_undo(offset_to_node(leaf), key, false);
+            update_value(leaf, slot, value);
+            update_cache(key, &value);
+        }
+        node_lock(leaf).unlock();
+        return slot >= 0;
+    }
+}
+
+// The value is read optimistically; a successful upgrade from the version
+// it was read under proves it unchanged.
+template <typename Key, typename Value, typename Compare>
+bool BasicBTree<Key, Value, Compare>::compare_update(const Key &key, const Value &expected,
+                                                     const Value &desired) {
+    total_logical_bytes.fetch_add(sizeof(entry_type), std::memory_order_relaxed);
+    auto matches = [&](BTreeNode *leaf, int slot) {
+        Value current = get_leaf_entries(leaf, config_.leaf_capacity)[slot].value;
+        return std::memcmp(&current, &expected, sizeof(Value)) == 0;
+    };
+    if constexpr (in_place_values) {
+        for (;;) {
+            std::uint64_t version;
+            std::uint64_t leaf_offset = find_leaf(key, version);
+            if (leaf_offset == 0) [[unlikely]]
+                continue;
+            BTreeNode *leaf = offset_to_node(leaf_offset);
+            int slot = find_slot(leaf, key);
+            bool match = slot >= 0 && matches(leaf, slot);
+            if (!match) {
+                if (!node_lock(leaf_offset).validate(version)) [[unlikely]]
+                    continue;
+                return false;
+            }
+            if (!node_lock(leaf_offset).try_upgrade(version)) [[unlikely]]
+                continue;
+            record_undo(leaf, key, false);
+            update_value(leaf_offset, slot, desired);
+            update_cache(key, &desired);
+            node_lock(leaf_offset).unlock();
+            return true;
+        }
+    } else {
+        std::uint64_t leaf = lock_leaf_for_insert(key, nullptr);
+        int slot = find_slot(offset_to_node(leaf), key);
+        bool match = slot >= 0 && matches(offset_to_node(leaf), slot);
+        if (match) {
+            record_undo(offset_to_node(leaf), key, false);
+            update_value(leaf, slot, desired);
+            update_cache(key, &desired);
+        }
+        node_lock(leaf).unlock();
+        return match;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t
+BasicBTree<Key, Value, Compare>::lock_leaf_for_insert(const Key &key, std::optional<Key> *upper) {
+    for (;;) {
+        std::uint64_t offset = root_offset_.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!node_lock(offset).read_lock(version) ||
+            offset != root_offset_.load(std::memory_order_acquire)) [[unlikely]]
+            continue;
+
+        if (upper)
+            upper->reset();
+        std::uint64_t parent = 0;
+        std::uint64_t parent_version = 0;
+        for (;;) {
+            if (!verify_node(offset, version)) [[unlikely]]
+                break;
+            BTreeNode *node = offset_to_node(offset);
+            VersionLock &lock = node_lock(offset);
+            bool is_leaf = node->is_leaf;
+            std::uint32_t limit = static_cast<std::uint32_t>(
+                is_leaf ? config_.leaf_capacity : config_.max_keys);
+            std::uint32_t count = is_leaf ? leaf_size(node) : std::min(node->key_count, limit);
+
+            if (count == limit) [[unlikely]] {
+                if (parent != 0 && !node_lock(parent).try_upgrade(parent_version))
+                    break;
+                if (!lock.try_upgrade(version)) {
+                    if (parent != 0)
+                        node_lock(parent).unlock();
+                    break;
+                }
+
+                InsertResult split = is_leaf ? split_leaf(offset) : split_internal(offset);
+                if (parent != 0) {
+                    insert_separator(parent, split.split_key, split.new_child_offset);
+                    node_lock(parent).unlock();
+                } else {
+                    grow_root(offset, split);
+                }
+                lock.unlock();
+                break;
+            }
+
+            if (is_leaf) [[likely]] {
+                if (!lock.try_upgrade(version)) [[unlikely]]
+                    break;
+                return offset;
+            }
+
+            Key *keys = get_internal_keys(node);
+            std::uint32_t idx = child_index(keys, count, key);
+            std::uint64_t child = get_internal_children(node, config_.max_keys)[idx];
+            prefetch_node(child);
+            if (upper && idx < count)
+                *upper = keys[idx];
+            std::uint64_t child_version;
+            if (!lock.validate(version) || !node_lock(child).read_lock(child_version) ||
+                !lock.validate(version)) [[unlikely]]
+                break;
+
+            parent = offset;
+            parent_version = version;
+            offset = child;
+            version = child_version;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::grow_root(std::uint64_t old_root_offset,
+                                                const InsertResult &split) {
+    std::uint64_t new_root_offset = alloc_internal_node();
+    BTreeNode *new_root = offset_to_node(new_root_offset);
+    new_root->is_leaf = false;
+    new_root->key_count = 1;
+
+    Key *keys = get_internal_keys(new_root);
+    std::uint64_t *children = get_internal_children(new_root, config_.max_keys);
+
+    keys[0] = split.split_key;
+    children[0] = old_root_offset;
+    children[1] = split.new_child_offset;
+
+    persist_node(new_root);
+    count_node(subtree_level(old_root_offset) + 1, 1);
+    if (config_.persistence == PersistenceMode::Full)
+        manager_->set_root_offset(new_root_offset, config_.root_slot);
+    root_offset_.store(new_root_offset, std::memory_order_release);
+}
+
+// Entries go into free slots and are made durable before the bitmap names
+// them, so the bitmap store is the single commit point. The caller makes
+// sure they fit.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::append_to_leaf(std::uint64_t leaf_offset,
+                                                     std::span<const entry_type> entries) {
+    BTreeNode *leaf = offset_to_node(leaf_offset);
+    entry_type *slots = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint8_t *fps = get_leaf_fingerprints(leaf);
+    std::uint64_t bitmap = *get_leaf_bitmap(leaf);
+    manager_->mark_dirty(leaf_offset, manager_->block_size());
+
+    std::uint64_t added = 0;
+    std::uint64_t free = ~bitmap;
+    for (const entry_type &entry : entries) {
+        int i = std::countr_zero(free);
+        free &= free - 1;
+        slots[i] = entry;
+        fps[i] = fingerprint(entry.key);
+        added |= 1ULL << i;
+    }
+
+    flush_leaf_slots(leaf, added);
+    commit_leaf(leaf_offset, bitmap | added);
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::insert_batch(std::vector<entry_type> entries) {
+    total_logical_bytes.fetch_add(entries.size() * sizeof(entry_type), std::memory_order_relaxed);
+    std::ranges::stable_sort(entries, [this](const entry_type &a, const entry_type &b) {
+        return comp_(a.key, b.key);
+    });
+
+    std::optional<Key> upper;
+    for (std::size_t i = 0; i < entries.size();) {
+        std::uint64_t leaf = lock_leaf_for_insert(entries[i].key, &upper);
+        std::size_t room = static_cast<std::size_t>(config_.leaf_capacity) -
+                           leaf_size(offset_to_node(leaf));
+
+        // Whatever does not fit stays for the next round, which finds the
+        // leaf full and splits it on the way down.
+        std::size_t end = i + 1;
+        while (end < entries.size() && end - i < room &&
+               (!upper || comp_(entries[end].key, *upper)))
+            ++end;
+
+        for (std::size_t j = i; j < end; ++j)
+            record_undo(offset_to_node(leaf), entries[j].key);
+        append_to_leaf(leaf, std::span<const entry_type>(entries).subspan(i, end - i));
+        for (std::size_t j = i; j < end; ++j)
+            update_cache(entries[j].key, nullptr);
+        node_lock(leaf).unlock();
+        i = end;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::insert_separator(std::uint64_t node_offset,
+                                                       const Key &split_key,
+                                                       std::uint64_t new_child_offset) {
+    BTreeNode *node = offset_to_node(node_offset);
+    Key *keys = get_internal_keys(node);
+    std::uint64_t *children = get_internal_children(node, config_.max_keys);
+
+    int count = static_cast<int>(node->key_count);
+    int idx = static_cast<int>(child_index(keys, node->key_count, split_key));
+    for (int i = count; i > idx; --i) {
+        keys[i] = keys[i - 1];
+        children[i + 1] = children[i];
+    }
+
+    keys[idx] = split_key;
+    children[idx + 1] = new_child_offset;
+    node->key_count++;
+
+    persist_node(node);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename BasicBTree<Key, Value, Compare>::InsertResult
+BasicBTree<Key, Value, Compare>::split_leaf(std::uint64_t old_leaf_offset) {
+    BTreeNode *old_leaf = offset_to_node(old_leaf_offset);
+    std::uint64_t new_leaf_offset = alloc_region_node();
+    BTreeNode *new_leaf = offset_to_node(new_leaf_offset);
+    new_leaf->is_leaf = true;
+    new_leaf->key_count = 0;
+
+    entry_type *old_entries = get_leaf_entries(old_leaf, config_.leaf_capacity);
+    entry_type *new_entries = get_leaf_entries(new_leaf, config_.leaf_capacity);
+    std::uint8_t *new_fps = get_leaf_fingerprints(new_leaf);
+
+    // Entries stay in their slots in the old leaf; only the order of the
+    // live slots is needed to pick the half that moves.
+    std::uint64_t old_bitmap = *get_leaf_bitmap(old_leaf);
+    std::vector<int> order;
+    for (std::uint64_t live = old_bitmap; live != 0; live &= live - 1)
+        order.push_back(std::countr_zero(live));
+    std::ranges::sort(order, [&](int a, int b) {
+        return comp_(old_entries[a].key, old_entries[b].key);
+    });
+
+    std::size_t mid = order.size() / 2;
+    std::uint64_t moved = 0;
+    for (std::size_t i = mid; i < order.size(); ++i) {
+        new_entries[i - mid] = old_entries[order[i]];
+        new_fps[i - mid] = fingerprint(new_entries[i - mid].key);
+        moved |= 1ULL << order[i];
+    }
+    std::size_t move_to_new = order.size() - mid;
+    *get_leaf_bitmap(new_leaf) = move_to_new < 64 ? (1ULL << move_to_new) - 1 : ~0ULL;
+    Key split_key = mid == 0 ? old_entries[order[mid]].key
+                             : separator_between(old_entries[order[mid - 1]].key,
+                                                 old_entries[order[mid]].key);
+
+    std::uint64_t *new_next = get_leaf_next(new_leaf, config_.leaf_capacity);
+    std::uint64_t *old_next = get_leaf_next(old_leaf, config_.leaf_capacity);
+    *new_next = *old_next;
+
+    persist_node(new_leaf);
+    count_leaf(static_cast<std::uint32_t>(move_to_new), 1);
+    manager_->mark_dirty(old_leaf_offset, manager_->block_size());
+    atomic_pointer_swap(old_next, new_leaf_offset, nullptr);
+    persist(old_next, sizeof(*old_next));
+
+    commit_leaf(old_leaf_offset, old_bitmap & ~moved);
+
+    return {split_key, new_leaf_offset, true};
+}
+
+template <typename Key, typename Value, typename Compare>
+typename BasicBTree<Key, Value, Compare>::InsertResult
+BasicBTree<Key, Value, Compare>::split_internal(std::uint64_t old_node_offset) {
+    BTreeNode *old_node = offset_to_node(old_node_offset);
+    std::uint64_t new_node_offset = alloc_internal_node();
+    BTreeNode *new_node = offset_to_node(new_node_offset);
+    new_node->is_leaf = false;
+
+    Key *old_keys = get_internal_keys(old_node);
+    std::uint64_t *old_children = get_internal_children(old_node, config_.max_keys);
+    Key *new_keys = get_internal_keys(new_node);
+    std::uint64_t *new_children = get_internal_children(new_node, config_.max_keys);
+
+    int total = static_cast<int>(old_node->key_count);
+    int mid = total / 2;
+    Key split_key = old_keys[mid];
+    int move_count = total - 1 - mid;
+
+    for (int i = 0; i < move_count; ++i) {
+        new_keys[i] = old_keys[mid + 1 + i];
+        new_children[i] = old_children[mid + 1 + i];
+    }
+
+    new_children[move_count] = old_children[total];
+    new_node->key_count = static_cast<std::uint32_t>(move_count);
+    persist_node(new_node);
+
+    old_node->key_count = static_cast<std::uint32_t>(mid);
+    persist_node(old_node);
+    count_node(subtree_level(old_node_offset), 1);
+
+    return {split_key, new_node_offset, true};
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::search(const Key &key,
+                                                           Value &out_value) const {
+    if (!cache_)
+        return search_tree(key, out_value);
+
+    using Clock = std::chrono::steady_clock;
+    bool sample = cache_->should_sample();
+    Clock::time_point start = sample ? Clock::now() : Clock::time_point{};
+    std::uint64_t hash = key_hash(key);
+    std::uint64_t fill_version;
+    bool hit = cache_->lookup(key, hash, out_value, fill_version);
+    bool found = hit;
+    if (!hit) {
+        Value value;
+        found = search_tree(key, value);
+        if (found) {
+            cache_->fill(key, hash, value, fill_version);
+            out_value = value;
+        }
+    }
+    cache_->record(hit);
+    if (sample)
+        cache_->record_sample(hit, Clock::now() - start);
+    return found;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::search_tree(const Key &key,
+                                                                Value &out_value) const {
+    for (;;) {
+        std::uint64_t version;
+        std::uint64_t leaf_offset = find_leaf(key, version);
+        if (leaf_offset == 0) [[unlikely]]
+            continue;
+
+        // Only slots whose fingerprint matches are read, so a miss usually
+        // touches no entry line at all.
+        BTreeNode *leaf = offset_to_node(leaf_offset);
+        int slot = find_slot(leaf, key);
+        bool found = slot >= 0;
+        Value value{};
+        if (found)
+            value = get_leaf_entries(leaf, config_.leaf_capacity)[slot].value;
+
+        if (!node_lock(leaf_offset).validate(version)) [[unlikely]]
+            continue;
+        if (found)
+            out_value = value;
+        return found;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t BasicBTree<Key, Value, Compare>::multi_get(std::span<const Key> keys,
+                                                       std::span<Value> values,
+                                                       std::span<bool> found,
+                                                       std::size_t group) const {
+    if (values.size() < keys.size() || found.size() < keys.size()) [[unlikely]] {
+        throw std::runtime_error(std::format("multi_get of {} keys given {} values, {} flags",
+                                             keys.size(), values.size(), found.size()));
+    }
+    run_interleaved(keys.size(), group, [&](std::size_t i) {
+        return search_interleaved(keys[i], values[i], found[i]);
+    });
+    return static_cast<std::size_t>(std::ranges::count(found.first(keys.size()), true));
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t BasicBTree<Key, Value, Compare>::search_sorted_batch(std::span<const Key> keys,
+                                                                 std::span<Value> values,
+                                                                 std::span<bool> found) const {
+    if (values.size() < keys.size() || found.size() < keys.size()) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("search_sorted_batch of {} keys given {} values, {} flags", keys.size(),
+                        values.size(), found.size()));
+    }
+    if (keys.size() > std::numeric_limits<std::uint32_t>::max()) [[unlikely]]
+        throw std::runtime_error(std::format("search_sorted_batch of {} keys", keys.size()));
+
+    std::vector<std::uint32_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0u);
+    auto key_order = [&](std::uint32_t a, std::uint32_t b) { return comp_(keys[a], keys[b]); };
+    if (!std::ranges::is_sorted(order, key_order))
+        std::ranges::stable_sort(order, key_order);
+
+    const SortedBatch batch{keys, order, values, found};
+    std::size_t done = 0;
+    while (done < keys.size()) {
+        std::uint64_t offset = root_offset_.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!node_lock(offset).read_lock(version) ||
+            offset != root_offset_.load(std::memory_order_acquire) ||
+            !verify_node(offset, version)) [[unlikely]]
+            continue;
+        done = search_sorted_range(batch, offset, version, done, keys.size());
+    }
+    return static_cast<std::size_t>(std::ranges::count(found.first(keys.size()), true));
+}
+
+// Runs are cut with the separator bounding each child on the right, a
+// window of them at a time so their children load together, and read
+// before the node validates like every other field. A child that fails
+// only sends its unresolved keys back through this node, if it still
+// validates; otherwise they go back to the root.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::size_t
+BasicBTree<Key, Value, Compare>::search_sorted_range(const SortedBatch &batch,
+                                                     std::uint64_t offset, std::uint64_t version,
+                                                     std::size_t lo, std::size_t hi) const {
+    auto key_at = [&](std::size_t i) -> const Key & { return batch.keys[batch.order[i]]; };
+    BTreeNode *node = offset_to_node(offset);
+    if (node->is_leaf) {
+        const entry_type *entries = get_leaf_entries(node, config_.leaf_capacity);
+        for (std::size_t i = lo; i < hi; ++i) {
+            int slot = find_slot(node, key_at(i));
+            batch.found[batch.order[i]] = slot >= 0;
+            if (slot >= 0)
+                batch.values[batch.order[i]] = entries[slot].value;
+        }
+        return node_lock(offset).validate(version) ? hi : lo;
+    }
+
+    struct Run {
+        std::uint64_t child;
+        std::size_t end;
+    };
+    std::array<Run, 16> runs;
+    const Key *keys = get_internal_keys(node);
+    const std::uint64_t *children = get_internal_children(node, config_.max_keys);
+    VersionLock &lock = node_lock(offset);
+    for (std::size_t i = lo; i < hi;) {
+        std::uint32_t count = std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+        std::size_t n_runs = 0;
+        for (std::size_t start = i; start < hi && n_runs < runs.size();) {
+            std::uint32_t idx = child_index(keys, count, key_at(start));
+            std::size_t end = start + 1;
+            if (idx < count) {
+                while (end < hi && comp_(key_at(end), keys[idx]))
+                    ++end;
+            } else {
+                end = hi;
+            }
+            runs[n_runs++] = {children[idx], end};
+            prefetch_node(children[idx]);
+            start = end;
+        }
+
+        for (std::size_t r = 0; r < n_runs; ++r) {
+            std::uint64_t child = runs[r].child;
+            std::uint64_t child_version;
+            if (!lock.validate(version) || !node_lock(child).read_lock(child_version) ||
+                !lock.validate(version) || !verify_node(child, child_version)) [[unlikely]]
+                return i;
+            std::size_t done = search_sorted_range(batch, child, child_version, i, runs[r].end);
+            i = done;
+            if (done < runs[r].end) [[unlikely]]
+                break;
+        }
+    }
+    return hi;
+}
+
+// The descent of find_leaf and the probe of search_tree, suspended where
+// they would otherwise wait on memory: at each child, and at the entry a
+// fingerprint picked. Parent versions are validated after the suspension,
+// so a writer that ran meanwhile restarts the lookup as it would a search.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] InterleavedTask
+BasicBTree<Key, Value, Compare>::search_interleaved(const Key &key, Value &out_value,
+                                                    bool &found) const {
+    std::uint64_t hash = 0;
+    std::uint64_t fill_version = 0;
+    if (cache_) {
+        hash = key_hash(key);
+        bool hit = cache_->lookup(key, hash, out_value, fill_version);
+        cache_->record(hit);
+        if (hit) {
+            found = true;
+            co_return;
+        }
+    }
+
+    for (;;) {
+        std::uint64_t offset = root_offset_.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!node_lock(offset).read_lock(version) ||
+            offset != root_offset_.load(std::memory_order_acquire) ||
+            !verify_node(offset, version)) [[unlikely]]
+            continue;
+
+        BTreeNode *node = offset_to_node(offset);
+        bool restart = false;
+        while (!node->is_leaf) {
+            std::uint32_t count =
+                std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+            std::uint32_t idx = child_index(get_internal_keys(node), count, key);
+            std::uint64_t child = get_internal_children(node, config_.max_keys)[idx];
+            prefetch_node(child);
+            co_await std::suspend_always{};
+
+            VersionLock &lock = node_lock(offset);
+            std::uint64_t child_version;
+            if (!lock.validate(version) || !node_lock(child).read_lock(child_version) ||
+                !lock.validate(version) || !verify_node(child, child_version)) [[unlikely]] {
+                restart = true;
+                break;
+            }
+            offset = child;
+            version = child_version;
+            node = offset_to_node(child);
+        }
+        if (restart) [[unlikely]]
+            continue;
+
+        int slot = find_slot(node, key);
+        Value value{};
+        if (slot >= 0) {
+            const entry_type *entry = &get_leaf_entries(node, config_.leaf_capacity)[slot];
+            prefetch_range(entry, sizeof(entry_type));
+            co_await std::suspend_always{};
+            value = entry->value;
+        }
+        if (!node_lock(offset).validate(version)) [[unlikely]]
+            continue;
+
+        found = slot >= 0;
+        if (found) {
+            out_value = value;
+            if (cache_)
+                cache_->fill(key, hash, value, fill_version);
+        }
+        co_return;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::erase(const Key &key) {
+    total_logical_bytes.fetch_add(sizeof(Key), std::memory_order_relaxed);
+    for (;;) {
+        std::uint64_t version;
+        std::uint64_t leaf_offset = find_leaf(key, version);
+        if (leaf_offset == 0 || !node_lock(leaf_offset).try_upgrade(version)) [[unlikely]]
+            continue;
+
+        record_undo(offset_to_node(leaf_offset), key, false);
+        std::size_t erased = erase_from_leaf(leaf_offset, std::span<const Key>(&key, 1));
+        update_cache(key, nullptr);
+        bool repair = erased != 0 && underfull(offset_to_node(leaf_offset));
+        node_lock(leaf_offset).unlock();
+        if (repair) [[unlikely]]
+            rebalance(key);
+        return erased != 0;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t BasicBTree<Key, Value, Compare>::erase_batch(std::vector<Key> keys) {
+    total_logical_bytes.fetch_add(keys.size() * sizeof(Key), std::memory_order_relaxed);
+    std::ranges::sort(keys, comp_);
+
+    std::size_t erased = 0;
+    std::optional<Key> upper;
+    for (std::size_t i = 0; i < keys.size();) {
+        std::uint64_t version;
+        std::uint64_t leaf_offset = find_leaf(keys[i], version, &upper);
+        if (leaf_offset == 0 || !node_lock(leaf_offset).try_upgrade(version)) [[unlikely]]
+            continue;
+
+        std::size_t end = i + 1;
+        while (end < keys.size() && (!upper || comp_(keys[end], *upper)))
+            ++end;
+
+        for (std::size_t j = i; j < end; ++j)
+            record_undo(offset_to_node(leaf_offset), keys[j], false);
+        std::size_t n = erase_from_leaf(leaf_offset, std::span<const Key>(keys).subspan(i, end - i));
+        for (std::size_t j = i; j < end; ++j)
+            update_cache(keys[j], nullptr);
+        bool repair = n != 0 && underfull(offset_to_node(leaf_offset));
+        node_lock(leaf_offset).unlock();
+        if (repair)
+            rebalance(keys[i]);
+        erased += n;
+        i = end;
+    }
+    return erased;
+}
+
+// Hits only lose their bitmap bit; no entry moves, so the whole delete is
+// the one header-line commit.
+template <typename Key, typename Value, typename Compare>
+std::size_t BasicBTree<Key, Value, Compare>::erase_from_leaf(std::uint64_t leaf_offset,
+                                                             std::span<const Key> keys) {
+    BTreeNode *leaf = offset_to_node(leaf_offset);
+    entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+    std::uint8_t *fps = get_leaf_fingerprints(leaf);
+    const std::uint64_t bitmap = *get_leaf_bitmap(leaf);
+
+    std::uint64_t removed = 0;
+    for (const Key &key : keys) {
+        std::uint64_t candidates =
+            fingerprint_match_mask(fps, fingerprint(key),
+                                   static_cast<std::uint32_t>(config_.leaf_capacity)) &
+            bitmap & ~removed;
+        for (; candidates != 0; candidates &= candidates - 1) {
+            std::uint32_t i = static_cast<std::uint32_t>(std::countr_zero(candidates));
+            if (key_equal(entries[i].key, key)) {
+                removed |= std::uint64_t{1} << i;
+                break;
+            }
+        }
+    }
+
+    if (removed == 0) [[unlikely]]
+        return 0;
+
+    manager_->mark_dirty(leaf_offset, manager_->block_size());
+    commit_leaf(leaf_offset, bitmap & ~removed);
+    return static_cast<std::size_t>(std::popcount(removed));
+}
+
+// The minimum is capped at half a node so that a borrow always leaves both
+// siblings at or above it.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool
+BasicBTree<Key, Value, Compare>::underfull(const BTreeNode *node) const noexcept {
+    int capacity = node->is_leaf ? config_.leaf_capacity : config_.max_keys;
+    std::uint32_t size = node->is_leaf ? leaf_size(const_cast<BTreeNode *>(node)) : node->key_count;
+    return size < static_cast<std::uint32_t>(std::min(config_.min_keys, capacity / 2));
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::rebalance(const Key &key) {
+    for (;;) {
+        std::uint64_t offset = root_offset_.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!node_lock(offset).read_lock(version) ||
+            offset != root_offset_.load(std::memory_order_acquire)) [[unlikely]]
+            continue;
+
+        bool restart = false;
+        for (BTreeNode *node = offset_to_node(offset); !node->is_leaf;) {
+            std::uint32_t count =
+                std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+            std::uint32_t idx = child_index(get_internal_keys(node), count, key);
+            std::uint64_t child = get_internal_children(node, config_.max_keys)[idx];
+            prefetch_node(child);
+
+            VersionLock &lock = node_lock(offset);
+            std::uint64_t child_version;
+            if (!lock.validate(version) || !node_lock(child).read_lock(child_version) ||
+                !lock.validate(version) || !verify_node(child, child_version)) [[unlikely]] {
+                restart = true;
+                break;
+            }
+
+            // A node without separators has no sibling to work with; only
+            // the root gets there, and repair_child collapses it.
+            BTreeNode *child_node = offset_to_node(child);
+            if (count > 0 && underfull(child_node)) {
+                // Restart whether or not the repair got its locks; a merge
+                // may have left this node underfull in turn.
+                repair_child(offset, version, idx, child, child_version);
+                restart = true;
+                break;
+            }
+
+            offset = child;
+            version = child_version;
+            node = child_node;
+        }
+
+        if (!restart)
+            return;
+    }
+}
+
+// Locks the parent, the underfull child and its sibling (the right one
+// unless the child is last), then merges the pair if it fits one node and
+// evens it out otherwise. Gives up if any lock is contended.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::repair_child(std::uint64_t parent,
+                                                   std::uint64_t parent_version,
+                                                   std::uint32_t idx, std::uint64_t child,
+                                                   std::uint64_t child_version) {
+    VersionLock &parent_lock = node_lock(parent);
+    if (!parent_lock.try_upgrade(parent_version))
+        return;
+    VersionLock &child_lock = node_lock(child);
+    if (!child_lock.try_upgrade(child_version)) {
+        parent_lock.unlock();
+        return;
+    }
+
+    BTreeNode *parent_node = offset_to_node(parent);
+    std::uint32_t sep_idx = idx < parent_node->key_count ? idx : idx - 1;
+    std::uint64_t *children = get_internal_children(parent_node, config_.max_keys);
+    std::uint64_t sibling = children[sep_idx == idx ? idx + 1 : sep_idx];
+    VersionLock &sibling_lock = node_lock(sibling);
+    std::uint64_t sibling_version;
+    // The sibling is about to be rewritten under a fresh checksum, so it
+    // must check out first; a mismatch must not leave the others locked.
+    bool sibling_ok = sibling_lock.read_lock(sibling_version);
+    try {
+        sibling_ok = sibling_ok && verify_node(sibling, sibling_version);
+    } catch (...) {
+        child_lock.unlock();
+        parent_lock.unlock();
+        throw;
+    }
+    if (!sibling_ok || !sibling_lock.try_upgrade(sibling_version)) {
+        child_lock.unlock();
+        parent_lock.unlock();
+        return;
+    }
+
+    std::uint64_t left = children[sep_idx];
+    std::uint64_t right = children[sep_idx + 1];
+    BTreeNode *left_node = offset_to_node(left);
+    BTreeNode *right_node = offset_to_node(right);
+
+    // A merged pair survives as one child: left for leaves, a fresh node
+    // for internal ones.
+    std::uint64_t merged = 0;
+    if (left_node->is_leaf) {
+        if (leaf_size(left_node) + leaf_size(right_node) <=
+            static_cast<std::uint32_t>(config_.leaf_capacity)) {
+            // The separator goes first, so a crash at any later point
+            // leaves right as a leaf the chain reaches but no parent does,
+            // which recover() handles as an unfinished split.
+            remove_separator(parent, sep_idx, left);
+            merge_leaves(left, right);
+            merged = left;
+        } else {
+            redistribute_leaves(parent, sep_idx, left, right);
+        }
+    } else {
+        if (left_node->key_count + right_node->key_count + 1 <=
+            static_cast<std::uint32_t>(config_.max_keys)) {
+            merged = merge_internal(parent, sep_idx, left, right);
+            remove_separator(parent, sep_idx, merged);
+        } else {
+            redistribute_internal(parent, sep_idx, left, right);
+        }
+    }
+
+    if (merged == 0) {
+        node_lock(left).unlock();
+        node_lock(right).unlock();
+        parent_lock.unlock();
+        return;
+    }
+
+    if (merged == left)
+        node_lock(left).unlock();
+    else
+        node_lock(left).unlock_obsolete();
+    node_lock(right).unlock_obsolete();
+
+    // A root left with a single child hands the tree to that child. Only
+    // the root's lock holder can move root_offset_, so this check is stable.
+    if (parent_node->key_count == 0 &&
+        parent == root_offset_.load(std::memory_order_acquire)) {
+        if (config_.persistence == PersistenceMode::Full)
+            manager_->set_root_offset(merged, config_.root_slot);
+        root_offset_.store(merged, std::memory_order_release);
+        count_node(subtree_level(merged) + 1, -1);
+        parent_lock.unlock_obsolete();
+    } else {
+        parent_lock.unlock();
+    }
+}
+
+// Mirror image of split_leaf, run once the parent no longer routes to
+// right: right's entries are committed into left's free slots first, then
+// right is unlinked from the chain. A crash in between leaves the entries
+// in both leaves with right still on the chain, which recover() repairs
+// like a split whose parent never learned of it, dropping left's copies.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::merge_leaves(std::uint64_t left, std::uint64_t right) {
+    BTreeNode *left_node = offset_to_node(left);
+    BTreeNode *right_node = offset_to_node(right);
+
+    std::vector<entry_type> entries(leaf_size(right_node));
+    if (live_entries(right_node, entries.data()) > 0)
+        append_to_leaf(left, entries);
+
+    manager_->mark_dirty(left, manager_->block_size());
+    std::uint64_t *next = get_leaf_next(left_node, config_.leaf_capacity);
+    atomic_pointer_swap(next, *get_leaf_next(right_node, config_.leaf_capacity), nullptr);
+    persist(next, sizeof(*next));
+    manager_->update_block_checksum(left);
+    count_leaf(leaf_size(right_node), -1);
+}
+
+// Moves the entries nearest the separator into the smaller leaf. The
+// receiver commits them before the separator moves and the donor drops
+// them after, so every key stays reachable at each step.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::redistribute_leaves(std::uint64_t parent,
+                                                          std::uint32_t sep_idx,
+                                                          std::uint64_t left,
+                                                          std::uint64_t right) {
+    BTreeNode *left_node = offset_to_node(left);
+    BTreeNode *right_node = offset_to_node(right);
+    std::uint32_t left_count = leaf_size(left_node);
+    std::uint32_t right_count = leaf_size(right_node);
+    std::uint32_t total = left_count + right_count;
+    bool to_left = left_count < right_count;
+
+    BTreeNode *donor = to_left ? right_node : left_node;
+    std::vector<entry_type> sorted(leaf_size(donor));
+    (void)live_entries(donor, sorted.data());
+    std::ranges::sort(sorted, [this](const entry_type &a, const entry_type &b) {
+        return comp_(a.key, b.key);
+    });
+
+    std::uint32_t n_move = to_left ? total / 2 - left_count : total / 2 - right_count;
+    auto moved = to_left ? std::span<const entry_type>(sorted).first(n_move)
+                         : std::span<const entry_type>(sorted).last(n_move);
+    append_to_leaf(to_left ? left : right, moved);
+
+    BTreeNode *parent_node = offset_to_node(parent);
+    get_internal_keys(parent_node)[sep_idx] =
+        to_left ? separator_between(moved.back().key, sorted[n_move].key)
+                : separator_between(sorted[sorted.size() - n_move - 1].key, moved.front().key);
+    persist_node(parent_node);
+
+    std::vector<Key> moved_keys;
+    moved_keys.reserve(n_move);
+    for (const entry_type &e : moved)
+        moved_keys.push_back(e.key);
+    (void)erase_from_leaf(to_left ? right : left, moved_keys);
+}
+
+// Shadowed like a split: both halves are written to a fresh node, and the
+// parent's single persist in remove_separator swaps it in. Until then the
+// parent still points at left and right, neither of which has changed.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t
+BasicBTree<Key, Value, Compare>::merge_internal(std::uint64_t parent, std::uint32_t sep_idx,
+                                                std::uint64_t left, std::uint64_t right) {
+    BTreeNode *left_node = offset_to_node(left);
+    BTreeNode *right_node = offset_to_node(right);
+    std::uint64_t merged = alloc_internal_node();
+    BTreeNode *merged_node = offset_to_node(merged);
+    merged_node->is_leaf = false;
+    Key *keys = get_internal_keys(merged_node);
+    std::uint64_t *children = get_internal_children(merged_node, config_.max_keys);
+
+    std::uint32_t n = left_node->key_count;
+    std::copy_n(get_internal_keys(left_node), n, keys);
+    std::copy_n(get_internal_children(left_node, config_.max_keys), n + 1, children);
+    keys[n] = get_internal_keys(offset_to_node(parent))[sep_idx];
+    std::copy_n(get_internal_keys(right_node), right_node->key_count, keys + n + 1);
+    std::copy_n(get_internal_children(right_node, config_.max_keys), right_node->key_count + 1,
+                children + n + 1);
+    merged_node->key_count = n + 1 + right_node->key_count;
+    persist_node(merged_node);
+    count_node(subtree_level(right), -1);
+    return merged;
+}
+
+// Rotates separators through the parent until both nodes hold half of
+// the combined keys. Receiver, parent and donor are persisted in that
+// order, mirroring redistribute_leaves.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::redistribute_internal(std::uint64_t parent,
+                                                            std::uint32_t sep_idx,
+                                                            std::uint64_t left,
+                                                            std::uint64_t right) {
+    BTreeNode *parent_node = offset_to_node(parent);
+    BTreeNode *left_node = offset_to_node(left);
+    BTreeNode *right_node = offset_to_node(right);
+    Key *parent_keys = get_internal_keys(parent_node);
+
+    std::vector<Key> keys(get_internal_keys(left_node),
+                          get_internal_keys(left_node) + left_node->key_count);
+    keys.push_back(parent_keys[sep_idx]);
+    keys.insert(keys.end(), get_internal_keys(right_node),
+                get_internal_keys(right_node) + right_node->key_count);
+    std::uint64_t *lc = get_internal_children(left_node, config_.max_keys);
+    std::uint64_t *rc = get_internal_children(right_node, config_.max_keys);
+    std::vector<std::uint64_t> children(lc, lc + left_node->key_count + 1);
+    children.insert(children.end(), rc, rc + right_node->key_count + 1);
+
+    auto n_left = static_cast<std::uint32_t>((keys.size() - 1) / 2);
+    auto n_right = static_cast<std::uint32_t>(keys.size() - 1 - n_left);
+    auto fill_left = [&] {
+        std::copy_n(keys.begin(), n_left, get_internal_keys(left_node));
+        std::copy_n(children.begin(), n_left + 1, lc);
+        left_node->key_count = n_left;
+        persist_node(left_node);
+    };
+    auto fill_right = [&] {
+        std::copy_n(keys.begin() + n_left + 1, n_right, get_internal_keys(right_node));
+        std::copy_n(children.begin() + n_left + 1, n_right + 1, rc);
+        right_node->key_count = n_right;
+        persist_node(right_node);
+    };
+
+    bool to_left = left_node->key_count < right_node->key_count;
+    if (to_left)
+        fill_left();
+    else
+        fill_right();
+    parent_keys[sep_idx] = keys[n_left];
+    persist_node(parent_node);
+    if (to_left)
+        fill_right();
+    else
+        fill_left();
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::remove_separator(std::uint64_t node_offset,
+                                                       std::uint32_t sep_idx,
+                                                       std::uint64_t left_child) {
+    BTreeNode *node = offset_to_node(node_offset);
+    Key *keys = get_internal_keys(node);
+    std::uint64_t *children = get_internal_children(node, config_.max_keys);
+
+    children[sep_idx] = left_child;
+    std::uint32_t count = node->key_count;
+    for (std::uint32_t i = sep_idx; i + 1 < count; ++i) {
+        keys[i] = keys[i + 1];
+        children[i + 1] = children[i + 2];
+    }
+    node->key_count = count - 1;
+    persist_node(node);
+}
+
+template <typename Key, typename Value, typename Compare>
+BasicBTree<Key, Value, Compare>::Cursor::Cursor(const BasicBTree &tree) noexcept
+    : tree_(&tree), entries_{}, count_(0), pos_(0), next_leaf_(0), last_key_(),
+      prefetch_frontier_(0), prefetched_(0), leaves_crossed_(0) {}
+
+// Copies the leaf and its next pointer, then validates the snapshot; false
+// means a writer got in between and the caller must re-read.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::Cursor::copy_leaf(std::uint64_t leaf_offset,
+                                                                      std::uint64_t version) {
+    if (!tree_->verify_node(leaf_offset, version)) [[unlikely]]
+        return false;
+    BTreeNode *leaf = tree_->offset_to_node(leaf_offset);
+    int capacity = tree_->config_.leaf_capacity;
+    const entry_type *entries = get_leaf_entries(leaf, capacity);
+    std::uint64_t bitmap = std::atomic_ref<std::uint64_t>(*get_leaf_bitmap(leaf))
+                               .load(std::memory_order_acquire);
+    bitmap &= capacity < 64 ? (std::uint64_t{1} << capacity) - 1 : ~std::uint64_t{0};
+    std::uint32_t count = 0;
+    for (; bitmap != 0; bitmap &= bitmap - 1)
+        entries_[count++] = entries[std::countr_zero(bitmap)];
+    std::uint64_t next = *get_leaf_next(leaf, capacity);
+    if (!tree_->node_lock(leaf_offset).validate(version)) [[unlikely]]
+        return false;
+
+    std::sort(entries_.begin(), entries_.begin() + count,
+              [this](const entry_type &a, const entry_type &b) {
+                  return tree_->comp_(a.key, b.key);
+              });
+    count_ = count;
+    pos_ = 0;
+    next_leaf_ = next;
+    if (count > 0)
+        last_key_ = entries_[count - 1].key;
+    prefetch_ahead(leaf_offset);
+    return true;
+}
+
+// Keeps scan_prefetch_leaves leaves in flight past the one just copied.
+// Each step reads one next pointer from a leaf prefetched earlier, so only
+// the first leaf after a seek waits on memory. The chain is read without
+// locks; a frontier that went stale only wastes hints until it drains.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Cursor::prefetch_ahead(std::uint64_t leaf_offset) {
+    const BTreeConfig &config = tree_->config_;
+    if (config.scan_prefetch_leaves <= 0)
+        return;
+
+    ++leaves_crossed_;
+    if (prefetched_ > 0)
+        --prefetched_;
+    if (prefetched_ == 0)
+        prefetch_frontier_ = leaf_offset;
+
+    const Manager *manager = tree_->manager_;
+    bool willneed = config.scan_willneed_after > 0 &&
+                    leaves_crossed_ >= static_cast<std::size_t>(config.scan_willneed_after);
+    while (prefetched_ < config.scan_prefetch_leaves) {
+        std::uint64_t next =
+            *get_leaf_next(tree_->offset_to_node(prefetch_frontier_), config.leaf_capacity);
+        if (next == 0 || next % manager->block_size() != 0 || next >= manager->region_size())
+            break;
+
+        prefetch_range(tree_->offset_to_node(next), leaf_node_bytes(config.leaf_capacity));
+        if (willneed)
+            manager->advise_willneed(next, manager->block_size());
+        prefetch_frontier_ = next;
+        ++prefetched_;
+    }
+}
+
+// A next leaf that turns out obsolete was merged into the leaf already
+// copied; the cursor then re-seeks past the last key it has seen.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Cursor::skip_exhausted_leaves() {
+    while (pos_ == count_ && next_leaf_ != 0) {
+        std::uint64_t offset = next_leaf_;
+        for (;;) {
+            std::uint64_t version;
+            if (!tree_->node_lock(offset).read_lock(version)) [[unlikely]] {
+                std::optional<Key> last = last_key_;
+                if (!last) {
+                    seek_to_first();
+                    return;
+                }
+                seek(*last);
+                while (valid() && !tree_->comp_(*last, key()))
+                    next();
+                return;
+            }
+            if (copy_leaf(offset, version))
+                break;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Cursor::seek(const Key &key) {
+    prefetched_ = 0;
+    leaves_crossed_ = 0;
+    for (;;) {
+        std::uint64_t version;
+        std::uint64_t leaf_offset = tree_->find_leaf(key, version);
+        if (leaf_offset != 0 && copy_leaf(leaf_offset, version)) [[likely]]
+            break;
+    }
+
+    pos_ = static_cast<std::uint32_t>(
+        std::lower_bound(entries_.begin(), entries_.begin() + count_, key,
+                         [this](const entry_type &e, const Key &k) {
+                             return tree_->comp_(e.key, k);
+                         }) -
+        entries_.begin());
+    skip_exhausted_leaves();
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Cursor::seek_to_first() {
+    count_ = 0;
+    pos_ = 0;
+    next_leaf_ = tree_->head_leaf_;
+    last_key_.reset();
+    prefetched_ = 0;
+    leaves_crossed_ = 0;
+    skip_exhausted_leaves();
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Cursor::next() {
+    ++pos_;
+    skip_exhausted_leaves();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Fn>
+void BasicBTree<Key, Value, Compare>::scan(const Key &lo, const Key &hi, Fn &&fn) const {
+    Cursor it(*this);
+    for (it.seek(lo); it.valid() && comp_(it.key(), hi); it.next()) {
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn &, const Key &, const Value &>,
+                                     bool>) {
+            if (!fn(it.key(), it.value()))
+                return;
+        } else {
+            fn(it.key(), it.value());
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] typename BasicBTree<Key, Value, Compare>::Snapshot
+BasicBTree<Key, Value, Compare>::snapshot() const {
+    std::lock_guard lock(snapshot_mutex_);
+    std::uint64_t epoch = epoch_.load() + 1;
+    snapshot_epochs_.insert(epoch);
+    open_snapshots_.fetch_add(1);
+    epoch_.store(epoch);
+    return Snapshot(this, epoch);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::size_t BasicBTree<Key, Value, Compare>::snapshot_undo_records() const {
+    std::lock_guard lock(snapshot_mutex_);
+    std::size_t n = 0;
+    for (const auto &[key, records] : undo_)
+        n += records.size();
+    return n;
+}
+
+template <typename Key, typename Value, typename Compare>
+BasicBTree<Key, Value, Compare>::Snapshot::Snapshot(Snapshot &&other) noexcept
+    : tree_(std::exchange(other.tree_, nullptr)), epoch_(other.epoch_) {}
+
+template <typename Key, typename Value, typename Compare>
+typename BasicBTree<Key, Value, Compare>::Snapshot &
+BasicBTree<Key, Value, Compare>::Snapshot::operator=(Snapshot &&other) noexcept {
+    if (this != &other) {
+        release();
+        tree_ = std::exchange(other.tree_, nullptr);
+        epoch_ = other.epoch_;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+BasicBTree<Key, Value, Compare>::Snapshot::~Snapshot() {
+    release();
+}
+
+// Drops every record that only snapshots older than the oldest one still
+// open could read.
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::Snapshot::release() noexcept {
+    if (!tree_)
+        return;
+    std::lock_guard lock(tree_->snapshot_mutex_);
+    tree_->snapshot_epochs_.erase(tree_->snapshot_epochs_.find(epoch_));
+    tree_->open_snapshots_.fetch_sub(1);
+    if (tree_->snapshot_epochs_.empty()) {
+        tree_->undo_.clear();
+    } else {
+        std::uint64_t oldest = *tree_->snapshot_epochs_.begin();
+        for (auto it = tree_->undo_.begin(); it != tree_->undo_.end();) {
+            std::erase_if(it->second, [&](const UndoRecord &r) { return r.stamp < oldest; });
+            it = it->second.empty() ? tree_->undo_.erase(it) : std::next(it);
+        }
+    }
+    tree_ = nullptr;
+}
+
+// The live lookup comes first: a change it missed is still being applied
+// and has already logged the pre-image this then finds.
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool BasicBTree<Key, Value, Compare>::Snapshot::search(const Key &key,
+                                                                     Value &out_value) const {
+    bool found = tree_->search(key, out_value);
+    std::lock_guard lock(tree_->snapshot_mutex_);
+    auto it = tree_->undo_.find(key);
+    if (it == tree_->undo_.end())
+        return found;
+    const UndoRecord *record = undo_at(it->second, epoch_);
+    if (!record)
+        return found;
+    if (record->present)
+        out_value = record->value;
+    return record->present;
+}
+
+// Walks a live cursor and merges in the pre-images of keys changed since
+// the snapshot. Records are fetched one leaf at a time, right after the
+// leaf is copied, for keys up to that leaf's largest: every key in that
+// range was last read from a copy taken before the fetch, so a change the
+// copy shows has its record in the batch.
+template <typename Key, typename Value, typename Compare>
+template <typename Fn>
+void BasicBTree<Key, Value, Compare>::Snapshot::scan(const Key &lo, const Key &hi,
+                                                     Fn &&fn) const {
+    const Compare &comp = tree_->comp_;
+    auto emit = [&](const Key &key, const Value &value) {
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn &, const Key &, const Value &>,
+                                     bool>) {
+            return fn(key, value);
+        } else {
+            fn(key, value);
+            return true;
+        }
+    };
+
+    std::vector<std::pair<Key, UndoRecord>> undo;
+    std::size_t u = 0;
+    std::optional<Key> fetched;   // records are in undo for keys in [lo, *fetched]
+    auto fetch = [&](const std::optional<Key> &upto) {
+        std::lock_guard lock(tree_->snapshot_mutex_);
+        auto it = fetched ? tree_->undo_.upper_bound(*fetched) : tree_->undo_.lower_bound(lo);
+        for (; it != tree_->undo_.end() && comp(it->first, hi) &&
+               (!upto || !comp(*upto, it->first));
+             ++it) {
+            if (const UndoRecord *record = undo_at(it->second, epoch_))
+                undo.emplace_back(it->first, *record);
+        }
+        fetched = upto;
+    };
+
+    Cursor it(*tree_);
+    for (it.seek(lo); it.valid() && comp(it.key(), hi); it.next()) {
+        if (!fetched || comp(*fetched, it.key()))
+            fetch(it.last_key_);
+
+        // Keys the leaves no longer hold but the snapshot does.
+        for (; u < undo.size() && comp(undo[u].first, it.key()); ++u)
+            if (undo[u].second.present && !emit(undo[u].first, undo[u].second.value))
+                return;
+
+        bool ok;
+        if (u < undo.size() && !comp(it.key(), undo[u].first)) {
+            ok = !undo[u].second.present || emit(it.key(), undo[u].second.value);
+            ++u;
+        } else {
+            ok = emit(it.key(), it.value());
+        }
+        if (!ok)
+            return;
+    }
+
+    fetch(std::nullopt);
+    for (; u < undo.size(); ++u)
+        if (undo[u].second.present && !emit(undo[u].first, undo[u].second.value))
+            return;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] int BasicBTree<Key, Value, Compare>::subtree_level(std::uint64_t offset) const noexcept {
+    int level = 0;
+    for (BTreeNode *node = offset_to_node(offset); !node->is_leaf;
+         node = offset_to_node(get_internal_children(node, config_.max_keys)[0]))
+        ++level;
+    return level;
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::recount_stats() {
+    for (auto &n : level_nodes_)
+        n.store(0, std::memory_order_relaxed);
+    for (auto &n : leaves_by_size_)
+        n.store(0, std::memory_order_relaxed);
+
+    std::vector<std::pair<std::uint64_t, int>> stack;
+    stack.emplace_back(root_offset_.load(), subtree_level(root_offset_.load()));
+    while (!stack.empty()) {
+        auto [offset, level] = stack.back();
+        stack.pop_back();
+        BTreeNode *node = offset_to_node(offset);
+        if (node->is_leaf) {
+            count_leaf(leaf_size(node), 1);
+            continue;
+        }
+        count_node(level, 1);
+        std::uint32_t count = std::min(node->key_count, static_cast<std::uint32_t>(config_.max_keys));
+        const std::uint64_t *children = get_internal_children(node, config_.max_keys);
+        for (std::uint32_t i = 0; i <= count; ++i)
+            stack.emplace_back(children[i], level - 1);
+    }
+}
+
+// Recovery runs in three steps. The walk splits the tree at the first
+// level with enough subtrees to balance the threads, then each thread
+// takes subtrees off a shared counter and marks every block it reaches.
+// A leaf the walk reached whose chain successor it did not reach left a
+// split unfinished; the successor and any unreached leaves after it are
+// linked back in once the bitmap matches the reachable blocks, so the
+// allocations a repair makes cannot hand out a live block.
+template <typename Key, typename Value, typename Compare>
+RecoveryReport BasicBTree<Key, Value, Compare>::recover(unsigned threads) {
+    using Clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    const Clock::time_point start = Clock::now();
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    // The bitmap is rebuilt from this tree alone and would drop the others.
+    const auto *meta = static_cast<const Manager::Metadata *>(manager_->base());
+    if (meta->shard_count > 1) [[unlikely]] {
+        throw std::runtime_error(std::format(
+            "recover() rebuilds the bitmap from one tree; the region holds {} shards",
+            meta->shard_count));
+    }
+    if (meta->flags & Manager::Metadata::flag_value_log) [[unlikely]]
+        throw std::runtime_error("recover() cannot see the value log segments the leaves point into");
+
+    RecoveryReport report{};
+    report.threads = threads;
+
+    const std::size_t block_size = manager_->block_size();
+    const std::size_t block_count = manager_->block_count();
+    std::vector<std::atomic<std::uint64_t>> reached((block_count + 63) / 64);
+    std::vector<std::uint64_t> parent_of(block_count, 0);   // leaves only; 0 under the root
+
+    // Returns false if the block was already marked.
+    auto mark = [&](std::uint64_t offset) {
+        std::size_t block = offset / block_size;
+        std::uint64_t bit = std::uint64_t{1} << (block % 64);
+        return !(reached[block / 64].fetch_or(bit, std::memory_order_relaxed) & bit);
+    };
+    auto is_reached = [&](std::uint64_t offset) {
+        std::size_t block = offset / block_size;
+        return (reached[block / 64].load(std::memory_order_relaxed) >> (block % 64)) & 1;
+    };
+    auto in_region = [&](std::uint64_t offset) {
+        return offset % block_size == 0 && offset / block_size >= manager_->reserved_blocks() &&
+               offset / block_size < block_count;
+    };
+    auto mark_key = [&](const Key &key) {
+        if (std::uint64_t ref = key_region_ref(key); ref != 0 && ref / block_size < block_count)
+            mark(ref);
+    };
+
+    struct Tally {
+        std::uint64_t nodes = 0;
+        std::array<std::int64_t, max_tree_levels> levels{};
+        std::array<std::int64_t, max_leaf_capacity + 1> leaf_sizes{};
+        std::vector<std::uint64_t> corrupt;
+        std::vector<std::uint64_t> leaves;
+        std::vector<std::uint64_t> internals;
+    };
+    std::vector<Tally> tallies(threads);
+
+    // Checks one node and marks what it owns; false if the walk must not
+    // descend from it.
+    auto visit = [&](Tally &tally, std::uint64_t offset, int level) {
+        BTreeNode *node = offset_to_node(offset);
+        if (!(offset & dram_node_tag)) {
+            tally.nodes++;
+            std::uint32_t actual = calculate_checksum(node);
+            bool matches = actual == node->checksum ||
+                           (node->is_leaf && actual == node->prev_checksum);
+            if (!matches || node->is_leaf != (level == 0) ||
+                (!node->is_leaf && node->key_count > static_cast<std::uint32_t>(config_.max_keys))) {
+                tally.corrupt.push_back(offset);
+                return false;
+            }
+            if (verified_) {
+                std::size_t block = offset / block_size;
+                verified_[block / 64].fetch_or(std::uint64_t{1} << (block % 64),
+                                               std::memory_order_relaxed);
+            }
+        }
+        if (node->is_leaf) {
+            const entry_type *entries = get_leaf_entries(node, config_.leaf_capacity);
+            for (std::uint64_t live = *get_leaf_bitmap(node); live != 0; live &= live - 1)
+                mark_key(entries[std::countr_zero(live)].key);
+            tally.leaf_sizes[leaf_size(node)]++;
+            tally.leaves.push_back(offset);
+        } else {
+            const Key *keys = get_internal_keys(node);
+            for (std::uint32_t i = 0; i < node->key_count; ++i)
+                mark_key(keys[i]);
+            tally.levels[static_cast<std::size_t>(level)]++;
+            if (!(offset & dram_node_tag))
+                tally.internals.push_back(offset);
+        }
+        return true;
+    };
+    // Passes each child of a node that passed visit to push; a child
+    // outside the region or reached twice makes the node corrupt.
+    auto children_of = [&](Tally &tally, std::uint64_t offset, auto &&push) {
+        BTreeNode *node = offset_to_node(offset);
+        const std::uint64_t *children = get_internal_children(node, config_.max_keys);
+        for (std::uint32_t i = 0; i <= node->key_count; ++i) {
+            std::uint64_t child = children[i];
+            if (child & dram_node_tag) {
+                push(child);
+            } else if (!in_region(child) || !mark(child)) {
+                tally.corrupt.push_back(offset);
+            } else {
+                push(child);
+            }
+        }
+    };
+
+    // Frontier entries are (offset, level, parent).
+    struct Task {
+        std::uint64_t offset;
+        int level;
+        std::uint64_t parent;
+    };
+    std::uint64_t root = root_offset_.load(std::memory_order_acquire);
+    std::vector<Task> frontier{{root, subtree_level(root), 0}};
+    if (!(root & dram_node_tag))
+        mark(root);
+    while (frontier.size() < static_cast<std::size_t>(threads) * 8 && frontier.front().level > 0) {
+        std::vector<Task> next;
+        for (const Task &task : frontier) {
+            if (!visit(tallies[0], task.offset, task.level))
+                continue;
+            children_of(tallies[0], task.offset, [&](std::uint64_t child) {
+                next.push_back({child, task.level - 1, task.offset});
+            });
+        }
+        frontier = std::move(next);
+        if (frontier.empty())
+            break;
+    }
+
+    std::atomic<std::size_t> next_task{0};
+    run_parallel(threads, [&](unsigned t) {
+        Tally &tally = tallies[t];
+        std::vector<Task> stack;
+        std::size_t i = 0;
+        while ((i = next_task.fetch_add(1, std::memory_order_relaxed)) < frontier.size()) {
+            stack.push_back(frontier[i]);
+            while (!stack.empty()) {
+                Task task = stack.back();
+                stack.pop_back();
+                if (!visit(tally, task.offset, task.level))
+                    continue;
+                if (task.level == 0) {
+                    if (!(task.offset & dram_node_tag))
+                        parent_of[task.offset / block_size] = task.parent;
+                    continue;
+                }
+                children_of(tally, task.offset, [&](std::uint64_t child) {
+                    stack.push_back({child, task.level - 1, task.offset});
+                });
+            }
+        }
+    });
+
+    // Leaves the walk reached whose successor it did not.
+    std::vector<std::vector<std::pair<std::uint64_t, std::uint64_t>>> breaks(threads);
+    run_parallel(threads, [&](unsigned t) {
+        for (std::uint64_t leaf : tallies[t].leaves) {
+            std::uint64_t next = *get_leaf_next(offset_to_node(leaf), config_.leaf_capacity);
+            if (next == 0 || (in_region(next) && is_reached(next)))
+                continue;
+            if (in_region(next))
+                breaks[t].emplace_back(leaf, next);
+            else
+                tallies[t].corrupt.push_back(leaf);
+        }
+    });
+
+    for (Tally &tally : tallies) {
+        report.nodes_checked += tally.nodes;
+        report.corrupt_nodes.insert(report.corrupt_nodes.end(), tally.corrupt.begin(),
+                                    tally.corrupt.end());
+    }
+
+    // Unreached leaves along each break. An empty one is only ever left by
+    // a rebuild that skipped it, and is dropped from the chain instead.
+    struct Orphan {
+        std::uint64_t left;
+        std::uint64_t leaf;
+        bool empty;
+    };
+    std::vector<Orphan> orphans;
+    std::map<std::uint64_t, std::size_t> parent_load;   // separators each parent gains
+    for (const auto &thread_breaks : breaks) {
+        for (auto [left, leaf] : thread_breaks) {
+            std::uint64_t parent = parent_of[left / block_size];
+            while (leaf != 0 && in_region(leaf) && !is_reached(leaf)) {
+                BTreeNode *node = offset_to_node(leaf);
+                std::uint32_t actual = calculate_checksum(node);
+                if (!node->is_leaf || (actual != node->checksum && actual != node->prev_checksum)) {
+                    report.corrupt_nodes.push_back(leaf);
+                    break;
+                }
+                bool empty = leaf_size(node) == 0;
+                orphans.push_back({left, leaf, empty});
+                if (!empty) {
+                    mark(leaf);
+                    const entry_type *entries = get_leaf_entries(node, config_.leaf_capacity);
+                    for (std::uint64_t live = *get_leaf_bitmap(node); live != 0; live &= live - 1)
+                        mark_key(entries[std::countr_zero(live)].key);
+                    parent_load[parent]++;
+                    left = leaf;
+                }
+                leaf = *get_leaf_next(node, config_.leaf_capacity);
+            }
+        }
+    }
+    std::ranges::sort(report.corrupt_nodes);
+    auto repeats = std::ranges::unique(report.corrupt_nodes);
+    report.corrupt_nodes.erase(repeats.begin(), repeats.end());
+    const Clock::time_point walked = Clock::now();
+    report.walk_ms = elapsed_ms(start, walked);
+
+    // Counters from the walk; the repairs below adjust them as they go.
+    for (auto &n : level_nodes_)
+        n.store(0, std::memory_order_relaxed);
+    for (auto &n : leaves_by_size_)
+        n.store(0, std::memory_order_relaxed);
+    for (const Tally &tally : tallies) {
+        for (std::size_t level = 1; level < tally.levels.size(); ++level)
+            count_node(static_cast<int>(level), tally.levels[level]);
+        for (std::size_t size = 0; size < tally.leaf_sizes.size(); ++size)
+            if (tally.leaf_sizes[size] != 0)
+                count_leaf(static_cast<std::uint32_t>(size), tally.leaf_sizes[size]);
+    }
+    for (const Orphan &orphan : orphans)
+        if (!orphan.empty)
+            count_leaf(leaf_size(offset_to_node(orphan.leaf)), 1);
+
+    if (!report.corrupt_nodes.empty()) {
+        report.total_ms = elapsed_ms(start, Clock::now());
+        return report;
+    }
+
+    // A parent with too little room for its orphans would need splits all
+    // the way up; the internal levels are rebuilt from the chain instead.
+    report.internal_rebuilt = std::ranges::any_of(parent_load, [&](const auto &load) {
+        std::uint32_t used = load.first == 0 ? 0 : offset_to_node(load.first)->key_count;
+        return used + load.second > static_cast<std::size_t>(config_.max_keys);
+    });
+    if (report.internal_rebuilt) {
+        for (const Tally &tally : tallies) {
+            for (std::uint64_t offset : tally.internals) {
+                std::size_t block = offset / block_size;
+                reached[block / 64].fetch_and(~(std::uint64_t{1} << (block % 64)),
+                                              std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::vector<std::uint64_t> live(reached.size());
+    for (std::size_t i = 0; i < reached.size(); ++i)
+        live[i] = reached[i].load(std::memory_order_relaxed);
+    for (std::size_t block = 0; block < manager_->reserved_blocks(); ++block)
+        live[block / 64] |= std::uint64_t{1} << (block % 64);
+    for (std::uint64_t pinned : manager_->pinned_blocks())
+        live[pinned / block_size / 64] |= std::uint64_t{1} << (pinned / block_size % 64);
+    Manager::BitmapRebuild rebuilt = manager_->rebuild_bitmap(live, threads);
+    report.blocks_freed = rebuilt.freed;
+    report.blocks_restored = rebuilt.restored;
+    const Clock::time_point swept = Clock::now();
+    report.bitmap_ms = elapsed_ms(walked, swept);
+
+    // Empty leaves were freed above, so they leave the chain before any
+    // repair can allocate their blocks.
+    for (const Orphan &orphan : orphans) {
+        if (!orphan.empty)
+            continue;
+        std::uint64_t *next = get_leaf_next(offset_to_node(orphan.left), config_.leaf_capacity);
+        manager_->mark_dirty(orphan.left, block_size);
+        atomic_pointer_swap(next, *get_leaf_next(offset_to_node(orphan.leaf), config_.leaf_capacity),
+                            nullptr);
+        persist(next, sizeof(*next));
+    }
+    for (const Orphan &orphan : orphans) {
+        if (orphan.empty)
+            continue;
+        BTreeNode *left = offset_to_node(orphan.left);
+        BTreeNode *leaf = offset_to_node(orphan.leaf);
+
+        // A crash before the left leaf's commit leaves the moved half in
+        // both leaves; the left copies go.
+        const entry_type *entries = get_leaf_entries(leaf, config_.leaf_capacity);
+        std::uint64_t bits = *get_leaf_bitmap(leaf);
+        const Key *min_key = &entries[std::countr_zero(bits)].key;
+        for (bits &= bits - 1; bits != 0; bits &= bits - 1)
+            if (comp_(entries[std::countr_zero(bits)].key, *min_key))
+                min_key = &entries[std::countr_zero(bits)].key;
+
+        const entry_type *left_entries = get_leaf_entries(left, config_.leaf_capacity);
+        std::uint64_t left_bitmap = *get_leaf_bitmap(left);
+        std::uint64_t keep = 0;
+        const Key *left_max = nullptr;
+        for (std::uint64_t live_bits = left_bitmap; live_bits != 0; live_bits &= live_bits - 1) {
+            int i = std::countr_zero(live_bits);
+            if (!comp_(left_entries[i].key, *min_key))
+                continue;
+            keep |= std::uint64_t{1} << i;
+            if (!left_max || comp_(*left_max, left_entries[i].key))
+                left_max = &left_entries[i].key;
+        }
+        if (keep != left_bitmap)
+            commit_leaf(orphan.left, keep);
+        report.splits_repaired++;
+        if (report.internal_rebuilt)
+            continue;
+
+        Key split_key = left_max ? separator_between(*left_max, *min_key) : *min_key;
+        std::uint64_t parent = parent_of[orphan.left / block_size];
+        if (parent == 0) {
+            grow_root(orphan.left, {split_key, orphan.leaf, true});
+            parent = root_offset_.load(std::memory_order_relaxed);
+        } else {
+            insert_separator(parent, split_key, orphan.leaf);
+        }
+        parent_of[orphan.leaf / block_size] = parent;
+    }
+
+    if (report.internal_rebuilt) {
+        for (std::size_t level = 1; level < level_nodes_.size(); ++level)
+            level_nodes_[level].store(0, std::memory_order_relaxed);
+        std::uint64_t new_root = rebuild_from_leaf_chain(head_leaf_);
+        if (config_.persistence == PersistenceMode::Full)
+            manager_->set_root_offset(new_root, config_.root_slot);
+        root_offset_.store(new_root, std::memory_order_release);
+    }
+    const Clock::time_point repaired = Clock::now();
+    report.repair_ms = elapsed_ms(swept, repaired);
+    report.total_ms = elapsed_ms(start, repaired);
+    return report;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] TreeStats BasicBTree<Key, Value, Compare>::stats() const {
+    TreeStats s{};
+    for (std::size_t level = 0; level < level_nodes_.size(); ++level) {
+        auto n = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(level_nodes_[level].load(std::memory_order_relaxed), 0));
+        s.nodes_per_level[level] = n;
+        if (n > 0)
+            s.height = static_cast<std::uint32_t>(level + 1);
+        if (level > 0)
+            s.internal_nodes += n;
+    }
+    s.leaves = s.nodes_per_level[0];
+
+    auto capacity = static_cast<std::uint64_t>(config_.leaf_capacity);
+    for (std::uint64_t size = 0; size <= capacity; ++size) {
+        auto n = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(leaves_by_size_[size].load(std::memory_order_relaxed), 0));
+        s.entries += size * n;
+        s.leaf_fill_histogram[std::min<std::uint64_t>(size * 10 / capacity, 9)] += n;
+    }
+    if (s.leaves > 0)
+        s.average_leaf_fill =
+            static_cast<double>(s.entries) / static_cast<double>(s.leaves * capacity);
+    // Every node but the root is the child of one internal node.
+    if (s.internal_nodes > 0)
+        s.average_fanout = static_cast<double>(s.leaves + s.internal_nodes - 1) /
+                           static_cast<double>(s.internal_nodes);
+
+    s.live_blocks = config_.persistence == PersistenceMode::Full ? s.leaves + s.internal_nodes
+                                                                 : s.leaves;
+    s.allocated_blocks = manager_->allocated_blocks() - manager_->reserved_blocks();
+    const auto *meta = static_cast<const Manager::Metadata *>(manager_->base());
+    bool alone = !(meta->flags & (Manager::Metadata::flag_var_keys |
+                                  Manager::Metadata::flag_value_log)) &&
+                 meta->shard_splits == 0;
+    for (std::uint32_t slot = 0; alone && slot < Manager::Metadata::max_root_slots; ++slot)
+        alone = slot == config_.root_slot || manager_->get_root_offset(slot) == 0;
+    if (alone && s.allocated_blocks > 0)
+        s.fragmentation = 1.0 - static_cast<double>(std::min(s.live_blocks, s.allocated_blocks)) /
+                                    static_cast<double>(s.allocated_blocks);
+    return s;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] LookupCacheStats
+BasicBTree<Key, Value, Compare>::lookup_cache_stats() const noexcept {
+    return cache_ ? cache_->stats() : LookupCacheStats{};
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::print_telemetry() const {
+    TreeStats s = stats();
+    std::string levels;
+    for (std::uint32_t level = 0; level < s.height; ++level)
+        levels += std::format("{}{}", level ? ", " : "", s.nodes_per_level[level]);
+    std::string fill;
+    for (std::size_t i = 0; i < s.leaf_fill_histogram.size(); ++i)
+        fill += std::format("{}{}", i ? ", " : "", s.leaf_fill_histogram[i]);
+    std::cout << std::format(
+                     R"({{"type": "tree", "height": {}, "nodes_per_level": [{}], "leaves": {}, "internal_nodes": {}, "entries": {}, "leaf_fill_histogram": [{}], "average_leaf_fill": {:.4f}, "average_fanout": {:.2f}, "live_blocks": {}, "allocated_blocks": {}, "fragmentation": {:.4f}}})",
+                     s.height, levels, s.leaves, s.internal_nodes, s.entries, fill,
+                     s.average_leaf_fill, s.average_fanout, s.live_blocks, s.allocated_blocks,
+                     s.fragmentation)
+              << std::endl;
+
+    LookupCacheStats cache = lookup_cache_stats();
+    std::cout << std::format(
+                     R"({{"type": "lookup_cache", "enabled": {}, "hits": {}, "misses": {}, "hit_rate": {:.4f}, "hit_ns": {:.1f}, "miss_ns": {:.1f}, "evictions": {}, "entries": {}, "capacity": {}, "bytes": {}}})",
+                     cache_ != nullptr, cache.hits, cache.misses, cache.hit_rate,
+                     cache.hit_ns, cache.miss_ns, cache.evictions, cache.entries,
+                     cache.capacity, cache.bytes)
+              << std::endl;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint64_t BasicBTree<Key, Value, Compare>::root_offset() const noexcept {
+    return root_offset_.load(std::memory_order_acquire);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] PersistenceMode BasicBTree<Key, Value, Compare>::persistence() const noexcept {
+    return config_.persistence;
+}
+
+template <typename Key, typename Value, typename Compare>
+void BasicBTree<Key, Value, Compare>::print_tree() const {
+    TreeStats s = stats();
+    std::cout << std::format("B+ tree: height {}, {} entries in {} leaves and {} internal nodes\n",
+                             s.height, s.entries, s.leaves, s.internal_nodes);
+    for (std::uint32_t level = s.height; level-- > 0;)
+        std::cout << std::format("  level {}: {} nodes\n", level, s.nodes_per_level[level]);
+    std::cout << std::format("  leaf fill {:.1f}%, fanout {:.2f}\n", 100.0 * s.average_leaf_fill,
+                             s.average_fanout);
+    for (std::size_t i = 0; i < s.leaf_fill_histogram.size(); ++i)
+        std::cout << std::format("    {:3}-{:3}%: {}\n", i * 10, i * 10 + 10,
+                                 s.leaf_fill_histogram[i]);
+    std::cout << std::format("  blocks: {} live of {} allocated ({:.1f}% fragmentation)\n",
+                             s.live_blocks, s.allocated_blocks, 100.0 * s.fragmentation);
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_BTREE_IMPL_H
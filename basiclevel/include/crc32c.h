@@ -0,0 +1,23 @@
+#ifndef ATOMIC_TREE_CRC32C_H
+#define ATOMIC_TREE_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace atomic_tree {
+
+// CRC32C (Castagnoli) of [data, data + len). Passing the result of one call
+// as crc to the next checksums discontiguous ranges as a single stream.
+// Uses the SSE4.2 crc32 instruction over three interleaved streams when the
+// CPU has it (checked on first use) and slicing-by-8 tables otherwise.
+[[nodiscard]] std::uint32_t crc32c(const void *data, std::size_t len,
+                                   std::uint32_t crc = 0) noexcept;
+
+// Switches between the hardware and table paths, e.g. for benchmarks.
+// Returns whether the hardware path is now in use.
+bool enable_hw_crc32c(bool enabled) noexcept;
+[[nodiscard]] bool hw_crc32c_enabled() noexcept;
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_CRC32C_H
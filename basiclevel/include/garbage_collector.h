@@ -7,7 +7,6 @@ namespace atomic_tree {
 
 class Manager;
 struct BTreeNode;
-class BTree;
 
 class GarbageCollector {
 public:
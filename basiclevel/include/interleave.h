@@ -0,0 +1,154 @@
+#ifndef ATOMIC_TREE_INTERLEAVE_H
+#define ATOMIC_TREE_INTERLEAVE_H
+
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace atomic_tree {
+
+// Recycles coroutine frames of one size per thread, so starting a lookup
+// does not cost a trip to the heap. Frames of other sizes bypass it.
+class FramePool {
+public:
+    FramePool() noexcept = default;
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+    ~FramePool() {
+        while (head_) {
+            Free *next = head_->next;
+            ::operator delete(head_);
+            head_ = next;
+        }
+    }
+
+    [[nodiscard]] void *allocate(std::size_t size) {
+        if (size == size_ && head_) {
+            Free *frame = head_;
+            head_ = frame->next;
+            --count_;
+            return frame;
+        }
+        return ::operator new(size);
+    }
+    void release(void *frame, std::size_t size) noexcept {
+        if (size_ == 0 && size >= sizeof(Free))
+            size_ = size;
+        if (size != size_ || count_ == max_frames) {
+            ::operator delete(frame);
+            return;
+        }
+        head_ = new (frame) Free{head_};
+        ++count_;
+    }
+
+    [[nodiscard]] static FramePool &local() noexcept {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+private:
+    struct Free {
+        Free *next;
+    };
+    static constexpr std::size_t max_frames = 64;
+
+    std::size_t size_ = 0;
+    Free *head_ = nullptr;
+    std::size_t count_ = 0;
+};
+
+// A coroutine that run_interleaved resumes until it finishes. It starts
+// suspended and should suspend (co_await std::suspend_always{}) right after
+// prefetching a line it is about to need, so other tasks run while the
+// line loads.
+class InterleavedTask {
+public:
+    struct promise_type {
+        std::exception_ptr error;
+
+        InterleavedTask get_return_object() noexcept {
+            return InterleavedTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+
+        static void *operator new(std::size_t size) { return FramePool::local().allocate(size); }
+        static void operator delete(void *frame, std::size_t size) noexcept {
+            FramePool::local().release(frame, size);
+        }
+    };
+
+    InterleavedTask() noexcept = default;
+    InterleavedTask(InterleavedTask &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {}
+    InterleavedTask &operator=(InterleavedTask &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~InterleavedTask() { reset(); }
+
+    // Runs to the next suspension; true once the task has finished.
+    // Rethrows what the task threw.
+    bool step() {
+        handle_.resume();
+        if (!handle_.done())
+            return false;
+        if (std::exception_ptr error = handle_.promise().error)
+            std::rethrow_exception(error);
+        return true;
+    }
+
+private:
+    explicit InterleavedTask(std::coroutine_handle<promise_type> handle) noexcept
+        : handle_(handle) {}
+    void reset() noexcept {
+        if (handle_)
+            handle_.destroy();
+        handle_ = nullptr;
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+inline constexpr std::size_t max_interleaved_tasks = 64;
+
+// Runs make(i) for every i in [0, n), keeping up to group tasks in flight
+// and resuming them round-robin. A finished task's slot goes to the next
+// i, so slow and fast tasks mix freely.
+template <typename Make>
+void run_interleaved(std::size_t n, std::size_t group, Make &&make) {
+    group = std::clamp<std::size_t>(group, 1, max_interleaved_tasks);
+    std::array<InterleavedTask, max_interleaved_tasks> slots;
+    std::size_t next = 0;
+    std::size_t active = 0;
+    for (; active < group && next < n; ++active)
+        slots[active] = make(next++);
+
+    while (active > 0) {
+        for (std::size_t s = 0; s < active;) {
+            if (!slots[s].step()) {
+                ++s;
+            } else if (next < n) {
+                slots[s++] = make(next++);
+            } else {
+                // The last slot moves into the finished one and runs next.
+                --active;
+                slots[s] = s == active ? InterleavedTask{} : std::move(slots[active]);
+            }
+        }
+    }
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_INTERLEAVE_H
@@ -0,0 +1,255 @@
+#ifndef ATOMIC_TREE_LOOKUP_CACHE_H
+#define ATOMIC_TREE_LOOKUP_CACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "version_lock.h"
+
+namespace atomic_tree {
+
+struct LookupCacheStats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    std::size_t   entries;
+    std::size_t   capacity;
+    std::size_t   bytes;
+    double        hit_rate;
+    double        hit_ns;    // sampled; a miss includes the tree lookup
+    double        miss_ns;
+};
+
+// Bounded key -> value cache in DRAM for point lookups. Keys hash to a set
+// of eight ways behind its own VersionLock, so a hit is a lock-free read of
+// one or two lines. Eviction follows S3-FIFO within a set: new entries are
+// probationary and go first unless a hit promoted them, and promoted
+// entries are evicted by CLOCK over per-way reference bits. Keys evicted
+// from probation leave a ghost tag, and one that comes back within the
+// ghost window is admitted as promoted. A stream of one-off keys thus
+// churns through the probationary ways and leaves the reused ones alone.
+//
+// A reader that misses keeps the set version it saw and fills only if the
+// set is unchanged by then, and writers update the set after changing the
+// tree, so a fill can never reinstate a value a writer has already
+// replaced. Keys compare by their bytes, so the tree only builds one for
+// keys whose equality is bytewise.
+template <typename Key, typename Value>
+class LookupCache {
+public:
+    static constexpr int ways = 8;
+
+    // Sized to the largest power-of-two number of sets within budget_bytes.
+    explicit LookupCache(std::size_t budget_bytes)
+        : set_count_(std::bit_floor(std::max<std::size_t>(budget_bytes / sizeof(Set), 1))),
+          sets_(std::make_unique<Set[]>(set_count_)) {}
+
+    // On a miss, fill_version receives the version to pass to fill().
+    [[nodiscard]] bool lookup(const Key &key, std::uint64_t hash, Value &out_value,
+                              std::uint64_t &fill_version) const noexcept {
+        const Set &set = set_for(hash);
+        const std::uint16_t tag = tag_of(hash);
+        for (;;) {
+            std::uint64_t version;
+            (void)set.lock.read_lock(version);
+            int way = find(set, key, tag);
+            Value value{};
+            if (way >= 0)
+                value = set.values[way];
+            if (!set.lock.validate(version)) [[unlikely]]
+                continue;
+
+            if (way < 0) {
+                fill_version = version;
+                return false;
+            }
+            auto bit = static_cast<std::uint8_t>(1u << way);
+            if (!(set.referenced.load(std::memory_order_relaxed) & bit))
+                set.referenced.fetch_or(bit, std::memory_order_relaxed);
+            out_value = value;
+            return true;
+        }
+    }
+
+    void fill(const Key &key, std::uint64_t hash, const Value &value,
+              std::uint64_t fill_version) noexcept {
+        Set &set = set_for(hash);
+        if (!set.lock.try_upgrade(fill_version))
+            return;
+
+        int way = std::countr_one(set.used);
+        if (way == ways) {
+            way = victim(set);
+            stripe().evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto bit = static_cast<std::uint8_t>(1u << way);
+        std::uint16_t ghost = tag_of(hash) | 1;
+        if (std::ranges::find(set.ghosts, ghost) != set.ghosts.end())
+            set.main |= bit;
+        else
+            set.main &= static_cast<std::uint8_t>(~bit);
+        set.referenced.fetch_and(static_cast<std::uint8_t>(~bit), std::memory_order_relaxed);
+        set.tags[way] = tag_of(hash);
+        set.keys[way] = key;
+        set.values[way] = value;
+        set.used |= bit;
+        set.lock.unlock();
+    }
+
+    // Writers call this after changing key in the tree, while still holding
+    // its leaf lock: a cached entry takes value, or is dropped if value is
+    // null. The set version moves either way, which voids pending fills.
+    void update(const Key &key, std::uint64_t hash, const Value *value) noexcept {
+        Set &set = set_for(hash);
+        for (;;) {
+            std::uint64_t version;
+            (void)set.lock.read_lock(version);
+            if (set.lock.try_upgrade(version))
+                break;
+        }
+        int way = find(set, key, tag_of(hash));
+        if (way >= 0) {
+            if (value) {
+                set.values[way] = *value;
+            } else {
+                set.used &= static_cast<std::uint8_t>(~(1u << way));
+                set.main &= static_cast<std::uint8_t>(~(1u << way));
+            }
+        }
+        set.lock.unlock();
+    }
+
+    // Counting is striped by thread, and one lookup in sample_period is
+    // timed by the caller.
+    static constexpr unsigned sample_period = 64;
+
+    [[nodiscard]] bool should_sample() const noexcept {
+        thread_local unsigned tick = 0;
+        return ++tick % sample_period == 0;
+    }
+    void record(bool hit) const noexcept {
+        Counters &c = stripe();
+        (hit ? c.hits : c.misses).fetch_add(1, std::memory_order_relaxed);
+    }
+    void record_sample(bool hit, std::chrono::nanoseconds elapsed) const noexcept {
+        Counters &c = stripe();
+        auto ns = static_cast<std::uint64_t>(elapsed.count());
+        (hit ? c.hit_ns : c.miss_ns).fetch_add(ns, std::memory_order_relaxed);
+        (hit ? c.timed_hits : c.timed_misses).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] LookupCacheStats stats() const noexcept {
+        LookupCacheStats s{};
+        std::uint64_t hit_ns = 0, miss_ns = 0, timed_hits = 0, timed_misses = 0;
+        for (const Counters &c : stripes_) {
+            s.hits += c.hits.load(std::memory_order_relaxed);
+            s.misses += c.misses.load(std::memory_order_relaxed);
+            s.evictions += c.evictions.load(std::memory_order_relaxed);
+            hit_ns += c.hit_ns.load(std::memory_order_relaxed);
+            miss_ns += c.miss_ns.load(std::memory_order_relaxed);
+            timed_hits += c.timed_hits.load(std::memory_order_relaxed);
+            timed_misses += c.timed_misses.load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < set_count_; ++i)
+            s.entries += static_cast<std::size_t>(std::popcount(sets_[i].used));
+        s.capacity = set_count_ * ways;
+        s.bytes = set_count_ * sizeof(Set);
+        std::uint64_t lookups = s.hits + s.misses;
+        s.hit_rate = lookups ? static_cast<double>(s.hits) / static_cast<double>(lookups) : 0.0;
+        s.hit_ns = timed_hits ? static_cast<double>(hit_ns) / static_cast<double>(timed_hits) : 0.0;
+        s.miss_ns =
+            timed_misses ? static_cast<double>(miss_ns) / static_cast<double>(timed_misses) : 0.0;
+        return s;
+    }
+
+private:
+    // Tags are the top 16 hash bits, so most misses compare no key.
+    struct alignas(64) Set {
+        VersionLock lock;
+        mutable std::atomic<std::uint8_t> referenced{0};
+        std::uint8_t used = 0;
+        std::uint8_t main = 0;    // promoted ways; the rest are probationary
+        std::uint8_t hand = 0;
+        std::uint8_t probation_hand = 0;
+        std::uint8_t ghost_hand = 0;
+        std::array<std::uint16_t, ways> ghosts{};   // tags | 1 of keys evicted from probation
+        std::array<std::uint16_t, ways> tags;
+        std::array<Key, ways> keys;
+        std::array<Value, ways> values;
+    };
+
+    struct alignas(64) Counters {
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> misses{0};
+        std::atomic<std::uint64_t> evictions{0};
+        std::atomic<std::uint64_t> hit_ns{0};
+        std::atomic<std::uint64_t> miss_ns{0};
+        std::atomic<std::uint64_t> timed_hits{0};
+        std::atomic<std::uint64_t> timed_misses{0};
+    };
+    static constexpr std::size_t stripe_count = 16;
+
+    std::size_t set_count_;
+    std::unique_ptr<Set[]> sets_;
+    mutable std::array<Counters, stripe_count> stripes_;
+
+    [[nodiscard]] Set &set_for(std::uint64_t hash) const noexcept {
+        return sets_[(hash >> 24) & (set_count_ - 1)];
+    }
+    // Probationary ways that were hit since they came in are promoted, and
+    // the oldest one that was not is evicted; with none left, CLOCK runs
+    // over the main ways.
+    [[nodiscard]] static int victim(Set &set) noexcept {
+        std::uint8_t referenced = set.referenced.load(std::memory_order_relaxed);
+        auto reused = static_cast<std::uint8_t>(referenced & ~set.main);
+        set.main |= reused;
+        set.referenced.fetch_and(static_cast<std::uint8_t>(~reused), std::memory_order_relaxed);
+
+        if (auto cold = static_cast<std::uint8_t>(~set.main)) {
+            int way = set.probation_hand;
+            while (!(cold >> way & 1))
+                way = (way + 1) % ways;
+            set.probation_hand = static_cast<std::uint8_t>((way + 1) % ways);
+            set.ghosts[set.ghost_hand] = set.tags[way] | 1;
+            set.ghost_hand = static_cast<std::uint8_t>((set.ghost_hand + 1) % ways);
+            return way;
+        }
+        for (;; set.hand = (set.hand + 1) % ways) {
+            auto bit = static_cast<std::uint8_t>(1u << set.hand);
+            if (!(set.referenced.load(std::memory_order_relaxed) & bit))
+                break;
+            set.referenced.fetch_and(static_cast<std::uint8_t>(~bit), std::memory_order_relaxed);
+        }
+        int way = set.hand;
+        set.hand = static_cast<std::uint8_t>((set.hand + 1) % ways);
+        return way;
+    }
+    [[nodiscard]] static std::uint16_t tag_of(std::uint64_t hash) noexcept {
+        return static_cast<std::uint16_t>(hash >> 48);
+    }
+    [[nodiscard]] static int find(const Set &set, const Key &key, std::uint16_t tag) noexcept {
+        for (int i = 0; i < ways; ++i)
+            if ((set.used >> i & 1) && set.tags[i] == tag &&
+                std::memcmp(&set.keys[i], &key, sizeof(Key)) == 0)
+                return i;
+        return -1;
+    }
+    [[nodiscard]] Counters &stripe() const noexcept {
+        thread_local const std::size_t index =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) % stripe_count;
+        return stripes_[index];
+    }
+};
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_LOOKUP_CACHE_H
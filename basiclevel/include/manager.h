@@ -1,9 +1,17 @@
 #ifndef ATOMIC_TREE_MANAGER_H
 #define ATOMIC_TREE_MANAGER_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace atomic_tree {
 
@@ -12,15 +20,47 @@ public:
     struct Metadata {
         std::uint64_t magic;
         std::uint32_t version;
-        std::uint32_t padding;
+        std::uint32_t flags;        // Metadata::flag_* bits, fixed at creation
         std::uint64_t root_offset;
         std::uint64_t block_count;
         std::uint64_t block_size;
         std::uint32_t max_keys;
         std::uint32_t min_keys;
         std::uint32_t leaf_capacity;
-        std::uint32_t reserved;   // keep alignment
+        std::uint16_t key_size;     // sizeof(Key) of the tree stored here
+        std::uint16_t entry_size;   // sizeof(BasicLeafEntry<Key, Value>)
         std::uint64_t checksum;
+        // Nonzero while a Manager has the region open: changes are folded
+        // into the checksum in DRAM and only written back by sync_checksum,
+        // so an owner that stopped without closing left the checksum behind.
+        std::uint64_t checksum_stale;
+        std::uint64_t checkpoint_id;   // bumped by export_incremental
+
+        // Trees sharing the region each own a root slot (see
+        // BTreeConfig::root_slot); slot 0 is root_offset. A ShardedBTree
+        // records how many shards it spread over the slots and how keys
+        // are routed to them.
+        static constexpr std::uint32_t max_root_slots = 64;
+        std::uint32_t shard_count;     // 0 while the region holds a single tree
+        std::uint32_t shard_routing;   // a ShardRouting
+        std::uint64_t shard_splits;    // block holding the range split keys, 0 if none
+        std::uint64_t extra_roots[max_root_slots - 1];
+
+        // Only leaves are stored; root_offset is the head of the leaf chain.
+        static constexpr std::uint32_t flag_leaves_only = 1u << 0;
+        // Keys are VarKeys; the GC also keeps the blocks their tails live in.
+        static constexpr std::uint32_t flag_var_keys = 1u << 1;
+        // Leaf values are ValueLog handles; the GC also keeps the log
+        // segments they point into.
+        static constexpr std::uint32_t flag_value_log = 1u << 2;
+    };
+
+    // Background release of freed blocks back to the filesystem.
+    struct SpaceReclaimConfig {
+        std::chrono::milliseconds interval{1000};
+        std::size_t max_bytes_per_pass = 16 * 1024 * 1024;
+        std::size_t reuse_reserve_blocks = 64;   // lowest free blocks kept for alloc_block
+        std::chrono::milliseconds min_free_age{2000};
     };
 
     Manager(const std::string &filename,
@@ -30,8 +70,8 @@ public:
 
     ~Manager();
 
-    void set_root_offset(std::uint64_t offset);
-    [[nodiscard]] std::uint64_t get_root_offset() const noexcept;
+    void set_root_offset(std::uint64_t offset, std::uint32_t slot = 0);
+    [[nodiscard]] std::uint64_t get_root_offset(std::uint32_t slot = 0) const noexcept;
 
     [[nodiscard]] std::uint64_t alloc_block();
     void free_block(std::uint64_t offset);
@@ -42,15 +82,98 @@ public:
     [[nodiscard]] std::size_t region_size() const noexcept;
     [[nodiscard]] std::size_t block_size() const noexcept;
     [[nodiscard]] std::size_t block_count() const noexcept;
+    [[nodiscard]] std::size_t reserved_blocks() const noexcept;
+    // Blocks currently allocated, reserved ones included.
+    [[nodiscard]] std::size_t allocated_blocks() const;
+
+    // Blocks the GC keeps although nothing in the tree points at them yet,
+    // such as a KeyHeap block still being filled. Held in DRAM only.
+    void pin_block(std::uint64_t offset);
+    void unpin_block(std::uint64_t offset);
+    // Trades a writer's batch of pinned blocks for a fresh one under a
+    // single lock: every block in blocks is unpinned, those from index
+    // handed_out on are freed as never used, and blocks is refilled with
+    // up to n newly allocated, pinned ones. Throws if the region is full
+    // and n > 0.
+    void exchange_pinned_blocks(std::vector<std::uint64_t> &blocks, std::size_t handed_out,
+                                std::size_t n);
+    [[nodiscard]] std::vector<std::uint64_t> pinned_blocks() const;
+
+    // Takes every block of one entirely free bitmap word, a run of
+    // blocks_per_group blocks aligned to its own size, and returns the
+    // first one's offset. The blocks come back pinned and zeroed with
+    // non-temporal stores. Throws if no such word is left.
+    static constexpr std::size_t blocks_per_group = 64;
+    [[nodiscard]] std::uint64_t alloc_block_group();
+    void unpin_block_group(std::uint64_t offset);
+    // Unpins the group's blocks and frees them.
+    void free_block_group(std::uint64_t offset);
 
     [[nodiscard]] std::uint64_t *get_bitmap() noexcept;
 
+    struct BitmapRebuild {
+        std::size_t freed;      // allocated, but not in the live set
+        std::size_t restored;   // in the live set, but marked free
+    };
+    // Sets the allocation bitmap to live, one bit per block, with each of
+    // threads taking a slice of its words. Freed blocks are queued for
+    // space reclaim like free_block's. Callers must be quiescent.
+    BitmapRebuild rebuild_bitmap(const std::vector<std::uint64_t> &live, unsigned threads);
+
+    // Asks the kernel to start paging in [offset, offset + len) ahead of
+    // use. Only a hint; errors are ignored.
+    void advise_willneed(std::uint64_t offset, std::size_t len) const noexcept;
+
+    std::size_t reclaim_free_space(const SpaceReclaimConfig &config);
+    void start_space_reclaimer(const SpaceReclaimConfig &config);
+    void stop_space_reclaimer();
+
+    // Changed-block tracking for incremental backups. The dirty bitmap sits
+    // after the allocation bitmap and is cleared whenever a checkpoint is cut.
+    void mark_dirty(std::uint64_t offset, std::size_t len) noexcept;
+    [[nodiscard]] std::uint64_t ptr_to_offset(const void *ptr) const noexcept;
+    [[nodiscard]] std::uint64_t checkpoint_id() const noexcept;
+    [[nodiscard]] std::size_t dirty_block_count() const noexcept;
+
+    // Writes the blocks changed since since_checkpoint_id to out_file and
+    // cuts a new checkpoint once the file is synced to disk. The dirty bits
+    // are read before any block is copied and cleared only after the new
+    // checkpoint id is durable, so a failed export or a crash at any point
+    // leaves every change marked for an export from the id the region
+    // holds. A block marked while the export runs keeps its bit for the
+    // next one. Writers must not be between mark_dirty and their store
+    // when the bits are read or cleared: that store may miss this export's
+    // copy and the next export's bits alike. One export at a time.
+    std::uint64_t export_incremental(std::uint64_t since_checkpoint_id,
+                                     const std::string &out_file);
+    static std::uint64_t apply_incremental(const std::string &in_file,
+                                           const std::string &region_file);
+
+    [[nodiscard]] std::uint64_t logical_file_size() const noexcept;
+    [[nodiscard]] std::uint64_t physical_file_size() const noexcept;
+    [[nodiscard]] std::uint64_t punched_bytes() const noexcept;
+
     void print_telemetry(double ops_per_sec, double latency_us);
 
     [[nodiscard]] std::uint64_t get_real_rss() noexcept;
 
     [[nodiscard]] std::uint64_t calculate_checksum() const noexcept;
+    // Recomputes the region checksum from scratch; callers must be quiescent.
     void update_persistent_checksum();
+    // Writes the checksum changes held in DRAM back to the region and
+    // flushes the checksum line. Done at every checkpoint and on close;
+    // writers may keep running, but the result is only exact once they
+    // have stopped.
+    void sync_checksum() noexcept;
+    // Folds one rewritten block into the region checksum. Safe to call from
+    // several writers at once as long as each owns the block it rewrote.
+    void update_block_checksum(std::uint64_t offset) noexcept;
+    // Folds len bytes just stored at offset into the region checksum,
+    // reading them from src instead of back from the region, which a
+    // non-temporal store has just bypassed the cache for. The bytes must
+    // have been zero before, as alloc_block_group leaves them, offset and
+    // len multiples of 8, and each block filled by one writer at a time.
+    void fold_new_bytes(std::uint64_t offset, const void *src, std::size_t len) noexcept;
     [[nodiscard]] bool verify_integrity() const noexcept;
 
 private:
@@ -68,13 +191,62 @@ private:
     void          *base_;
     Metadata      *metadata_;
     std::uint64_t *bitmap_;
+    std::uint64_t *dirty_bitmap_;
     std::size_t    block_count_;
     std::size_t    bitmap_size_words_;
+    std::size_t    reserved_blocks_;
     std::size_t    allocated_blocks_;
-};
 
-[[nodiscard]] std::uint32_t calculate_node_checksum(const void *data,
-                                                    std::size_t len) noexcept;
+    // Per-block share of the region checksum, so a rewrite only refolds its
+    // own block. Reserved blocks are folded directly into the checksum.
+    std::vector<std::uint64_t> block_folds_;
+
+    // Checksum changes not yet written to the region, spread over a stripe
+    // per thread so writers neither share a line nor flush one per change.
+    static constexpr std::size_t checksum_stripes = 16;
+    struct alignas(64) ChecksumStripe {
+        std::atomic<std::uint64_t> delta{0};
+    };
+    std::array<ChecksumStripe, checksum_stripes> checksum_deltas_;
+
+    mutable std::mutex       alloc_mutex_;
+    // Blocks freed since their space was last released, one bit per block,
+    // and when each word last had a block freed. Sized by the region, so a
+    // process that never reclaims space does not grow them.
+    std::vector<std::uint64_t> pending_release_;
+    std::vector<std::chrono::steady_clock::time_point> freed_at_;
+    // Blocks marked dirty again while an export runs, one bit per block.
+    // Their bits survive the clear that ends the export.
+    std::atomic<bool>          exporting_;
+    std::vector<std::uint64_t> redirtied_;
+    std::vector<std::uint64_t> pinned_;
+    std::uint64_t            punched_bytes_;
+
+    SpaceReclaimConfig       reclaim_config_;
+    std::thread              reclaim_thread_;
+    std::mutex               reclaim_mutex_;
+    std::condition_variable  reclaim_cv_;
+    bool                     reclaim_stop_;
+
+    // Unmaps the region and closes its file; the destructor's work, and a
+    // constructor's that refuses the region it opened.
+    void close_region() noexcept;
+    [[nodiscard]] bool punch_hole(std::size_t first_block, std::size_t n_blocks);
+    // Picks the runs a reclaim pass releases and reserves them in the bitmap;
+    // alloc_mutex_ held.
+    [[nodiscard]] std::vector<std::pair<std::size_t, std::size_t>>
+    reserve_release_runs(const SpaceReclaimConfig &config);
+    void set_bitmap_range(std::size_t first_block, std::size_t n_blocks, bool set) noexcept;
+    [[nodiscard]] std::uint64_t fold_block(std::size_t block_idx) const noexcept;
+    void refresh_block_folds() noexcept;
+    void xor_into_checksum(std::uint64_t delta) noexcept;
+    [[nodiscard]] std::uint64_t pending_checksum() const noexcept;
+    // alloc_block and free_block with alloc_mutex_ already held; the
+    // search for a free block starts at bitmap word first_word.
+    [[nodiscard]] std::uint64_t alloc_block_locked(std::size_t first_word);
+    void free_block_locked(std::uint64_t offset);
+    void reclaimer_loop();
+};
 
 } // namespace atomic_tree
 
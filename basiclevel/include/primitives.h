@@ -1,13 +1,19 @@
 #ifndef ATOMIC_TREE_PRIMITIVES_H
 #define ATOMIC_TREE_PRIMITIVES_H
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <immintrin.h> // for _mm_clflush, _mm_sfence
 
 namespace atomic_tree {
 
-extern std::uint64_t total_persisted_bytes;
+// Process-wide counters; writers on several threads update them relaxed.
+extern std::atomic<std::uint64_t> total_persisted_bytes;
+extern std::atomic<std::uint64_t> total_flushed_lines;
+// Key and value bytes handed to tree writes; against total_persisted_bytes
+// it gives the write amplification.
+extern std::atomic<std::uint64_t> total_logical_bytes;
 
 void pmem_flush(void *addr, std::size_t len);
 
@@ -19,6 +25,28 @@ void atomic_pointer_swap(std::uint64_t *addr,
                          std::uint64_t new_value,
                          std::uint64_t *out_old_value) noexcept;
 
+// Binds the calling thread to one CPU. Returns false, leaving the thread
+// free to move, if the platform refuses or the CPU does not exist.
+bool pin_thread_to_cpu(unsigned cpu) noexcept;
+
+// Copies len bytes with non-temporal stores, which go around the cache
+// straight to memory, then fences: the copy is durable without flushing a
+// line, and a large one does not evict the working set on its way. dst
+// must be 8-byte aligned and len a multiple of 8; a null src stores zeros.
+void persist_nt(void *dst, const void *src, std::size_t len) noexcept;
+// persist_nt without the fence, for a write made of several pieces that a
+// single pmem_fence then makes durable together.
+void stream_nt(void *dst, const void *src, std::size_t len) noexcept;
+
+// Hints every cache line overlapping [addr, addr + len) into L1. Never
+// faults, so stale or unmapped addresses are harmless.
+inline void prefetch_range(const void *addr, std::size_t len) noexcept {
+    auto first = reinterpret_cast<std::uintptr_t>(addr) & ~std::uintptr_t{63};
+    auto end = reinterpret_cast<std::uintptr_t>(addr) + len;
+    for (std::uintptr_t line = first; line < end; line += 64)
+        _mm_prefetch(reinterpret_cast<const char *>(line), _MM_HINT_T0);
+}
+
 } // namespace atomic_tree
 
 #endif // ATOMIC_TREE_PRIMITIVES_H
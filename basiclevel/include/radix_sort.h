@@ -0,0 +1,86 @@
+#ifndef ATOMIC_TREE_RADIX_SORT_H
+#define ATOMIC_TREE_RADIX_SORT_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace atomic_tree {
+
+// Runs fn(t) for t in [0, threads), t == 0 on the calling thread.
+template <typename Fn>
+void run_parallel(unsigned threads, Fn &&fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back(fn, t);
+    fn(0u);
+    for (auto &w : workers)
+        w.join();
+}
+
+// Stable LSD radix sort on the unsigned integer returned by key_of, one byte
+// per pass. Thread t histograms and scatters its own contiguous slice of the
+// input into a private run of every bucket, so passes need no atomics and
+// stay stable. Passes whose byte is equal across all items are skipped.
+template <typename T, typename KeyOf>
+void parallel_radix_sort(std::vector<T> &items, KeyOf key_of, unsigned threads) {
+    using Bits = std::invoke_result_t<KeyOf &, const T &>;
+    static_assert(std::is_unsigned_v<Bits>, "radix keys must be unsigned integers");
+
+    const std::size_t n = items.size();
+    if (n < 2) [[unlikely]]
+        return;
+
+    // Below a few thousand items per thread the spawns cost more than they save.
+    threads = static_cast<unsigned>(
+        std::clamp<std::size_t>(n / 4096, 1, std::max(threads, 1u)));
+
+    std::vector<T> buffer(n);
+    std::vector<std::array<std::size_t, 256>> counts(threads);
+    T *src = items.data();
+    T *dst = buffer.data();
+    auto slice_begin = [&](unsigned t) { return n * t / threads; };
+
+    for (unsigned shift = 0; shift < sizeof(Bits) * 8; shift += 8) {
+        run_parallel(threads, [&](unsigned t) {
+            counts[t].fill(0);
+            for (std::size_t i = slice_begin(t); i < slice_begin(t + 1); ++i)
+                ++counts[t][(key_of(src[i]) >> shift) & 0xFF];
+        });
+
+        // Bucket-major, thread-minor prefix sums give each thread its run.
+        bool single_bucket = false;
+        std::size_t offset = 0;
+        for (std::size_t b = 0; b < 256; ++b) {
+            std::size_t bucket_start = offset;
+            for (unsigned t = 0; t < threads; ++t) {
+                std::size_t c = counts[t][b];
+                counts[t][b] = offset;
+                offset += c;
+            }
+            single_bucket |= (offset - bucket_start == n);
+        }
+        if (single_bucket)
+            continue;
+
+        run_parallel(threads, [&](unsigned t) {
+            auto &pos = counts[t];
+            for (std::size_t i = slice_begin(t); i < slice_begin(t + 1); ++i)
+                dst[pos[(key_of(src[i]) >> shift) & 0xFF]++] = src[i];
+        });
+        std::swap(src, dst);
+    }
+
+    if (src != items.data())
+        items.swap(buffer);
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_RADIX_SORT_H
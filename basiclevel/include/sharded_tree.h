@@ -0,0 +1,516 @@
+#ifndef ATOMIC_TREE_SHARDED_TREE_H
+#define ATOMIC_TREE_SHARDED_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "B_tree.h"
+#include "manager.h"
+#include "primitives.h"
+
+namespace atomic_tree {
+
+// How a ShardedBTree spreads keys over its shards. Stored in the region.
+enum class ShardRouting : std::uint32_t {
+    Hash,    // by BasicBTree::key_hash, for an even spread
+    Range,   // by split keys, so each shard holds one contiguous key range
+};
+
+struct ShardConfig {
+    std::uint32_t shards = 4;    // at most Manager::Metadata::max_root_slots
+    ShardRouting routing = ShardRouting::Hash;
+    // Slots in each shard's request queue, rounded up to a power of two.
+    // Callers yield while the queue of a shard they route to is full.
+    std::size_t queue_capacity = 1024;
+    // Worker i is pinned to CPU (first_cpu + i) modulo the core count;
+    // negative leaves the workers to the scheduler.
+    int first_cpu = 0;
+    // Replaces BTreeConfig::alloc_batch_blocks for every shard, so each
+    // worker allocates from a batch of its own.
+    std::size_t alloc_batch_blocks = 32;
+};
+
+enum class ShardOpType : std::uint8_t { Insert, Upsert, Search, Erase };
+
+// One request to a ShardedBTree. value is read by Insert and Upsert and set
+// by a Search that finds key. found is set by Search and Erase when key was
+// there, and by Upsert when it inserted key.
+template <typename Key, typename Value>
+struct ShardOp {
+    ShardOpType type;
+    Key key;
+    Value value{};
+    bool found = false;
+};
+
+// Bounded queue for many producers and one consumer. Every cell carries a
+// sequence number telling producers when it is free and the consumer when
+// it is filled, so neither side takes a lock; a producer claims its cell
+// with one compare-exchange on tail_.
+template <typename T>
+class ShardQueue {
+public:
+    explicit ShardQueue(std::size_t capacity)
+        : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+          cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+        for (std::size_t i = 0; i <= mask_; ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // False if the queue is full.
+    [[nodiscard]] bool try_push(const T &item) noexcept {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells_[pos & mask_];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lag = static_cast<std::ptrdiff_t>(sequence - pos);
+            if (lag == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item = item;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only. False if the queue is empty.
+    [[nodiscard]] bool try_pop(T &item) noexcept {
+        Cell &cell = cells_[head_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != head_ + 1)
+            return false;
+        item = cell.item;
+        cell.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T item;
+    };
+
+    std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::size_t head_ = 0;
+};
+
+// Shared-nothing front-end over several trees in one region. Keys are
+// routed by hash or by range to one of the shards, each a BasicBTree under
+// its own root slot that only its worker thread changes. Callers hand
+// requests to the workers through lock-free per-shard queues, so no two
+// threads contend for a node and a shard's nodes stay in one core's cache.
+//
+// Any number of threads may call the operations below. A created region
+// records the shard count, routing and split keys; when an existing one is
+// opened they are read back and those given are ignored. The region can
+// hold nothing else. recover() is not supported, since it rebuilds the
+// bitmap from a single tree; the GC keeps every shard. Keys must be
+// hashable and Compare default-constructible.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class ShardedBTree {
+public:
+    using tree_type = BasicBTree<Key, Value, Compare>;
+    using op_type = ShardOp<Key, Value>;
+
+    static_assert(tree_type::hashable_keys, "ShardedBTree routes keys by their hash");
+
+    // range_splits are the shards - 1 keys that start shards 1 and up, in
+    // increasing order; Range routing only. config's lookup cache budget
+    // is split evenly between the shards.
+    ShardedBTree(Manager *manager, const BTreeConfig &config, const ShardConfig &shard_config = {},
+                 std::span<const Key> range_splits = {});
+    ~ShardedBTree();
+
+    ShardedBTree(const ShardedBTree &) = delete;
+    ShardedBTree &operator=(const ShardedBTree &) = delete;
+
+    // As the BasicBTree operations, each waiting for its shard's worker.
+    void insert(const Key &key, const Value &value);
+    bool upsert(const Key &key, const Value &value);
+    [[nodiscard]] bool search(const Key &key, Value &out_value) const;
+    [[nodiscard]] bool erase(const Key &key);
+
+    // Runs every op and returns once all are done. Ops are queued to their
+    // shards in one request per shard and run in parallel across shards,
+    // in their given order within one. If an op throws, the rest still run
+    // and the first exception is rethrown.
+    void execute(std::span<op_type> ops) const;
+
+    [[nodiscard]] std::uint32_t shard_of(const Key &key) const noexcept;
+    [[nodiscard]] std::uint32_t shard_count() const noexcept {
+        return static_cast<std::uint32_t>(shards_.size());
+    }
+    [[nodiscard]] ShardRouting routing() const noexcept { return routing_; }
+    [[nodiscard]] std::span<const Key> range_splits() const noexcept { return splits_; }
+
+    // A shard's tree, for reads that need no worker: search, scans and
+    // stats are safe from any thread while the worker writes.
+    [[nodiscard]] const tree_type &shard(std::uint32_t index) const noexcept {
+        return *shards_[index]->tree;
+    }
+
+    // The shards' stats combined; allocated_blocks is the region's and
+    // fragmentation is not reported.
+    [[nodiscard]] TreeStats stats() const;
+
+private:
+    // Ops indices[0, count) of a batch, all routed to one shard.
+    struct Completion;
+    struct Request {
+        op_type *ops;
+        const std::uint32_t *indices;
+        std::size_t count;
+        Completion *done;
+    };
+    struct Completion {
+        std::atomic<std::size_t> remaining;
+        std::atomic<bool> released{false};   // the last worker is done with it
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+    };
+    struct alignas(64) Shard {
+        explicit Shard(std::size_t queue_capacity) : queue(queue_capacity) {}
+
+        std::unique_ptr<tree_type> tree;
+        ShardQueue<Request> queue;
+        std::atomic<std::uint32_t> wake{0};   // bumped after every push
+        std::thread worker;
+    };
+
+    // Pops a worker makes before it goes to sleep on wake.
+    static constexpr int idle_polls = 64;
+
+    Manager *manager_;
+    ShardRouting routing_;
+    std::vector<Key> splits_;
+    [[no_unique_address]] Compare comp_{};
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> stop_{false};
+
+    void stop_workers() noexcept;
+    void run_one(op_type &op) const;
+    void submit(Shard &shard, const Request &request) const;
+    static void wait(Completion &done);
+    static void apply(tree_type &tree, op_type &op);
+    void work(Shard &shard, int cpu);
+};
+
+template <typename Key, typename Value, typename Compare>
+ShardedBTree<Key, Value, Compare>::ShardedBTree(Manager *manager, const BTreeConfig &config,
+                                                const ShardConfig &shard_config,
+                                                std::span<const Key> range_splits)
+    : manager_(manager), routing_(shard_config.routing) {
+    if (config.recovery_threads > 0) [[unlikely]]
+        throw std::runtime_error("ShardedBTree regions cannot run recover() at open");
+
+    auto *meta = static_cast<Manager::Metadata *>(manager_->base());
+    std::uint32_t shards = meta->shard_count;
+    if (shards == 0) {
+        shards = shard_config.shards;
+        if (manager_->get_root_offset() != 0) [[unlikely]]
+            throw std::runtime_error("Region holds a single tree, not shards");
+        if (shards == 0 || shards > Manager::Metadata::max_root_slots) [[unlikely]] {
+            throw std::runtime_error(std::format("ShardedBTree needs 1 to {} shards, not {}",
+                                                 Manager::Metadata::max_root_slots, shards));
+        }
+
+        std::uint64_t splits_block = 0;
+        if (routing_ == ShardRouting::Range) {
+            if (range_splits.size() != shards - 1 ||
+                std::adjacent_find(range_splits.begin(), range_splits.end(),
+                                   [&](const Key &a, const Key &b) { return !comp_(a, b); }) !=
+                    range_splits.end()) [[unlikely]] {
+                throw std::runtime_error(std::format(
+                    "Range routing over {} shards needs {} increasing split keys, got {}",
+                    shards, shards - 1, range_splits.size()));
+            }
+            if (range_splits.size_bytes() > manager_->block_size()) [[unlikely]] {
+                throw std::runtime_error(std::format(
+                    "{} bytes of split keys do not fit a {} byte block",
+                    range_splits.size_bytes(), manager_->block_size()));
+            }
+            if (!range_splits.empty()) {
+                splits_block = manager_->alloc_block();
+                void *dst = manager_->offset_to_ptr(splits_block);
+                std::memcpy(dst, range_splits.data(), range_splits.size_bytes());
+                persist(dst, range_splits.size_bytes());
+                manager_->mark_dirty(splits_block, range_splits.size_bytes());
+                manager_->update_block_checksum(splits_block);
+            }
+        }
+
+        // Recorded before any shard exists, so a crash part way through
+        // leaves slots that open as empty trees.
+        meta->shard_count = shards;
+        meta->shard_routing = static_cast<std::uint32_t>(routing_);
+        meta->shard_splits = splits_block;
+        persist(meta, sizeof(Manager::Metadata));
+        manager_->update_persistent_checksum();
+    } else {
+        routing_ = static_cast<ShardRouting>(meta->shard_routing);
+    }
+
+    BTreeConfig shard_tree_config = config;
+    shard_tree_config.alloc_batch_blocks = shard_config.alloc_batch_blocks;
+    shard_tree_config.lookup_cache_bytes = config.lookup_cache_bytes / shards;
+    shards_.reserve(shards);
+    for (std::uint32_t i = 0; i < shards; ++i) {
+        shard_tree_config.root_slot = i;
+        auto shard = std::make_unique<Shard>(shard_config.queue_capacity);
+        shard->tree = std::make_unique<tree_type>(manager_, shard_tree_config);
+        shards_.push_back(std::move(shard));
+    }
+
+    // Read back only now that the trees have checked the key size.
+    if (routing_ == ShardRouting::Range && meta->shard_splits != 0) {
+        const auto *stored = static_cast<const Key *>(manager_->offset_to_ptr(meta->shard_splits));
+        splits_.assign(stored, stored + (shards - 1));
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        for (std::uint32_t i = 0; i < shards; ++i) {
+            int cpu = shard_config.first_cpu < 0
+                          ? -1
+                          : static_cast<int>((static_cast<unsigned>(shard_config.first_cpu) + i) %
+                                             cores);
+            shards_[i]->worker =
+                std::thread(&ShardedBTree::work, this, std::ref(*shards_[i]), cpu);
+        }
+    } catch (...) {
+        stop_workers();
+        throw;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+ShardedBTree<Key, Value, Compare>::~ShardedBTree() {
+    stop_workers();
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::stop_workers() noexcept {
+    stop_.store(true, std::memory_order_release);
+    for (auto &shard : shards_) {
+        shard->wake.fetch_add(1, std::memory_order_release);
+        shard->wake.notify_one();
+    }
+    for (auto &shard : shards_)
+        if (shard->worker.joinable())
+            shard->worker.join();
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::insert(const Key &key, const Value &value) {
+    op_type op{ShardOpType::Insert, key, value};
+    run_one(op);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ShardedBTree<Key, Value, Compare>::upsert(const Key &key, const Value &value) {
+    op_type op{ShardOpType::Upsert, key, value};
+    run_one(op);
+    return op.found;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool ShardedBTree<Key, Value, Compare>::search(const Key &key,
+                                                             Value &out_value) const {
+    op_type op{ShardOpType::Search, key};
+    run_one(op);
+    if (op.found)
+        out_value = op.value;
+    return op.found;
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] bool ShardedBTree<Key, Value, Compare>::erase(const Key &key) {
+    op_type op{ShardOpType::Erase, key};
+    run_one(op);
+    return op.found;
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::execute(std::span<op_type> ops) const {
+    if (ops.empty())
+        return;
+    if (ops.size() > std::numeric_limits<std::uint32_t>::max()) [[unlikely]]
+        throw std::runtime_error(std::format("execute() takes at most 2^32 - 1 ops, got {}",
+                                             ops.size()));
+
+    // Counting sort of op indices by shard, keeping each shard's in order.
+    std::vector<std::uint32_t> shard_ids(ops.size());
+    std::vector<std::size_t> starts(shards_.size() + 1, 0);
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+        shard_ids[i] = shard_of(ops[i].key);
+        ++starts[shard_ids[i] + 1];
+    }
+    std::size_t touched = 0;
+    for (std::size_t s = 0; s < shards_.size(); ++s) {
+        touched += starts[s + 1] > 0;
+        starts[s + 1] += starts[s];
+    }
+    std::vector<std::uint32_t> indices(ops.size());
+    std::vector<std::size_t> next(starts.begin(), starts.end() - 1);
+    for (std::size_t i = 0; i < ops.size(); ++i)
+        indices[next[shard_ids[i]]++] = static_cast<std::uint32_t>(i);
+
+    Completion done;
+    done.remaining.store(touched, std::memory_order_relaxed);
+    for (std::size_t s = 0; s < shards_.size(); ++s) {
+        if (std::size_t count = starts[s + 1] - starts[s]; count > 0)
+            submit(*shards_[s], Request{ops.data(), indices.data() + starts[s], count, &done});
+    }
+    wait(done);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] std::uint32_t
+ShardedBTree<Key, Value, Compare>::shard_of(const Key &key) const noexcept {
+    if (routing_ == ShardRouting::Range) {
+        return static_cast<std::uint32_t>(std::upper_bound(splits_.begin(), splits_.end(), key,
+                                                           comp_) -
+                                          splits_.begin());
+    }
+    // Top hash bits scaled onto the shards; no division.
+    std::uint64_t high = tree_type::key_hash(key) >> 32;
+    return static_cast<std::uint32_t>((high * shards_.size()) >> 32);
+}
+
+template <typename Key, typename Value, typename Compare>
+[[nodiscard]] TreeStats ShardedBTree<Key, Value, Compare>::stats() const {
+    TreeStats total{};
+    double fill = 0;
+    double fanout = 0;
+    for (const auto &shard : shards_) {
+        TreeStats s = shard->tree->stats();
+        total.height = std::max(total.height, s.height);
+        for (std::size_t level = 0; level < total.nodes_per_level.size(); ++level)
+            total.nodes_per_level[level] += s.nodes_per_level[level];
+        for (std::size_t bucket = 0; bucket < total.leaf_fill_histogram.size(); ++bucket)
+            total.leaf_fill_histogram[bucket] += s.leaf_fill_histogram[bucket];
+        total.leaves += s.leaves;
+        total.internal_nodes += s.internal_nodes;
+        total.entries += s.entries;
+        total.live_blocks += s.live_blocks;
+        total.allocated_blocks = s.allocated_blocks;
+        fill += s.average_leaf_fill * static_cast<double>(s.leaves);
+        fanout += s.average_fanout * static_cast<double>(s.internal_nodes);
+    }
+    if (total.leaves > 0)
+        total.average_leaf_fill = fill / static_cast<double>(total.leaves);
+    if (total.internal_nodes > 0)
+        total.average_fanout = fanout / static_cast<double>(total.internal_nodes);
+    // Each shard's blocks look like garbage to the others, so the region
+    // has no per-tree fragmentation to report; it stays 0.
+    return total;
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::run_one(op_type &op) const {
+    static constexpr std::uint32_t first = 0;
+    Completion done;
+    done.remaining.store(1, std::memory_order_relaxed);
+    submit(*shards_[shard_of(op.key)], Request{&op, &first, 1, &done});
+    wait(done);
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::submit(Shard &shard, const Request &request) const {
+    while (!shard.queue.try_push(request))
+        std::this_thread::yield();
+    shard.wake.fetch_add(1, std::memory_order_release);
+    shard.wake.notify_one();
+}
+
+// The last worker notifies, then releases; done lives on the caller's
+// stack, so the caller must not return while that notify is still running.
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::wait(Completion &done) {
+    for (std::size_t left; (left = done.remaining.load(std::memory_order_acquire)) != 0;)
+        done.remaining.wait(left, std::memory_order_acquire);
+    while (!done.released.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    if (done.error)
+        std::rethrow_exception(done.error);
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::apply(tree_type &tree, op_type &op) {
+    switch (op.type) {
+    case ShardOpType::Insert:
+        tree.insert(op.key, op.value);
+        break;
+    case ShardOpType::Upsert:
+        op.found = tree.upsert(op.key, op.value);
+        break;
+    case ShardOpType::Search:
+        op.found = tree.search(op.key, op.value);
+        break;
+    case ShardOpType::Erase:
+        op.found = tree.erase(op.key);
+        break;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void ShardedBTree<Key, Value, Compare>::work(Shard &shard, int cpu) {
+    if (cpu >= 0)
+        (void)pin_thread_to_cpu(static_cast<unsigned>(cpu));
+
+    Request request;
+    for (;;) {
+        // Read wake before the last look at the queue: a push after that
+        // look bumps it, and the wait below returns at once.
+        std::uint32_t seen = shard.wake.load(std::memory_order_acquire);
+        bool popped = shard.queue.try_pop(request);
+        for (int poll = 0; !popped && poll < idle_polls; ++poll) {
+            std::this_thread::yield();
+            popped = shard.queue.try_pop(request);
+        }
+        if (!popped) {
+            if (stop_.load(std::memory_order_acquire))
+                return;
+            shard.wake.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        Completion &done = *request.done;
+        for (std::size_t i = 0; i < request.count; ++i) {
+            try {
+                apply(*shard.tree, request.ops[request.indices[i]]);
+            } catch (...) {
+                if (!done.failed.exchange(true, std::memory_order_relaxed))
+                    done.error = std::current_exception();
+            }
+        }
+        if (done.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done.remaining.notify_all();
+            done.released.store(true, std::memory_order_release);
+        }
+    }
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_SHARDED_TREE_H
@@ -0,0 +1,32 @@
+#ifndef ATOMIC_TREE_SIMD_SEARCH_H
+#define ATOMIC_TREE_SIMD_SEARCH_H
+
+#include <cstdint>
+
+namespace atomic_tree {
+
+// Number of sorted separator keys that are <= key, i.e. the child slot a
+// descent takes. Uses AVX2 compare/movemask/popcount when the CPU has it
+// (checked once at startup) and a scalar loop otherwise.
+[[nodiscard]] std::uint32_t separator_rank(const std::int32_t *keys,
+                                           std::uint32_t count,
+                                           std::int32_t key) noexcept;
+[[nodiscard]] std::uint32_t separator_rank(const std::uint32_t *keys,
+                                           std::uint32_t count,
+                                           std::uint32_t key) noexcept;
+[[nodiscard]] std::uint32_t separator_rank(const std::int64_t *keys,
+                                           std::uint32_t count,
+                                           std::int64_t key) noexcept;
+[[nodiscard]] std::uint32_t separator_rank(const std::uint64_t *keys,
+                                           std::uint32_t count,
+                                           std::uint64_t key) noexcept;
+
+// Switches between the vector and scalar paths, e.g. for benchmarks. The
+// path is picked at startup; switching is safe while other threads search.
+// Returns whether the vector path is now in use.
+bool enable_simd_separator_search(bool enabled) noexcept;
+[[nodiscard]] bool simd_separator_search_enabled() noexcept;
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_SIMD_SEARCH_H
@@ -0,0 +1,484 @@
+#ifndef ATOMIC_TREE_VALUE_LOG_H
+#define ATOMIC_TREE_VALUE_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "B_tree.h"
+#include "crc32c.h"
+#include "manager.h"
+#include "primitives.h"
+
+namespace atomic_tree {
+
+struct ValueLogStats {
+    std::size_t segments;             // segments holding records, the head included
+    std::uint64_t appended_bytes;     // record bytes written since the log was opened
+    std::uint64_t live_bytes;         // estimated, see ValueLog
+    std::uint64_t dead_bytes;
+    std::uint64_t segments_compacted;
+    std::uint64_t records_moved;
+    std::uint64_t compaction_errors;  // background passes that threw
+};
+
+// What one compaction pass did.
+struct ValueLogCompaction {
+    std::size_t segments_freed;
+    std::uint64_t records_moved;
+    std::uint64_t bytes_moved;
+};
+
+struct ValueLogCompactorConfig {
+    std::chrono::milliseconds interval{1000};
+    double min_dead_share = 0.5;         // of a segment's filled bytes
+    std::size_t max_segments_per_pass = 4;
+};
+
+// Append-only store for values too large to keep in a leaf. A value is
+// named by an 8-byte handle that the tree stores in its place: values of
+// up to max_inline bytes are packed into the handle itself, longer ones
+// are appended to the log as a record and the handle holds its offset and
+// length.
+//
+//   inline:       bit 0 set, bits 1-3 the length, bytes 1-7 the value
+//   out of line:  bits 0-39 the record's region offset, bits 40-63 the
+//                 value's length
+//
+// The log fills one segment at a time, a group of Manager::blocks_per_group
+// blocks, with non-temporal stores, so a record is durable when append
+// returns without flushing a line and a stream of large values does not
+// evict the tree from the cache. A record carries its key and a CRC-32C of
+// key and value:
+//
+//   [u32 value length][u32 crc][key, padded to 8][value, padded to 8]
+//
+// which lets a reader holding a stale handle, one whose record was moved
+// and whose segment was freed, tell that it has to look the key up again.
+// Readers take no locks; appends are serialised.
+//
+// Live and filled bytes are counted per segment to pick segments worth
+// compacting. The counts are estimates: two writers racing on one key may
+// leave a dead record counted as live, and after a reopen every segment
+// still referenced counts as full. Segments nothing references any more
+// are only found by the GC.
+class ValueLog {
+public:
+    static constexpr std::size_t max_inline = 7;
+    static constexpr std::size_t max_value_length = (std::size_t{1} << 24) - 1;
+
+    ValueLog(Manager *manager, std::size_t key_size);
+    ~ValueLog();
+
+    ValueLog(const ValueLog &) = delete;
+    ValueLog &operator=(const ValueLog &) = delete;
+
+    // The handle for value. Out-of-line values are appended under key and
+    // stay in flight until settle: compaction leaves their segment alone,
+    // so the handle can be published in the tree first. Throws
+    // std::runtime_error if the value does not fit a segment.
+    [[nodiscard]] std::uint64_t append(const void *key, std::string_view value);
+    void settle(std::uint64_t handle) noexcept;
+
+    // An appended record in flight while the write that publishes its
+    // handle runs. Going out of scope settles it and, unless it was
+    // published, releases it as dead, so a write that throws leaves no
+    // segment pinned and no dead record counted live.
+    class Pending {
+    public:
+        Pending(ValueLog &log, std::uint64_t handle) noexcept : log_(log), handle_(handle) {}
+        ~Pending() {
+            if (!published_)
+                log_.release(handle_);
+            log_.settle(handle_);
+        }
+
+        Pending(const Pending &) = delete;
+        Pending &operator=(const Pending &) = delete;
+
+        [[nodiscard]] std::uint64_t handle() const noexcept { return handle_; }
+        void publish() noexcept { published_ = true; }
+
+    private:
+        ValueLog &log_;
+        std::uint64_t handle_;
+        bool published_ = false;
+    };
+
+    // Copies the value handle names into out. Returns false if its record
+    // no longer holds key's value, its segment having been compacted away.
+    [[nodiscard]] bool read(std::uint64_t handle, const void *key, std::string &out) const;
+
+    // The tree no longer references handle.
+    void release(std::uint64_t handle) noexcept;
+    // The tree references handle; counted for every entry when a region
+    // is reopened.
+    void count_live(std::uint64_t handle) noexcept;
+
+    [[nodiscard]] static bool is_inline(std::uint64_t handle) noexcept { return handle & 1; }
+    [[nodiscard]] static std::uint64_t record_offset(std::uint64_t handle) noexcept {
+        return handle & offset_mask;
+    }
+    [[nodiscard]] static std::size_t value_length(std::uint64_t handle) noexcept {
+        return is_inline(handle) ? (handle >> 1) & 7 : static_cast<std::size_t>(handle >> 40);
+    }
+
+    // Sealed segments, in offset order, whose dead share is at least
+    // min_dead_share and that no append is still in flight for.
+    [[nodiscard]] std::vector<std::uint64_t> compaction_candidates(double min_dead_share) const;
+    // Calls fn(handle, key, value) for each intact record in a sealed
+    // segment, in append order.
+    template <typename Fn>
+    void for_each_record(std::uint64_t segment, Fn &&fn) const;
+    void free_segment(std::uint64_t segment);
+    // Counts one record moved by compaction.
+    void record_moved() noexcept { records_moved_.fetch_add(1, std::memory_order_relaxed); }
+    // Counts one background compaction pass that failed.
+    void record_compaction_error() noexcept {
+        compaction_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::size_t segment_bytes() const noexcept { return segment_bytes_; }
+    [[nodiscard]] ValueLogStats stats() const;
+
+private:
+    static constexpr std::uint64_t offset_mask = (std::uint64_t{1} << 40) - 1;
+    static constexpr std::size_t header_bytes = 8;
+
+    Manager *manager_;
+    std::size_t key_size_;
+    std::size_t key_bytes_;        // key_size_ padded to 8
+    std::size_t segment_bytes_;
+
+    mutable std::mutex mutex_;
+    std::uint64_t head_;           // segment being filled, 0 before the first append
+    std::size_t head_used_;
+
+    // Indexed by segment, that is by bitmap word.
+    std::vector<std::atomic<std::uint64_t>> filled_;
+    std::vector<std::atomic<std::int64_t>> live_;
+    std::vector<std::atomic<std::uint32_t>> in_flight_;
+
+    std::atomic<std::uint64_t> appended_bytes_;
+    std::atomic<std::uint64_t> segments_compacted_;
+    std::atomic<std::uint64_t> records_moved_;
+    std::atomic<std::uint64_t> compaction_errors_;
+
+    [[nodiscard]] std::size_t record_size(std::size_t value_length) const noexcept {
+        return header_bytes + key_bytes_ + ((value_length + 7) & ~std::size_t{7});
+    }
+    [[nodiscard]] std::size_t segment_index(std::uint64_t offset) const noexcept {
+        return static_cast<std::size_t>(offset / segment_bytes_);
+    }
+    [[nodiscard]] std::uint32_t record_crc(const void *key, const void *value,
+                                           std::size_t length) const noexcept {
+        return crc32c(value, length, crc32c(key, key_size_));
+    }
+};
+
+template <typename Fn>
+void ValueLog::for_each_record(std::uint64_t segment, Fn &&fn) const {
+    const auto *base = static_cast<const std::uint8_t *>(manager_->base());
+    std::size_t pos = 0;
+    while (pos + header_bytes <= segment_bytes_) {
+        const std::uint8_t *record = base + segment + pos;
+        std::uint32_t header[2];
+        std::memcpy(header, record, sizeof(header));
+        // Out-of-line values are longer than max_inline, so a zero length
+        // is the untouched rest of the segment.
+        std::size_t size = record_size(header[0]);
+        if (header[0] == 0 || pos + size > segment_bytes_)
+            break;
+        const std::uint8_t *key = record + header_bytes;
+        const std::uint8_t *value = key + key_bytes_;
+        if (record_crc(key, value, header[0]) != header[1]) [[unlikely]]
+            break;
+        std::uint64_t handle = (segment + pos) | std::uint64_t{header[0]} << 40;
+        fn(handle, key, std::string_view(reinterpret_cast<const char *>(value), header[0]));
+        pos += size;
+    }
+}
+
+// A tree whose values are byte strings of any length up to
+// ValueLog::max_value_length. Leaves hold the 8-byte handles, so their
+// size, fanout and scan speed do not depend on the values; small values
+// stay inline in the handle and cost no extra read.
+//
+// Compaction copies the live records of mostly dead segments to the head
+// of the log, swaps each handle with BasicBTree::compare_update, which
+// loses cleanly to a writer that replaced the value meanwhile, and frees
+// the segment. It runs alongside readers and writers, from compact() or a
+// background thread. Neither compaction nor the GC may run while
+// snapshots are open, as their undo records may hold handles the leaves
+// no longer do.
+template <typename Key = std::uint64_t, typename Compare = std::less<Key>>
+class ValueLogBTree {
+public:
+    using tree_type = BasicBTree<Key, std::uint64_t, Compare>;
+    static_assert(std::is_trivially_copyable_v<Key>, "ValueLog records store keys bytewise");
+
+    // Reopening counts the live records with one scan of the tree. The
+    // BTreeConfig::recovery_threads pass is refused: it rebuilds the
+    // bitmap from the nodes alone and would free the log.
+    ValueLogBTree(Manager *manager, const BTreeConfig &config);
+    ~ValueLogBTree();
+
+    ValueLogBTree(const ValueLogBTree &) = delete;
+    ValueLogBTree &operator=(const ValueLogBTree &) = delete;
+
+    // As BasicBTree::insert: key must not be in the tree.
+    void insert(const Key &key, std::string_view value);
+    // As BasicBTree::upsert; the replaced record becomes dead.
+    bool upsert(const Key &key, std::string_view value);
+    [[nodiscard]] bool search(const Key &key, std::string &out_value) const;
+    [[nodiscard]] bool erase(const Key &key);
+
+    // Calls fn(key, value) for every entry in [lo, hi), in key order. The
+    // value is only valid during the call. If fn returns bool, returning
+    // false stops the scan.
+    template <typename Fn>
+    void scan(const Key &lo, const Key &hi, Fn &&fn) const;
+
+    // Compacts up to max_segments segments whose dead share is at least
+    // min_dead_share.
+    ValueLogCompaction compact(double min_dead_share = 0.5, std::size_t max_segments = 4);
+    void start_compactor(const ValueLogCompactorConfig &config);
+    void stop_compactor();
+    // The exception that ended the background compactor's latest failed
+    // pass, or null. ValueLogStats::compaction_errors counts them all.
+    [[nodiscard]] std::exception_ptr compactor_error() const;
+
+    [[nodiscard]] tree_type &tree() noexcept { return tree_; }
+    [[nodiscard]] const tree_type &tree() const noexcept { return tree_; }
+    [[nodiscard]] const ValueLog &log() const noexcept { return log_; }
+
+private:
+    tree_type tree_;
+    ValueLog log_;
+
+    ValueLogCompactorConfig compactor_config_;
+    std::thread compactor_thread_;
+    mutable std::mutex compactor_mutex_;
+    std::condition_variable compactor_cv_;
+    bool compactor_stop_ = false;
+    std::exception_ptr compactor_error_;
+
+    void compactor_loop();
+    // Reads the value of a handle found under key, looking the key up
+    // again while its record is being moved.
+    bool read_value(const Key &key, std::uint64_t handle, std::string &out) const;
+};
+
+template <typename Key, typename Compare>
+ValueLogBTree<Key, Compare>::ValueLogBTree(Manager *manager, const BTreeConfig &config)
+    : tree_(manager, config), log_(manager, sizeof(Key)) {
+    if (config.recovery_threads > 0) [[unlikely]]
+        throw std::runtime_error("ValueLogBTree cannot run the open-time recovery pass");
+    auto *meta = static_cast<Manager::Metadata *>(manager->base());
+    if (!(meta->flags & Manager::Metadata::flag_value_log)) {
+        meta->flags |= Manager::Metadata::flag_value_log;
+        persist(meta, sizeof(Manager::Metadata));
+        manager->update_persistent_checksum();
+    }
+    auto cursor = tree_.cursor();
+    for (cursor.seek_to_first(); cursor.valid(); cursor.next())
+        log_.count_live(cursor.value());
+}
+
+template <typename Key, typename Compare>
+ValueLogBTree<Key, Compare>::~ValueLogBTree() {
+    stop_compactor();
+}
+
+template <typename Key, typename Compare>
+void ValueLogBTree<Key, Compare>::insert(const Key &key, std::string_view value) {
+    ValueLog::Pending record(log_, log_.append(&key, value));
+    tree_.insert(key, record.handle());
+    record.publish();
+}
+
+// The old handle is read first and swapped out with compare_update, so the
+// record it names is known to be dead. A key that is absent, or vanishes
+// before the swap, is inserted with upsert.
+template <typename Key, typename Compare>
+bool ValueLogBTree<Key, Compare>::upsert(const Key &key, std::string_view value) {
+    ValueLog::Pending record(log_, log_.append(&key, value));
+    bool inserted = false;
+    for (;;) {
+        std::uint64_t old;
+        if (!tree_.search(key, old)) {
+            inserted = tree_.upsert(key, record.handle());
+            break;
+        }
+        if (tree_.compare_update(key, old, record.handle())) {
+            log_.release(old);
+            break;
+        }
+    }
+    record.publish();
+    return inserted;
+}
+
+template <typename Key, typename Compare>
+[[nodiscard]] bool ValueLogBTree<Key, Compare>::search(const Key &key,
+                                                       std::string &out_value) const {
+    std::uint64_t handle;
+    return tree_.search(key, handle) && read_value(key, handle, out_value);
+}
+
+template <typename Key, typename Compare>
+bool ValueLogBTree<Key, Compare>::read_value(const Key &key, std::uint64_t handle,
+                                            std::string &out) const {
+    for (;;) {
+        if (log_.read(handle, &key, out))
+            return true;
+        // A moved record has a new handle by the time its segment is
+        // freed; the same handle failing twice is a damaged record.
+        std::uint64_t current;
+        if (!tree_.search(key, current))
+            return false;
+        if (current == handle) [[unlikely]]
+            throw std::runtime_error(
+                std::format("Value record at offset {} fails its checksum",
+                            ValueLog::record_offset(handle)));
+        handle = current;
+    }
+}
+
+template <typename Key, typename Compare>
+[[nodiscard]] bool ValueLogBTree<Key, Compare>::erase(const Key &key) {
+    std::uint64_t handle;
+    if (!tree_.search(key, handle))
+        return false;
+    if (!tree_.erase(key))
+        return false;
+    log_.release(handle);
+    return true;
+}
+
+template <typename Key, typename Compare>
+template <typename Fn>
+void ValueLogBTree<Key, Compare>::scan(const Key &lo, const Key &hi, Fn &&fn) const {
+    std::string value;
+    tree_.scan(lo, hi, [&](const Key &key, const std::uint64_t &handle) {
+        // A key erased since the scan copied its leaf is skipped.
+        if (!read_value(key, handle, value)) {
+            if constexpr (std::is_same_v<std::invoke_result_t<Fn &, const Key &, std::string_view>,
+                                         bool>)
+                return true;
+            else
+                return;
+        }
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn &, const Key &, std::string_view>,
+                                     bool>)
+            return fn(key, std::string_view(value));
+        else
+            fn(key, std::string_view(value));
+    });
+}
+
+// A record is live while the tree still points at it. The copy is
+// appended before the swap, so a crash in between leaves the old record
+// in place and the copy unreferenced.
+template <typename Key, typename Compare>
+ValueLogCompaction ValueLogBTree<Key, Compare>::compact(double min_dead_share,
+                                                        std::size_t max_segments) {
+    ValueLogCompaction result{};
+    std::vector<std::uint64_t> segments = log_.compaction_candidates(min_dead_share);
+    if (segments.size() > max_segments)
+        segments.resize(max_segments);
+
+    for (std::uint64_t segment : segments) {
+        log_.for_each_record(segment, [&](std::uint64_t handle, const std::uint8_t *key_bytes,
+                                          std::string_view value) {
+            Key key;
+            std::memcpy(&key, key_bytes, sizeof(Key));
+            std::uint64_t current;
+            if (!tree_.search(key, current) || current != handle)
+                return;
+            ValueLog::Pending moved(log_, log_.append(&key, value));
+            if (tree_.compare_update(key, handle, moved.handle())) {
+                moved.publish();
+                log_.release(handle);
+                log_.record_moved();
+                result.records_moved++;
+                result.bytes_moved += value.size();
+            }
+        });
+        log_.free_segment(segment);
+        result.segments_freed++;
+    }
+    return result;
+}
+
+template <typename Key, typename Compare>
+void ValueLogBTree<Key, Compare>::start_compactor(const ValueLogCompactorConfig &config) {
+    stop_compactor();
+
+    compactor_config_ = config;
+    compactor_stop_ = false;
+    compactor_thread_ = std::thread(&ValueLogBTree::compactor_loop, this);
+}
+
+template <typename Key, typename Compare>
+void ValueLogBTree<Key, Compare>::stop_compactor() {
+    if (!compactor_thread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(compactor_mutex_);
+        compactor_stop_ = true;
+    }
+    compactor_cv_.notify_all();
+    compactor_thread_.join();
+}
+
+template <typename Key, typename Compare>
+[[nodiscard]] std::exception_ptr ValueLogBTree<Key, Compare>::compactor_error() const {
+    std::lock_guard<std::mutex> lock(compactor_mutex_);
+    return compactor_error_;
+}
+
+// A pass that fails, e.g. by running the region out of space or reading a
+// damaged node, leaves its segment half moved, which is harmless. The error
+// is kept for compactor_error() and the next pass tries again; nothing
+// escapes the thread.
+template <typename Key, typename Compare>
+void ValueLogBTree<Key, Compare>::compactor_loop() {
+    std::unique_lock<std::mutex> lock(compactor_mutex_);
+    while (!compactor_stop_) {
+        if (compactor_cv_.wait_for(lock, compactor_config_.interval,
+                                   [this] { return compactor_stop_; }))
+            break;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            compact(compactor_config_.min_dead_share, compactor_config_.max_segments_per_pass);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error) [[unlikely]] {
+            compactor_error_ = error;
+            log_.record_compaction_error();
+        }
+    }
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_VALUE_LOG_H
@@ -0,0 +1,357 @@
+#ifndef ATOMIC_TREE_VAR_KEY_H
+#define ATOMIC_TREE_VAR_KEY_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "B_tree.h"
+#include "crc32c.h"
+#include "manager.h"
+#include "primitives.h"
+
+namespace atomic_tree {
+
+// Variable-length binary key in a fixed 16-byte slot, ordered bytewise like
+// std::string_view. The first inline_bytes are kept in the slot, zero
+// padded; a longer key also points at the rest of its bytes (its tail),
+// which live in a KeyHeap block for keys stored in the tree and in caller
+// memory for keys built only to look one up. Most comparisons are decided
+// by the heads alone and never follow a tail.
+//
+// word holds the length in its low 16 bits. Above it, a stored key keeps
+// an 8-bit hash of its tail and a 39-bit region offset (regions of up to
+// 512 GiB), so leaf fingerprints tell apart keys that share their head
+// without reading tails; a lookup key keeps a 47-bit address and flag bit
+// dram_tail, and hashes its tail when asked.
+struct VarKey {
+    static constexpr std::size_t inline_bytes = 8;
+    static constexpr std::size_t max_length = 0xFFFF;
+    static constexpr std::uint64_t dram_tail = 1ULL << 63;
+    static constexpr std::uint64_t max_tail_offset = (1ULL << 39) - 1;
+
+    std::array<std::uint8_t, inline_bytes> head;
+    std::uint64_t word;
+
+    [[nodiscard]] std::size_t length() const noexcept {
+        return static_cast<std::size_t>(word & 0xFFFF);
+    }
+    [[nodiscard]] bool has_tail() const noexcept { return length() > inline_bytes; }
+    [[nodiscard]] bool dram() const noexcept { return (word & dram_tail) != 0; }
+    // Region offset or address of the tail; 0 for keys without one.
+    [[nodiscard]] std::uint64_t tail_location() const noexcept {
+        return dram() ? (word & ~dram_tail) >> 16 : word >> 24;
+    }
+    [[nodiscard]] std::uint8_t tail_hash() const noexcept {
+        if (!has_tail())
+            return 0;
+        if (dram())
+            return hash_tail(reinterpret_cast<const void *>(tail_location()),
+                             length() - inline_bytes);
+        return static_cast<std::uint8_t>(word >> 16);
+    }
+    [[nodiscard]] static std::uint8_t hash_tail(const void *bytes, std::size_t len) noexcept {
+        return static_cast<std::uint8_t>(crc32c(bytes, len));
+    }
+
+    // A key over bytes, for lookups; its tail is bytes itself, so bytes
+    // must outlive the key.
+    [[nodiscard]] static VarKey lookup(std::string_view bytes) noexcept;
+    // A key whose tail was appended to a KeyHeap at tail_offset.
+    [[nodiscard]] static VarKey stored(std::string_view bytes,
+                                       std::uint64_t tail_offset) noexcept;
+};
+
+static_assert(sizeof(VarKey) == 16 && std::is_trivially_copyable_v<VarKey>);
+
+// Orders VarKeys by their bytes. The tree builds it from its Manager so
+// stored tails can be reached; a default-constructed one only handles
+// keys whose tails are absent or in DRAM.
+class VarKeyLess {
+public:
+    VarKeyLess() noexcept = default;
+    explicit VarKeyLess(Manager *manager) noexcept;
+
+    [[nodiscard]] bool operator()(const VarKey &a, const VarKey &b) const noexcept {
+        std::uint64_t ha = head_word(a);
+        std::uint64_t hb = head_word(b);
+        if (ha != hb)
+            return ha < hb;
+        // Equal heads: a key that ends within them is a prefix of the other.
+        std::size_t la = a.length();
+        std::size_t lb = b.length();
+        if (la <= VarKey::inline_bytes || lb <= VarKey::inline_bytes)
+            return la < lb;
+        int c = std::memcmp(tail(a), tail(b), std::min(la, lb) - VarKey::inline_bytes);
+        return c != 0 ? c < 0 : la < lb;
+    }
+
+    // Covers the head, the length and the tail's hash; BasicBTree uses it
+    // for leaf fingerprints.
+    [[nodiscard]] static std::uint64_t hash(const VarKey &key) noexcept {
+        std::uint64_t h = (head_word(key) ^ key.length()) * 0x100000001b3ULL;
+        return (h ^ key.tail_hash()) * 0x100000001b3ULL;
+    }
+
+    // The shortest prefix of right that still orders after left, for
+    // left < right: a separator between two leaves that only needs the
+    // bytes up to the first one where they differ. Within the head it is
+    // stored inline; otherwise it shares right's tail.
+    [[nodiscard]] VarKey separator(const VarKey &left, const VarKey &right) const noexcept;
+
+    // Region offset of a stored key's tail, or 0; BasicBTree::recover
+    // keeps the blocks these point into.
+    [[nodiscard]] static std::uint64_t region_ref(const VarKey &key) noexcept {
+        return key.has_tail() && !key.dram() ? key.tail_location() : 0;
+    }
+
+    // Optimistic readers may compare a key torn by a concurrent writer
+    // before their validation fails; a stored tail that would run past the
+    // region reads as zeros instead.
+    [[nodiscard]] const std::uint8_t *tail(const VarKey &key) const noexcept {
+        std::uint64_t location = key.tail_location();
+        if (key.dram())
+            return reinterpret_cast<const std::uint8_t *>(location);
+        if (location + key.length() > region_size_) [[unlikely]]
+            return torn_tail.data();
+        return reinterpret_cast<const std::uint8_t *>(base_) + location;
+    }
+
+    // Big-endian head, so integer order is byte order.
+    [[nodiscard]] static std::uint64_t head_word(const VarKey &key) noexcept {
+        std::uint64_t word;
+        std::memcpy(&word, key.head.data(), sizeof(word));
+        if constexpr (std::endian::native == std::endian::little)
+            word = __builtin_bswap64(word);
+        return word;
+    }
+
+private:
+    static constexpr std::array<std::uint8_t, VarKey::max_length> torn_tail{};
+
+    const std::byte *base_ = nullptr;
+    std::uint64_t region_size_ = 0;
+};
+
+// Append-only store for key tails in region blocks. Tails are flushed
+// before append returns, so they are durable before any entry that points
+// at them is committed. The block being filled is pinned; the GC keeps the
+// others only while a stored key or separator still points into them, so
+// a block is reclaimed once every key in it is erased. Tails never move,
+// and the heap starts a fresh block each time a region is reopened.
+class KeyHeap {
+public:
+    explicit KeyHeap(Manager *manager) noexcept;
+    ~KeyHeap();
+
+    KeyHeap(const KeyHeap &) = delete;
+    KeyHeap &operator=(const KeyHeap &) = delete;
+
+    // Copies bytes into the heap and returns their region offset. Throws
+    // std::runtime_error if they do not fit a block.
+    [[nodiscard]] std::uint64_t append(std::string_view bytes);
+
+    // Blocks this heap has taken from the Manager since it was created.
+    [[nodiscard]] std::size_t blocks_allocated() const;
+
+private:
+    Manager *manager_;
+    mutable std::mutex mutex_;
+    std::uint64_t block_;
+    std::size_t used_;
+    std::size_t blocks_allocated_;
+};
+
+extern template class BasicBTree<VarKey, std::uint64_t, VarKeyLess>;
+
+// A tree over variable-length binary keys, taken and handed out as
+// string_views of up to VarKey::max_length bytes. Tails of stored keys go
+// to a KeyHeap ahead of the entry, and leaf splits cut separators to the
+// shortest prefix that divides the two leaves, so internal nodes mostly
+// hold inline separators whatever the key lengths. Internal nodes hold
+// 16-byte keys, which gives half the fanout of an 8-byte key type per
+// block.
+//
+// Needs PersistenceMode::Full: a leaves-only tree would rebuild its
+// separators in DRAM, where the GC cannot see the tails they point into.
+// The GC must not run while snapshots are open, as their undo records
+// may hold keys the leaves no longer do.
+template <typename Value = std::uint64_t>
+class VarKeyBTree {
+public:
+    using tree_type = BasicBTree<VarKey, Value, VarKeyLess>;
+
+    VarKeyBTree(Manager *manager, const BTreeConfig &config);
+
+    void insert(std::string_view key, const Value &value);
+    // As BasicBTree::upsert. An update appends nothing to the heap.
+    bool upsert(std::string_view key, const Value &value);
+    [[nodiscard]] bool search(std::string_view key, Value &out_value) const;
+    // As BasicBTree::multi_get and search_sorted_batch.
+    std::size_t multi_get(std::span<const std::string_view> keys, std::span<Value> values,
+                          std::span<bool> found, std::size_t group = 8) const;
+    std::size_t search_sorted_batch(std::span<const std::string_view> keys,
+                                    std::span<Value> values, std::span<bool> found) const;
+    [[nodiscard]] bool erase(std::string_view key);
+
+    // Calls fn(key, value) for every entry in [lo, hi), in key order. Keys
+    // are only valid during the call. If fn returns bool, returning false
+    // stops the scan.
+    template <typename Fn>
+    void scan(std::string_view lo, std::string_view hi, Fn &&fn) const;
+
+    // The bytes of a key held by this tree.
+    [[nodiscard]] std::string key_bytes(const VarKey &key) const;
+
+    [[nodiscard]] tree_type &tree() noexcept { return tree_; }
+    [[nodiscard]] const tree_type &tree() const noexcept { return tree_; }
+    [[nodiscard]] const KeyHeap &heap() const noexcept { return heap_; }
+
+private:
+    Manager *manager_;
+    tree_type tree_;
+    KeyHeap heap_;
+    VarKeyLess comp_;
+
+    [[nodiscard]] VarKey stored_key(std::string_view key);
+    // Runs lookup over keys as VarKeys; keys too long to store are not found.
+    template <typename Lookup>
+    std::size_t batch_lookup(std::span<const std::string_view> keys, std::span<bool> found,
+                             Lookup &&lookup) const;
+    void append_bytes(const VarKey &key, std::string &out) const;
+};
+
+template <typename Value>
+VarKeyBTree<Value>::VarKeyBTree(Manager *manager, const BTreeConfig &config)
+    : manager_(manager), tree_(manager, config), heap_(manager), comp_(manager) {
+    if (tree_.persistence() != PersistenceMode::Full) [[unlikely]]
+        throw std::runtime_error("VarKeyBTree needs a PersistenceMode::Full region");
+
+    auto *meta = static_cast<Manager::Metadata *>(manager_->base());
+    if (!(meta->flags & Manager::Metadata::flag_var_keys)) {
+        meta->flags |= Manager::Metadata::flag_var_keys;
+        persist(meta, sizeof(Manager::Metadata));
+        manager_->update_persistent_checksum();
+    }
+}
+
+template <typename Value>
+void VarKeyBTree<Value>::insert(std::string_view key, const Value &value) {
+    tree_.insert(stored_key(key), value);
+}
+
+// Only a key that is not in the tree yet needs its tail in the heap.
+template <typename Value>
+bool VarKeyBTree<Value>::upsert(std::string_view key, const Value &value) {
+    if (key.size() <= VarKey::inline_bytes)
+        return tree_.upsert(VarKey::lookup(key), value);
+    if (key.size() <= VarKey::max_length && tree_.update(VarKey::lookup(key), value))
+        return false;
+    return tree_.upsert(stored_key(key), value);
+}
+
+template <typename Value>
+[[nodiscard]] bool VarKeyBTree<Value>::search(std::string_view key, Value &out_value) const {
+    return key.size() <= VarKey::max_length && tree_.search(VarKey::lookup(key), out_value);
+}
+
+template <typename Value>
+std::size_t VarKeyBTree<Value>::multi_get(std::span<const std::string_view> keys,
+                                          std::span<Value> values, std::span<bool> found,
+                                          std::size_t group) const {
+    return batch_lookup(keys, found, [&](std::span<const VarKey> lookups) {
+        return tree_.multi_get(lookups, values, found, group);
+    });
+}
+
+template <typename Value>
+std::size_t VarKeyBTree<Value>::search_sorted_batch(std::span<const std::string_view> keys,
+                                                    std::span<Value> values,
+                                                    std::span<bool> found) const {
+    return batch_lookup(keys, found, [&](std::span<const VarKey> lookups) {
+        return tree_.search_sorted_batch(lookups, values, found);
+    });
+}
+
+// Tails are compared in place, so keys must stay alive for the call.
+template <typename Value>
+template <typename Lookup>
+std::size_t VarKeyBTree<Value>::batch_lookup(std::span<const std::string_view> keys,
+                                             std::span<bool> found, Lookup &&lookup) const {
+    std::vector<VarKey> lookups;
+    lookups.reserve(keys.size());
+    for (std::string_view key : keys)
+        lookups.push_back(VarKey::lookup(key.substr(0, VarKey::max_length)));
+    std::size_t hits = lookup(std::span<const VarKey>(lookups));
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (found[i] && keys[i].size() > VarKey::max_length) {
+            found[i] = false;
+            --hits;
+        }
+    }
+    return hits;
+}
+
+template <typename Value>
+[[nodiscard]] bool VarKeyBTree<Value>::erase(std::string_view key) {
+    return key.size() <= VarKey::max_length && tree_.erase(VarKey::lookup(key));
+}
+
+template <typename Value>
+template <typename Fn>
+void VarKeyBTree<Value>::scan(std::string_view lo, std::string_view hi, Fn &&fn) const {
+    lo = lo.substr(0, VarKey::max_length);
+    hi = hi.substr(0, VarKey::max_length);
+    std::string bytes;
+    tree_.scan(VarKey::lookup(lo), VarKey::lookup(hi), [&](const VarKey &key, const Value &value) {
+        bytes.clear();
+        append_bytes(key, bytes);
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn &, std::string_view, const Value &>,
+                                     bool>)
+            return fn(std::string_view(bytes), value);
+        else
+            fn(std::string_view(bytes), value);
+    });
+}
+
+template <typename Value>
+[[nodiscard]] std::string VarKeyBTree<Value>::key_bytes(const VarKey &key) const {
+    std::string bytes;
+    append_bytes(key, bytes);
+    return bytes;
+}
+
+template <typename Value>
+[[nodiscard]] VarKey VarKeyBTree<Value>::stored_key(std::string_view key) {
+    if (key.size() > VarKey::max_length) [[unlikely]] {
+        throw std::runtime_error(std::format("VarKey of {} bytes exceeds the {} byte limit",
+                                             key.size(), VarKey::max_length));
+    }
+    if (key.size() <= VarKey::inline_bytes)
+        return VarKey::lookup(key);
+    return VarKey::stored(key, heap_.append(key.substr(VarKey::inline_bytes)));
+}
+
+template <typename Value>
+void VarKeyBTree<Value>::append_bytes(const VarKey &key, std::string &out) const {
+    const auto *head = reinterpret_cast<const char *>(key.head.data());
+    out.append(head, std::min(key.length(), VarKey::inline_bytes));
+    if (key.has_tail())
+        out.append(reinterpret_cast<const char *>(comp_.tail(key)),
+                   key.length() - VarKey::inline_bytes);
+}
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_VAR_KEY_H
@@ -0,0 +1,74 @@
+#ifndef ATOMIC_TREE_VERSION_LOCK_H
+#define ATOMIC_TREE_VERSION_LOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <immintrin.h> // for _mm_pause
+
+namespace atomic_tree {
+
+// Optimistic lock coupling word. Readers snapshot the version, read without
+// writing shared memory, then validate; writers upgrade a snapshot to an
+// exclusive lock and bump the version on unlock. Bit 1 is the lock bit and
+// bit 0 marks a node that was unlinked from the tree.
+//
+// Lock words live in DRAM only, so a crash can never leave a node locked.
+class VersionLock {
+public:
+    static constexpr std::uint64_t locked_bit   = 0b10;
+    static constexpr std::uint64_t obsolete_bit = 0b01;
+
+    // Waits out a writer and returns the version to validate against;
+    // false means the node is obsolete and the caller must restart.
+    [[nodiscard]] bool read_lock(std::uint64_t &version) const noexcept {
+        version = word_.load(std::memory_order_acquire);
+        for (unsigned spins = 0; version & locked_bit; ++spins) [[unlikely]] {
+            // A writer holds the node for one flush; if it was preempted,
+            // stop burning its core.
+            if (spins < 64)
+                _mm_pause();
+            else
+                std::this_thread::yield();
+            version = word_.load(std::memory_order_acquire);
+        }
+        return (version & obsolete_bit) == 0;
+    }
+
+    // True if nothing was written since read_lock returned version.
+    [[nodiscard]] bool validate(std::uint64_t version) const noexcept {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return word_.load(std::memory_order_relaxed) == version;
+    }
+
+    [[nodiscard]] bool try_upgrade(std::uint64_t version) noexcept {
+        return word_.compare_exchange_strong(version, version + locked_bit,
+                                             std::memory_order_acquire);
+    }
+
+    void unlock() noexcept {
+        word_.fetch_add(locked_bit, std::memory_order_release);
+    }
+
+    void unlock_obsolete() noexcept {
+        word_.fetch_add(locked_bit | obsolete_bit, std::memory_order_release);
+    }
+
+    // Clears the obsolete bit when a freed block is handed out again. The
+    // version still moves forward, so nothing validated against the old
+    // node can pass.
+    void revive() noexcept {
+        std::uint64_t version = word_.load(std::memory_order_relaxed);
+        if (version & obsolete_bit)
+            word_.store((version & ~obsolete_bit) + 2 * locked_bit,
+                        std::memory_order_release);
+    }
+
+private:
+    std::atomic<std::uint64_t> word_{0};
+};
+
+} // namespace atomic_tree
+
+#endif // ATOMIC_TREE_VERSION_LOCK_H
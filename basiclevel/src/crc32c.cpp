@@ -0,0 +1,196 @@
+#include "crc32c.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+namespace atomic_tree {
+
+namespace {
+
+// Bit-reflected Castagnoli polynomial. The update functions below work on
+// the raw register; crc32c() applies the pre- and post-inversion.
+constexpr std::uint32_t poly = 0x82F63B78u;
+
+using Table = std::array<std::array<std::uint32_t, 256>, 8>;
+
+// tables[k][b] is the register after byte b followed by k zero bytes, so
+// eight bytes fold in with eight independent lookups.
+constexpr Table make_slicing_tables() {
+    Table t{};
+    for (std::uint32_t b = 0; b < 256; ++b) {
+        std::uint32_t c = b;
+        for (int i = 0; i < 8; ++i)
+            c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+        t[0][b] = c;
+    }
+    for (std::size_t k = 1; k < 8; ++k)
+        for (std::size_t b = 0; b < 256; ++b)
+            t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+    return t;
+}
+
+constexpr Table slicing = make_slicing_tables();
+
+std::uint64_t load_u64(const std::uint8_t *p) noexcept {
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+std::uint32_t update_sw(std::uint32_t crc, const std::uint8_t *p, std::size_t len) noexcept {
+    for (; len > 0 && (reinterpret_cast<std::uintptr_t>(p) & 7); --len)
+        crc = slicing[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    for (; len >= 8; len -= 8, p += 8) {
+        std::uint64_t word = load_u64(p) ^ crc;
+        crc = slicing[7][word & 0xFF] ^ slicing[6][(word >> 8) & 0xFF] ^
+              slicing[5][(word >> 16) & 0xFF] ^ slicing[4][(word >> 24) & 0xFF] ^
+              slicing[3][(word >> 32) & 0xFF] ^ slicing[2][(word >> 40) & 0xFF] ^
+              slicing[1][(word >> 48) & 0xFF] ^ slicing[0][word >> 56];
+    }
+
+    for (; len > 0; --len)
+        crc = slicing[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// a * b modulo the polynomial, both bit-reflected.
+constexpr std::uint32_t multmodp(std::uint32_t a, std::uint32_t b) {
+    std::uint32_t product = 0;
+    for (std::uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m)
+            product ^= b;
+        b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * bytes) modulo the polynomial: the operator that appends that many
+// zero bytes to a register.
+constexpr std::uint32_t zeros_operator(std::size_t bytes) {
+    std::uint32_t op = 1u << 31;      // x^0
+    std::uint32_t square = 1u << 23;  // x^8
+    for (; bytes != 0; bytes >>= 1) {
+        if (bytes & 1)
+            op = multmodp(square, op);
+        square = multmodp(square, square);
+    }
+    return op;
+}
+
+// Each of the three streams covers one stripe of a 3 * stripe_bytes round.
+// Short enough that a leaf's few hundred bytes still interleave, long
+// enough that the two shifts per round stay in the noise.
+constexpr std::size_t stripe_bytes = 128;
+
+using ShiftTable = std::array<std::array<std::uint32_t, 256>, 4>;
+
+constexpr ShiftTable make_shift_table() {
+    constexpr std::uint32_t op = zeros_operator(stripe_bytes);
+    ShiftTable t{};
+    for (std::size_t k = 0; k < 4; ++k)
+        for (std::uint32_t b = 0; b < 256; ++b)
+            t[k][b] = multmodp(op, b << (8 * k));
+    return t;
+}
+
+constexpr ShiftTable stripe_shift = make_shift_table();
+
+// The register after it is followed by stripe_bytes zero bytes.
+std::uint32_t shift_stripe(std::uint32_t crc) noexcept {
+    return stripe_shift[0][crc & 0xFF] ^ stripe_shift[1][(crc >> 8) & 0xFF] ^
+           stripe_shift[2][(crc >> 16) & 0xFF] ^ stripe_shift[3][crc >> 24];
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#    define ATOMIC_TREE_HAS_SSE42_DISPATCH 1
+
+// crc32 has a three-cycle latency and one-per-cycle throughput, so three
+// independent streams keep the unit busy. Streams 1 and 2 start from zero
+// and are folded in by shifting the running register past their stripe.
+__attribute__((target("sse4.2")))
+std::uint32_t update_hw(std::uint32_t crc, const std::uint8_t *p, std::size_t len) noexcept {
+    for (; len > 0 && (reinterpret_cast<std::uintptr_t>(p) & 7); --len)
+        crc = _mm_crc32_u8(crc, *p++);
+
+    std::uint64_t c0 = crc;
+    for (; len >= 3 * stripe_bytes; len -= 3 * stripe_bytes) {
+        std::uint64_t c1 = 0;
+        std::uint64_t c2 = 0;
+        for (const std::uint8_t *end = p + stripe_bytes; p < end; p += 8) {
+            c0 = _mm_crc32_u64(c0, load_u64(p));
+            c1 = _mm_crc32_u64(c1, load_u64(p + stripe_bytes));
+            c2 = _mm_crc32_u64(c2, load_u64(p + 2 * stripe_bytes));
+        }
+        c0 = shift_stripe(static_cast<std::uint32_t>(c0)) ^ c1;
+        c0 = shift_stripe(static_cast<std::uint32_t>(c0)) ^ c2;
+        p += 2 * stripe_bytes;
+    }
+
+    for (; len >= 8; len -= 8, p += 8)
+        c0 = _mm_crc32_u64(c0, load_u64(p));
+    crc = static_cast<std::uint32_t>(c0);
+    for (; len > 0; --len)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+bool cpu_has_sse42() noexcept {
+    return __builtin_cpu_supports("sse4.2");
+}
+#else
+bool cpu_has_sse42() noexcept {
+    return false;
+}
+#endif
+
+using UpdateFn = std::uint32_t (*)(std::uint32_t, const std::uint8_t *, std::size_t) noexcept;
+
+UpdateFn make_update(bool hw) noexcept {
+#ifdef ATOMIC_TREE_HAS_SSE42_DISPATCH
+    if (hw && cpu_has_sse42())
+        return update_hw;
+#else
+    (void)hw;
+#endif
+    return update_sw;
+}
+
+// Constant-initialized, so it is usable during other translation units'
+// static initialization; the CPU check runs on first use. Null until then.
+constinit std::atomic<UpdateFn> update{nullptr};
+
+UpdateFn active_update() noexcept {
+    UpdateFn fn = update.load(std::memory_order_acquire);
+    if (fn != nullptr) [[likely]]
+        return fn;
+    UpdateFn expected = nullptr;
+    fn = make_update(true);
+    // An enable_hw_crc32c that got in first wins.
+    if (!update.compare_exchange_strong(expected, fn, std::memory_order_acq_rel))
+        fn = expected;
+    return fn;
+}
+
+} // namespace
+
+[[nodiscard]] std::uint32_t crc32c(const void *data, std::size_t len,
+                                   std::uint32_t crc) noexcept {
+    return ~active_update()(~crc, static_cast<const std::uint8_t *>(data), len);
+}
+
+bool enable_hw_crc32c(bool enabled) noexcept {
+    UpdateFn fn = make_update(enabled);
+    update.store(fn, std::memory_order_release);
+    return fn != update_sw;
+}
+
+[[nodiscard]] bool hw_crc32c_enabled() noexcept {
+    return active_update() != update_sw;
+}
+
+} // namespace atomic_tree
@@ -1,9 +1,12 @@
 #include "garbage_collector.h"
 #include "B_tree.h"
 #include "manager.h"
+#include "value_log.h"
+#include "var_key.h"
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <vector>
 #include <bit>
 #include <format>
@@ -17,15 +20,66 @@ GarbageCollector::GarbageCollector(Manager *manager)
 void GarbageCollector::collect(std::uint64_t root_offset, int max_keys, int leaf_capacity) {
     std::vector<std::uint64_t> stack;
 
+    // Leaves-only trees keep internal nodes in DRAM; every block they own is
+    // on the leaf chain that starts at the region's root.
+    auto *meta = static_cast<Manager::Metadata *>(manager_->base());
+    if (meta->flags & Manager::Metadata::flag_leaves_only)
+        root_offset = meta->root_offset;
+
     if (root_offset != 0) [[likely]] {
         stack.push_back(root_offset);
     }
+    // Other trees sharing the region.
+    for (std::uint32_t slot = 1; slot < meta->shard_count; ++slot)
+        if (std::uint64_t root = manager_->get_root_offset(slot); root != 0)
+            stack.push_back(root);
 
     std::size_t n_blocks = manager_->block_count();
     std::vector<bool> reachable(n_blocks, false);
 
+    // Metadata and bitmap blocks, and the split keys of a ShardedBTree,
+    // are never reachable from a root.
+    for (std::size_t i = 0; i < manager_->reserved_blocks(); ++i)
+        reachable[i] = true;
+    if (meta->shard_splits != 0)
+        reachable[meta->shard_splits / manager_->block_size()] = true;
+
+    // VarKey tails live in KeyHeap blocks, kept while any live key or
+    // separator points into them. Keys start their leaf entries.
+    const bool var_keys = (meta->flags & Manager::Metadata::flag_var_keys) != 0;
+    auto mark_tail = [&](const std::uint8_t *key_bytes) {
+        VarKey key;
+        std::memcpy(&key, key_bytes, sizeof(key));
+        if (!key.has_tail() || key.dram()) [[likely]]
+            return;
+        std::size_t tail_block = key.tail_location() / manager_->block_size();
+        if (tail_block < n_blocks)
+            reachable[tail_block] = true;
+    };
+
+    // Values stored out of line keep their whole ValueLog segment, a
+    // group of blocks aligned to its size. Handles follow the key.
+    const bool value_log = (meta->flags & Manager::Metadata::flag_value_log) != 0;
+    auto mark_segment = [&](const std::uint8_t *handle_bytes) {
+        std::uint64_t handle;
+        std::memcpy(&handle, handle_bytes, sizeof(handle));
+        if (ValueLog::is_inline(handle)) [[likely]]
+            return;
+        std::size_t first = ValueLog::record_offset(handle) / manager_->block_size() /
+                            Manager::blocks_per_group * Manager::blocks_per_group;
+        for (std::size_t b = first; b < first + Manager::blocks_per_group && b < n_blocks; ++b)
+            reachable[b] = true;
+    };
+
     marked_count_ = 0;
 
+    // Child pointers sit after the keys/entries, whose sizes the tree recorded.
+    std::size_t key_size = meta->key_size;
+    std::size_t entry_size = meta->entry_size;
+    std::size_t children_off = internal_children_offset(key_size, max_keys);
+    std::size_t next_off = leaf_next_offset(entry_size, leaf_capacity);
+    std::size_t value_off = (key_size + 7) & ~std::size_t{7};
+
     while (!stack.empty()) {
         std::uint64_t offset = stack.back();
         stack.pop_back();
@@ -44,12 +98,27 @@ void GarbageCollector::collect(std::uint64_t root_offset, int max_keys, int leaf
             static_cast<BTreeNode *>(manager_->offset_to_ptr(offset));
 
         if (node->is_leaf) [[likely]] {
-            std::uint64_t *next_ptr = BTree::get_leaf_next(node, leaf_capacity);
+            auto *next_ptr = reinterpret_cast<std::uint64_t *>(node->data + next_off);
             if (*next_ptr != 0) [[unlikely]]
                 stack.push_back(*next_ptr);
+            const std::uint8_t *entries = node->data + leaf_entries_offset(leaf_capacity);
+            std::uint64_t live = 0;
+            if (var_keys || value_log)
+                live = *reinterpret_cast<std::uint64_t *>(node->data);
+            for (; live; live &= live - 1) {
+                const std::uint8_t *entry =
+                    entries + static_cast<std::size_t>(std::countr_zero(live)) * entry_size;
+                if (var_keys)
+                    mark_tail(entry);
+                if (value_log)
+                    mark_segment(entry + value_off);
+            }
         } else {
-            std::uint64_t *children = BTree::get_internal_children(node, max_keys);
-            for (int i = 0; i <= node->key_count; ++i) {
+            if (var_keys)
+                for (std::uint32_t i = 0; i < node->key_count; ++i)
+                    mark_tail(node->data + i * key_size);
+            auto *children = reinterpret_cast<std::uint64_t *>(node->data + children_off);
+            for (std::uint32_t i = 0; i <= node->key_count; ++i) {
                 if (children[i] != 0) [[likely]] {
                     stack.push_back(children[i]);
                 }
@@ -57,6 +126,12 @@ void GarbageCollector::collect(std::uint64_t root_offset, int max_keys, int leaf
         }
     }
 
+    // Kept after the walk rather than before it: a pinned block may already
+    // be a node, whose children still have to be marked.
+    for (std::uint64_t offset : manager_->pinned_blocks())
+        if (offset / manager_->block_size() < n_blocks)
+            reachable[offset / manager_->block_size()] = true;
+
     freed_count_ = 0;
 
     std::uint64_t *bitmap = manager_->get_bitmap();
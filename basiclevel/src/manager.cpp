@@ -1,5 +1,6 @@
 #include "manager.h"
 #include "primitives.h"
+#include "radix_sort.h"
 
 #include <cstdint>
 #include <cstddef>
@@ -10,6 +11,12 @@
 #include <bit>
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #    include <windows.h>
@@ -27,14 +34,65 @@ consteval std::uint64_t magic_number() noexcept {
     return 0x4154524545;
 }
 
+// Bumped whenever Metadata, the reserved area or a node format changes.
+// Regions of another version are refused rather than misread; there is no
+// migration.
+consteval std::uint32_t layout_version() noexcept {
+    return 8;
+}
+
 constexpr std::size_t align_to_8(std::size_t value) noexcept {
     return (value + 7) & ~std::size_t{7};
 }
 
+// Forces a closed file's contents to disk.
+[[nodiscard]] bool sync_file(const std::string &path) noexcept {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    bool synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return synced;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+// Each thread keeps to one checksum stripe, handed out round robin.
+std::size_t checksum_stripe(std::size_t stripes) noexcept {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t stripe = next.fetch_add(1, std::memory_order_relaxed);
+    return stripe % stripes;
+}
+
 constexpr std::size_t calculate_bitmap_words(std::size_t block_count) noexcept {
     return (block_count + 63) / 64;
 }
 
+consteval std::uint64_t incremental_magic() noexcept {
+    return 0x31524e4943525441; // "ATRCINR1"
+}
+
+// Header of an export_incremental stream. It is followed by
+// changed_blocks * (u64 block index + block bytes), then the reserved
+// metadata/bitmap blocks as of the new checkpoint.
+struct IncrementalHeader {
+    std::uint64_t magic;
+    std::uint64_t from_checkpoint;
+    std::uint64_t to_checkpoint;
+    std::uint64_t block_size;
+    std::uint64_t block_count;
+    std::uint64_t reserved_blocks;
+    std::uint64_t changed_blocks;
+};
+
 Manager::Manager(const std::string &filename,
                  std::size_t region_size,
                  std::size_t block_size,
@@ -46,11 +104,19 @@ Manager::Manager(const std::string &filename,
       base_(nullptr),
       metadata_(nullptr),
       bitmap_(nullptr),
+      dirty_bitmap_(nullptr),
       block_count_(0),
       bitmap_size_words_(0),
-      allocated_blocks_(0) {
+      reserved_blocks_(0),
+      allocated_blocks_(0),
+      exporting_(false),
+      punched_bytes_(0),
+      reclaim_stop_(false) {
     block_count_ = region_size / block_size;
     bitmap_size_words_ = calculate_bitmap_words(block_count_);
+    pending_release_.assign(bitmap_size_words_, 0);
+    freed_at_.assign(bitmap_size_words_, {});
+    redirtied_.assign(bitmap_size_words_, 0);
 
 #ifdef _WIN32
     DWORD access_mode = GENERIC_READ | GENERIC_WRITE;
@@ -142,22 +208,34 @@ Manager::Manager(const std::string &filename,
         static_cast<std::uint8_t *>(base_) + bitmap_offset);
 
     std::size_t bitmap_bytes = bitmap_size_words_ * sizeof(std::uint64_t);
-    std::size_t total_reserved_bytes = bitmap_offset + bitmap_bytes;
+    dirty_bitmap_ = bitmap_ + bitmap_size_words_;
+
+    std::size_t total_reserved_bytes = bitmap_offset + 2 * bitmap_bytes;
     std::size_t reserved_blocks =
         (total_reserved_bytes + block_size - 1) / block_size;
+    reserved_blocks_ = reserved_blocks;
 
     if (create_new) [[unlikely]] {
         metadata_->magic = magic_number();
-        metadata_->version = 1;
+        metadata_->version = layout_version();
         metadata_->root_offset = 0;
         metadata_->block_count = block_count_;
         metadata_->block_size = block_size_;
         metadata_->max_keys = 16;
         metadata_->min_keys = 8;
         metadata_->leaf_capacity = 32;
-        metadata_->padding = 0;
+        metadata_->key_size = 4;
+        metadata_->entry_size = 8;
+        metadata_->flags = 0;
+        metadata_->checksum_stale = 0;
+        metadata_->checkpoint_id = 1;
+        metadata_->shard_count = 0;
+        metadata_->shard_routing = 0;
+        metadata_->shard_splits = 0;
+        std::fill(std::begin(metadata_->extra_roots), std::end(metadata_->extra_roots), 0);
 
         std::memset(bitmap_, 0, bitmap_bytes);
+        std::memset(dirty_bitmap_, 0, bitmap_bytes);
 
         for (std::size_t i = 0; i < reserved_blocks; ++i) {
             std::size_t word_idx = i / 64;
@@ -169,10 +247,16 @@ Manager::Manager(const std::string &filename,
 
         update_persistent_checksum();
         persist(metadata_, sizeof(Metadata));
-        persist(bitmap_, bitmap_bytes);
+        persist(bitmap_, 2 * bitmap_bytes);
     } else [[likely]] {
-        if (metadata_->magic != magic_number()) [[unlikely]] {
-            // Magic mismatch; leave handling to caller or future logic.
+        if (metadata_->magic != magic_number() || metadata_->version != layout_version()) [[unlikely]] {
+            std::string error =
+                metadata_->magic != magic_number()
+                    ? std::format("{} is not a tree region", filename)
+                    : std::format("{} has layout version {}, this build reads {}", filename,
+                                  metadata_->version, layout_version());
+            close_region();
+            throw std::runtime_error(error);
         }
 
         allocated_blocks_ = 0;
@@ -180,29 +264,52 @@ Manager::Manager(const std::string &filename,
             allocated_blocks_ += static_cast<std::size_t>(
                 std::popcount(bitmap_[i]));
         }
+        refresh_block_folds();
 
-        if (!create_new) [[likely]] {
-            if (!verify_integrity()) [[unlikely]] {
-                std::cerr
-                    << R"({"type": "log", "level": "ERROR", "message": "NVM Integrity Failure"})"
-                    << std::endl;
-            }
+        if (metadata_->checksum_stale) [[unlikely]] {
+            // The last owner stopped without closing. Its stores all reached
+            // the region; only the checksum deltas it held in DRAM were lost,
+            // so the checksum is rebuilt from the blocks.
+            metadata_->checksum = calculate_checksum();
+            persist(&metadata_->checksum, sizeof(metadata_->checksum));
+        } else if (!verify_integrity()) [[unlikely]] {
+            std::cerr
+                << R"({"type": "log", "level": "ERROR", "message": "NVM Integrity Failure"})"
+                << std::endl;
         }
     }
+
+    metadata_->checksum_stale = 1;
+    persist(&metadata_->checksum_stale, sizeof(metadata_->checksum_stale));
 }
 
-void Manager::set_root_offset(std::uint64_t offset) {
-    metadata_->root_offset = offset;
-    update_persistent_checksum();
-    _mm_clflush(metadata_);
+void Manager::set_root_offset(std::uint64_t offset, std::uint32_t slot) {
+    if (slot >= Metadata::max_root_slots) [[unlikely]] {
+        throw std::runtime_error(std::format("Root slot {} is past the {} the region holds",
+                                             slot, Metadata::max_root_slots));
+    }
+    std::uint64_t &root = slot == 0 ? metadata_->root_offset : metadata_->extra_roots[slot - 1];
+    xor_into_checksum(std::rotl(root, 1) ^ std::rotl(offset, 1));
+    root = offset;
+    _mm_clflush(&root);
     _mm_sfence();
 }
 
-[[nodiscard]] std::uint64_t Manager::get_root_offset() const noexcept {
-    return metadata_->root_offset;
+[[nodiscard]] std::uint64_t Manager::get_root_offset(std::uint32_t slot) const noexcept {
+    if (slot >= Metadata::max_root_slots) [[unlikely]]
+        return 0;
+    return slot == 0 ? metadata_->root_offset : metadata_->extra_roots[slot - 1];
 }
 
 Manager::~Manager() {
+    stop_space_reclaimer();
+    sync_checksum();
+    metadata_->checksum_stale = 0;
+    persist(&metadata_->checksum_stale, sizeof(metadata_->checksum_stale));
+    close_region();
+}
+
+void Manager::close_region() noexcept {
 #ifdef _WIN32
     if (base_) {
         UnmapViewOfFile(base_);
@@ -224,12 +331,18 @@ Manager::~Manager() {
 }
 
 [[nodiscard]] std::uint64_t Manager::alloc_block() {
-    for (std::size_t i = 0; i < bitmap_size_words_; ++i) {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    return alloc_block_locked(0);
+}
+
+[[nodiscard]] std::uint64_t Manager::alloc_block_locked(std::size_t first_word) {
+    for (std::size_t i = first_word; i < bitmap_size_words_; ++i) {
         std::uint64_t word = bitmap_[i];
         if (word != ~0ULL) [[likely]] {
             std::uint64_t inverted = ~word;
             auto index = std::countr_zero(inverted);
             bitmap_[i] |= (1ULL << index);
+            xor_into_checksum(std::rotl(word, 1) ^ std::rotl(bitmap_[i], 1));
 
             std::size_t block_idx = i * 64 + index;
             if (block_idx >= block_count_) [[unlikely]] {
@@ -248,16 +361,493 @@ void Manager::free_block(std::uint64_t offset) {
     if (offset >= region_size_) [[unlikely]]
         return;
 
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    free_block_locked(offset);
+}
+
+void Manager::free_block_locked(std::uint64_t offset) {
     std::size_t block_idx = static_cast<std::size_t>(offset / block_size_);
     std::size_t word_idx = block_idx / 64;
     std::size_t bit_idx = block_idx % 64;
 
     if (bitmap_[word_idx] & (1ULL << bit_idx)) [[likely]] {
+        std::uint64_t word = bitmap_[word_idx];
         bitmap_[word_idx] &= ~(1ULL << bit_idx);
+        xor_into_checksum(std::rotl(word, 1) ^ std::rotl(bitmap_[word_idx], 1));
         if (allocated_blocks_ > 0) {
             allocated_blocks_--;
         }
+        pending_release_[word_idx] |= 1ULL << bit_idx;
+        freed_at_[word_idx] = std::chrono::steady_clock::now();
+    }
+}
+
+// Releases the disk space behind blocks freed since the last pass. Adjacent
+// blocks are coalesced into one hole; blocks that alloc_block is about to hand
+// out again (the lowest free blocks, or ones in a word with a block freed too
+// recently) are skipped. The runs are reserved in the bitmap while
+// alloc_mutex_ is held and punched after it is dropped, so allocation is not
+// held up behind the filesystem.
+std::size_t Manager::reclaim_free_space(const SpaceReclaimConfig &config) {
+    std::vector<std::pair<std::size_t, std::size_t>> runs;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex_);
+        runs = reserve_release_runs(config);
+    }
+    if (runs.empty())
+        return 0;
+
+    // Unsupported or failed punches are dropped rather than retried.
+    std::size_t released = 0;
+    for (auto [first, n] : runs) {
+        if (punch_hole(first, n))
+            released += n;
+    }
+
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    for (auto [first, n] : runs)
+        set_bitmap_range(first, n, false);
+    punched_bytes_ += released * block_size_;
+    return released * block_size_;
+}
+
+[[nodiscard]] std::vector<std::pair<std::size_t, std::size_t>>
+Manager::reserve_release_runs(const SpaceReclaimConfig &config) {
+    std::vector<std::pair<std::size_t, std::size_t>> runs;
+    if (std::ranges::all_of(pending_release_, [](std::uint64_t word) { return word == 0; }))
+        return runs;
+
+    // alloc_block is first-fit, so the lowest free blocks are reused next.
+    std::size_t reserve_end = 0;
+    std::size_t reserve_left = config.reuse_reserve_blocks;
+    for (std::size_t i = 0; i < bitmap_size_words_ && reserve_left > 0; ++i) {
+        std::uint64_t free_bits = ~bitmap_[i];
+        auto free_count = static_cast<std::size_t>(std::popcount(free_bits));
+        if (free_count < reserve_left) {
+            reserve_left -= free_count;
+            reserve_end = (i + 1) * 64;
+            continue;
+        }
+
+        for (; reserve_left > 1; --reserve_left)
+            free_bits &= free_bits - 1;
+        reserve_end = i * 64 + static_cast<std::size_t>(std::countr_zero(free_bits)) + 1;
+        reserve_left = 0;
+    }
+    reserve_end = std::min(reserve_end, block_count_);
+
+    auto now = std::chrono::steady_clock::now();
+    std::size_t budget = config.max_bytes_per_pass / block_size_;
+    std::size_t released = 0;
+    std::size_t run_first = 0;
+    std::size_t run = 0;
+    auto punch_run = [&] {
+        if (run > 0) {
+            set_bitmap_range(run_first, run, true);
+            runs.emplace_back(run_first, run);
+            released += run;
+        }
+        run = 0;
+    };
+
+    for (std::size_t i = 0; i < bitmap_size_words_ && released + run < budget; ++i) {
+        // Blocks allocated again since they were freed have nothing to release.
+        pending_release_[i] &= ~bitmap_[i];
+        std::uint64_t bits = pending_release_[i];
+        if (bits == 0 || now - freed_at_[i] < config.min_free_age) {
+            punch_run();
+            continue;
+        }
+        for (; bits != 0 && released + run < budget; bits &= bits - 1) {
+            auto bit = std::countr_zero(bits);
+            std::size_t block_idx = i * 64 + static_cast<std::size_t>(bit);
+            if (block_idx < reserve_end)
+                continue;
+            if (run == 0 || block_idx != run_first + run) {
+                punch_run();
+                run_first = block_idx;
+            }
+            ++run;
+            pending_release_[i] &= ~(1ULL << bit);
+        }
+    }
+    punch_run();
+    return runs;
+}
+
+// Flips the bitmap bits of [first_block, first_block + n_blocks) without
+// counting the blocks as allocated: reclaim holds them only while it punches.
+void Manager::set_bitmap_range(std::size_t first_block, std::size_t n_blocks, bool set) noexcept {
+    for (std::size_t block_idx = first_block; block_idx < first_block + n_blocks; ++block_idx) {
+        std::uint64_t &word = bitmap_[block_idx / 64];
+        std::uint64_t old = word;
+        std::uint64_t mask = 1ULL << (block_idx % 64);
+        word = set ? word | mask : word & ~mask;
+        xor_into_checksum(std::rotl(old, 1) ^ std::rotl(word, 1));
+    }
+}
+
+void Manager::advise_willneed(std::uint64_t offset, std::size_t len) const noexcept {
+#ifdef _WIN32
+    // The mapping is touched on demand; no prefetch wired up here yet.
+    (void)offset;
+    (void)len;
+#else
+    static const std::uint64_t page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    std::uint64_t first = offset & ~(page - 1);
+    std::uint64_t end = std::min<std::uint64_t>(offset + len, region_size_);
+    if (first < end) [[likely]]
+        ::madvise(static_cast<std::uint8_t *>(base_) + first, end - first, MADV_WILLNEED);
+#endif
+}
+
+// The caller has reserved the range in the bitmap, so it cannot be
+// reallocated mid-punch.
+[[nodiscard]] bool Manager::punch_hole(std::size_t first_block, std::size_t n_blocks) {
+#if defined(__linux__)
+    std::size_t offset = first_block * block_size_;
+    std::size_t len = n_blocks * block_size_;
+
+    // The region checksum folds in every word; a hole reads back as zeros.
+    std::uint64_t delta = 0;
+    const auto *words = reinterpret_cast<const std::uint64_t *>(
+        static_cast<const std::uint8_t *>(base_) + offset);
+    for (std::size_t w = 0; w < len / sizeof(std::uint64_t); ++w)
+        delta ^= std::rotl(words[w], 1);
+
+    if (::fallocate(file_handle_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(offset), static_cast<off_t>(len)) != 0) [[unlikely]]
+        return false;
+
+    xor_into_checksum(delta);
+    std::fill_n(block_folds_.begin() + static_cast<std::ptrdiff_t>(first_block), n_blocks, 0);
+
+    // The hole reads back as zeros, which the next incremental export must carry.
+    mark_dirty(offset, len);
+    return true;
+#else
+    // No sparse-file support wired up for this platform yet.
+    (void)first_block;
+    (void)n_blocks;
+    return false;
+#endif
+}
+
+void Manager::start_space_reclaimer(const SpaceReclaimConfig &config) {
+    stop_space_reclaimer();
+
+    reclaim_config_ = config;
+    reclaim_stop_ = false;
+    reclaim_thread_ = std::thread(&Manager::reclaimer_loop, this);
+}
+
+void Manager::stop_space_reclaimer() {
+    if (!reclaim_thread_.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(reclaim_mutex_);
+        reclaim_stop_ = true;
+    }
+    reclaim_cv_.notify_all();
+    reclaim_thread_.join();
+}
+
+void Manager::reclaimer_loop() {
+    std::unique_lock<std::mutex> lock(reclaim_mutex_);
+    while (!reclaim_stop_) {
+        if (reclaim_cv_.wait_for(lock, reclaim_config_.interval,
+                                 [this] { return reclaim_stop_; }))
+            break;
+
+        lock.unlock();
+        reclaim_free_space(reclaim_config_);
+        lock.lock();
+    }
+}
+
+[[nodiscard]] std::uint64_t Manager::logical_file_size() const noexcept {
+#ifdef _WIN32
+    LARGE_INTEGER size_li;
+    if (GetFileSizeEx(file_handle_, &size_li)) [[likely]]
+        return static_cast<std::uint64_t>(size_li.QuadPart);
+    return region_size_;
+#else
+    struct stat st {};
+    if (::fstat(file_handle_, &st) != 0) [[unlikely]]
+        return region_size_;
+    return static_cast<std::uint64_t>(st.st_size);
+#endif
+}
+
+[[nodiscard]] std::uint64_t Manager::physical_file_size() const noexcept {
+#ifdef _WIN32
+    return logical_file_size();
+#else
+    struct stat st {};
+    if (::fstat(file_handle_, &st) != 0) [[unlikely]]
+        return region_size_;
+    return static_cast<std::uint64_t>(st.st_blocks) * 512;
+#endif
+}
+
+[[nodiscard]] std::uint64_t Manager::punched_bytes() const noexcept {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    return punched_bytes_;
+}
+
+void Manager::mark_dirty(std::uint64_t offset, std::size_t len) noexcept {
+    if (len == 0 || offset >= region_size_) [[unlikely]]
+        return;
+
+    std::size_t first = static_cast<std::size_t>(offset / block_size_);
+    std::size_t last = static_cast<std::size_t>((offset + len - 1) / block_size_);
+    last = std::min(last, block_count_ - 1);
+
+    for (std::size_t block_idx = first; block_idx <= last; ++block_idx) {
+        std::uint64_t mask = 1ULL << (block_idx % 64);
+        std::atomic_ref<std::uint64_t> word(dirty_bitmap_[block_idx / 64]);
+        if (word.load(std::memory_order_relaxed) & mask) [[likely]] {
+            if (exporting_.load(std::memory_order_acquire)) [[unlikely]]
+                std::atomic_ref<std::uint64_t>(redirtied_[block_idx / 64])
+                    .fetch_or(mask, std::memory_order_relaxed);
+            continue;
+        }
+
+        // First change since the checkpoint: the bit must be durable before
+        // the block contents it describes.
+        word.fetch_or(mask, std::memory_order_relaxed);
+        _mm_clflush(&dirty_bitmap_[block_idx / 64]);
+        _mm_sfence();
+    }
+}
+
+[[nodiscard]] std::uint64_t Manager::ptr_to_offset(const void *ptr) const noexcept {
+    return static_cast<std::uint64_t>(static_cast<const std::uint8_t *>(ptr) -
+                                      static_cast<const std::uint8_t *>(base_));
+}
+
+[[nodiscard]] std::uint64_t Manager::checkpoint_id() const noexcept {
+    return metadata_->checkpoint_id;
+}
+
+[[nodiscard]] std::size_t Manager::dirty_block_count() const noexcept {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < bitmap_size_words_; ++i)
+        count += static_cast<std::size_t>(std::popcount(dirty_bitmap_[i]));
+    return count;
+}
+
+// Streams the blocks changed since since_checkpoint_id, then the reserved
+// blocks as they stand once the new checkpoint is cut. A since id of 0
+// requests a full export of every non-zero block. Returns the new
+// checkpoint id, which is the since id for the next export.
+std::uint64_t Manager::export_incremental(std::uint64_t since_checkpoint_id,
+                                          const std::string &out_file) {
+    bool full = since_checkpoint_id == 0;
+    std::uint64_t from = metadata_->checkpoint_id;
+    if (!full && since_checkpoint_id != from) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Incremental export from checkpoint {} requested, region is at {}",
+                        since_checkpoint_id, from));
+    }
+
+    std::ofstream out(out_file, std::ios::binary | std::ios::trunc);
+    if (!out) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Failed to open export file: {}", out_file));
+    }
+
+    // Read word by word with the same atomics mark_dirty sets them with,
+    // but left set: they are only cleared once the new checkpoint holds.
+    std::size_t dirty_bytes = bitmap_size_words_ * sizeof(std::uint64_t);
+    exporting_.store(true, std::memory_order_seq_cst);
+    std::vector<std::uint64_t> taken(bitmap_size_words_);
+    for (std::size_t i = 0; i < bitmap_size_words_; ++i)
+        taken[i] = std::atomic_ref<std::uint64_t>(dirty_bitmap_[i]).load(std::memory_order_acquire);
+    auto end_export = [&] {
+        exporting_.store(false, std::memory_order_release);
+        for (std::uint64_t &word : redirtied_)
+            std::atomic_ref<std::uint64_t>(word).store(0, std::memory_order_relaxed);
+    };
+
+    auto block_ptr = [&](std::size_t block_idx) {
+        return static_cast<const char *>(offset_to_ptr(block_idx * block_size_));
+    };
+    auto is_zero = [&](std::size_t block_idx) {
+        const auto *words = reinterpret_cast<const std::uint64_t *>(block_ptr(block_idx));
+        return std::all_of(words, words + block_size_ / sizeof(std::uint64_t),
+                           [](std::uint64_t w) { return w == 0; });
+    };
+
+    IncrementalHeader header{};
+    header.magic = incremental_magic();
+    header.from_checkpoint = since_checkpoint_id;
+    header.to_checkpoint = from + 1;
+    header.block_size = block_size_;
+    header.block_count = block_count_;
+    header.reserved_blocks = reserved_blocks_;
+
+    try {
+        std::vector<std::size_t> changed;
+        for (std::size_t i = reserved_blocks_; i < block_count_; ++i) {
+            bool dirty = (taken[i / 64] >> (i % 64)) & 1ULL;
+            if (full ? !is_zero(i) : dirty)
+                changed.push_back(i);
+        }
+        header.changed_blocks = changed.size();
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        for (std::size_t block_idx : changed) {
+            std::uint64_t idx = block_idx;
+            out.write(reinterpret_cast<const char *>(&idx), sizeof(idx));
+            out.write(block_ptr(block_idx), static_cast<std::streamsize>(block_size_));
+        }
+
+        // The copy carries the new checkpoint id, with the checksum swapped
+        // to match, and no dirty blocks; the region itself moves on below.
+        sync_checksum();
+        std::vector<char> reserved(block_ptr(0), block_ptr(reserved_blocks_));
+        auto *meta = reinterpret_cast<Metadata *>(reserved.data());
+        meta->checksum ^= std::rotl(from, 1) ^ std::rotl(header.to_checkpoint, 1);
+        meta->checksum_stale = 0;
+        meta->checkpoint_id = header.to_checkpoint;
+        std::memset(reserved.data() + ptr_to_offset(dirty_bitmap_), 0, dirty_bytes);
+        out.write(reserved.data(), static_cast<std::streamsize>(reserved.size()));
+        out.close();
+    } catch (...) {
+        end_export();
+        throw;
+    }
+    if (out.fail() || !sync_file(out_file)) [[unlikely]] {
+        end_export();
+        throw std::runtime_error(
+            std::format("Failed to write export file: {}", out_file));
+    }
+
+    // The checkpoint id is one checksummed word; swapping its fold keeps
+    // the checksum exact without a quiescent full recompute.
+    xor_into_checksum(std::rotl(from, 1) ^ std::rotl(header.to_checkpoint, 1));
+    metadata_->checkpoint_id = header.to_checkpoint;
+    persist(&metadata_->checkpoint_id, sizeof(metadata_->checkpoint_id));
+
+    // Only the bits this export carried go, less any marked again since.
+    // A mark that lands between the two reads of a word is put back.
+    for (std::size_t i = 0; i < bitmap_size_words_; ++i) {
+        std::atomic_ref<std::uint64_t> redirtied(redirtied_[i]);
+        std::uint64_t clear = taken[i] & ~redirtied.load(std::memory_order_relaxed);
+        if (clear == 0)
+            continue;
+        std::atomic_ref<std::uint64_t> word(dirty_bitmap_[i]);
+        word.fetch_and(~clear, std::memory_order_acq_rel);
+        if (std::uint64_t late = redirtied.load(std::memory_order_acquire) & clear; late != 0)
+            word.fetch_or(late, std::memory_order_relaxed);
+    }
+    persist(dirty_bitmap_, dirty_bytes);
+    end_export();
+    return header.to_checkpoint;
+}
+
+// Replays an export_incremental stream onto a closed region file. Full
+// exports create the file; incremental ones must continue its checkpoint.
+std::uint64_t Manager::apply_incremental(const std::string &in_file,
+                                         const std::string &region_file) {
+    std::ifstream in(in_file, std::ios::binary);
+    if (!in) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Failed to open incremental file: {}", in_file));
+    }
+
+    IncrementalHeader header{};
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || header.magic != incremental_magic()) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Not an incremental export: {}", in_file));
+    }
+
+    // The reserved blocks close the stream; their layout is checked before
+    // anything is written to the region.
+    std::vector<char> reserved(header.reserved_blocks * header.block_size);
+    std::streamoff blocks_begin = in.tellg();
+    in.seekg(blocks_begin + static_cast<std::streamoff>(header.changed_blocks *
+                                                        (sizeof(std::uint64_t) + header.block_size)));
+    in.read(reserved.data(), static_cast<std::streamsize>(reserved.size()));
+    if (!in || reserved.size() < sizeof(Metadata)) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Truncated incremental file: {}", in_file));
+    }
+    Metadata exported{};
+    std::memcpy(&exported, reserved.data(), sizeof(exported));
+    if (exported.magic != magic_number() || exported.version != layout_version()) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("{} holds a region of layout version {}, this build reads {}", in_file,
+                        exported.version, layout_version()));
+    }
+    in.seekg(blocks_begin);
+
+    bool full = header.from_checkpoint == 0;
+    std::fstream region;
+    if (full) {
+        region.open(region_file, std::ios::binary | std::ios::in |
+                                     std::ios::out | std::ios::trunc);
+    } else {
+        region.open(region_file, std::ios::binary | std::ios::in | std::ios::out);
+    }
+    if (!region) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Failed to open region file: {}", region_file));
+    }
+
+    if (!full) {
+        Metadata meta{};
+        region.read(reinterpret_cast<char *>(&meta), sizeof(meta));
+        if (region && meta.magic == magic_number() && meta.version != layout_version()) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("Region {} has layout version {}, this build reads {}", region_file,
+                            meta.version, layout_version()));
+        }
+        if (!region || meta.magic != magic_number() ||
+            meta.checkpoint_id != header.from_checkpoint ||
+            meta.block_size != header.block_size ||
+            meta.block_count != header.block_count) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("Region {} is not at checkpoint {}",
+                            region_file, header.from_checkpoint));
+        }
     }
+
+    std::vector<char> block(header.block_size);
+    for (std::uint64_t i = 0; i < header.changed_blocks; ++i) {
+        std::uint64_t block_idx = 0;
+        in.read(reinterpret_cast<char *>(&block_idx), sizeof(block_idx));
+        in.read(block.data(), static_cast<std::streamsize>(block.size()));
+        if (!in || block_idx >= header.block_count) [[unlikely]] {
+            throw std::runtime_error(
+                std::format("Truncated incremental file: {}", in_file));
+        }
+
+        region.seekp(static_cast<std::streamoff>(block_idx * header.block_size));
+        region.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }
+
+    // Extend a freshly created file to the full region before the metadata
+    // lands, so a reader never sees a valid header on a short file.
+    if (full && header.block_count > header.reserved_blocks) {
+        char zero = 0;
+        region.seekp(static_cast<std::streamoff>(
+            header.block_count * header.block_size - 1));
+        region.write(&zero, 1);
+    }
+
+    region.seekp(0);
+    region.write(reserved.data(), static_cast<std::streamsize>(reserved.size()));
+    region.flush();
+    if (!region) [[unlikely]] {
+        throw std::runtime_error(
+            std::format("Failed to write region file: {}", region_file));
+    }
+
+    return header.to_checkpoint;
 }
 
 [[nodiscard]] void *Manager::offset_to_ptr(std::uint64_t offset) noexcept {
@@ -280,26 +870,192 @@ void Manager::free_block(std::uint64_t offset) {
     return block_count_;
 }
 
+[[nodiscard]] std::size_t Manager::reserved_blocks() const noexcept {
+    return reserved_blocks_;
+}
+
+[[nodiscard]] std::size_t Manager::allocated_blocks() const {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    return allocated_blocks_;
+}
+
+void Manager::pin_block(std::uint64_t offset) {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    pinned_.push_back(offset);
+}
+
+void Manager::unpin_block(std::uint64_t offset) {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    if (auto it = std::ranges::find(pinned_, offset); it != pinned_.end())
+        pinned_.erase(it);
+}
+
+void Manager::exchange_pinned_blocks(std::vector<std::uint64_t> &blocks, std::size_t handed_out,
+                                     std::size_t n) {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    if (!blocks.empty()) {
+        std::vector<std::uint64_t> sorted = blocks;
+        std::ranges::sort(sorted);
+        std::erase_if(pinned_, [&](std::uint64_t offset) {
+            return std::ranges::binary_search(sorted, offset);
+        });
+        for (std::size_t i = handed_out; i < blocks.size(); ++i)
+            free_block_locked(blocks[i]);
+        blocks.clear();
+    }
+
+    // First-fit like alloc_block, resuming the scan where the last block
+    // was found. A partial batch is kept if the region runs out.
+    std::size_t word = 0;
+    try {
+        while (blocks.size() < n) {
+            blocks.push_back(alloc_block_locked(word));
+            word = blocks.back() / block_size_ / 64;
+        }
+    } catch (const std::runtime_error &) {
+        if (blocks.empty())
+            throw;
+    }
+    pinned_.insert(pinned_.end(), blocks.begin(), blocks.end());
+}
+
+[[nodiscard]] std::uint64_t Manager::alloc_block_group() {
+    std::size_t first_block = 0;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex_);
+        // Only words whose 64 blocks all exist; reserved blocks keep the
+        // first words busy.
+        std::size_t words = block_count_ / blocks_per_group;
+        std::size_t i = 0;
+        while (i < words && bitmap_[i] != 0)
+            ++i;
+        if (i == words) [[unlikely]]
+            throw std::runtime_error("Out of memory (no free block group)");
+
+        bitmap_[i] = ~0ULL;
+        xor_into_checksum(std::rotl(~0ULL, 1));
+        allocated_blocks_ += blocks_per_group;
+        first_block = i * blocks_per_group;
+        for (std::size_t b = 0; b < blocks_per_group; ++b)
+            pinned_.push_back((first_block + b) * block_size_);
+    }
+
+    // The blocks are the caller's now, so their old contents can be
+    // cleared outside the lock.
+    std::uint64_t offset = first_block * block_size_;
+    std::size_t len = blocks_per_group * block_size_;
+    std::uint64_t delta = 0;
+    for (std::size_t b = first_block; b < first_block + blocks_per_group; ++b) {
+        delta ^= block_folds_[b];
+        block_folds_[b] = 0;
+    }
+    persist_nt(offset_to_ptr(offset), nullptr, len);
+    xor_into_checksum(delta);
+    mark_dirty(offset, len);
+    return offset;
+}
+
+void Manager::unpin_block_group(std::uint64_t offset) {
+    std::uint64_t end = offset + blocks_per_group * block_size_;
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    std::erase_if(pinned_, [&](std::uint64_t pinned) { return pinned >= offset && pinned < end; });
+}
+
+void Manager::free_block_group(std::uint64_t offset) {
+    unpin_block_group(offset);
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    for (std::size_t b = 0; b < blocks_per_group; ++b)
+        free_block_locked(offset + b * block_size_);
+}
+
+[[nodiscard]] std::vector<std::uint64_t> Manager::pinned_blocks() const {
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    return pinned_;
+}
+
 [[nodiscard]] std::uint64_t *Manager::get_bitmap() noexcept {
     return bitmap_;
 }
 
+Manager::BitmapRebuild Manager::rebuild_bitmap(const std::vector<std::uint64_t> &live,
+                                               unsigned threads) {
+    if (live.size() < bitmap_size_words_) [[unlikely]] {
+        throw std::runtime_error(std::format("Live set of {} words is smaller than the {} word bitmap",
+                                             live.size(), bitmap_size_words_));
+    }
+    threads = static_cast<unsigned>(std::clamp<std::size_t>(bitmap_size_words_ / 64, 1,
+                                                            std::max(threads, 1u)));
+
+    struct Slice {
+        std::uint64_t delta = 0;
+        std::size_t freed = 0;
+        std::size_t restored = 0;
+    };
+    std::vector<Slice> slices(threads);
+    std::size_t per_thread = (bitmap_size_words_ + threads - 1) / threads;
+
+    std::lock_guard<std::mutex> lock(alloc_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    run_parallel(threads, [&](unsigned t) {
+        Slice &slice = slices[t];
+        std::size_t end = std::min(bitmap_size_words_, (t + 1) * per_thread);
+        for (std::size_t i = t * per_thread; i < end; ++i) {
+            std::uint64_t word = bitmap_[i];
+            // Bits past the last block are left as they are.
+            std::uint64_t valid = i + 1 < bitmap_size_words_ || block_count_ % 64 == 0
+                                      ? ~0ULL
+                                      : (1ULL << (block_count_ % 64)) - 1;
+            std::uint64_t target = (live[i] & valid) | (word & ~valid);
+            if (target == word)
+                continue;
+            slice.delta ^= std::rotl(word, 1) ^ std::rotl(target, 1);
+            slice.restored += static_cast<std::size_t>(std::popcount(target & ~word));
+            if (std::uint64_t gone = word & ~target; gone != 0) {
+                slice.freed += static_cast<std::size_t>(std::popcount(gone));
+                pending_release_[i] |= gone;
+                freed_at_[i] = now;
+            }
+            bitmap_[i] = target;
+        }
+        if (end > t * per_thread)
+            persist(bitmap_ + t * per_thread, (end - t * per_thread) * sizeof(std::uint64_t));
+    });
+
+    BitmapRebuild result{0, 0};
+    std::uint64_t delta = 0;
+    for (const Slice &slice : slices) {
+        delta ^= slice.delta;
+        result.restored += slice.restored;
+        result.freed += slice.freed;
+    }
+    xor_into_checksum(delta);
+    allocated_blocks_ = allocated_blocks_ + result.restored - result.freed;
+    return result;
+}
+
 void Manager::print_telemetry(double ops_per_sec, double latency_us) {
     std::uint64_t rss = get_real_rss();
-    std::uint64_t logical_writes =
-        static_cast<std::uint64_t>(ops_per_sec * 16.0);
+    const char *tree_type = (metadata_->flags & Metadata::flag_leaves_only)
+                                ? "B+ Tree (leaves only)"
+                                : "B+ Tree";
 
     std::cout << std::format(
-                     R"({{"type": "metric", "ops": {}, "latency": {}, "mem_used": {}, "physical_writes": {}, "logical_writes": {}, "allocated_blocks": {}, "treeType": "B+ Tree", "consistency": "Shadow Paging", "version": "1.1.0", "integrity": "{}", "region_kb": {}, "block_size": {}}})",
+                     R"({{"type": "metric", "ops": {}, "latency": {}, "mem_used": {}, "physical_writes": {}, "logical_writes": {}, "allocated_blocks": {}, "treeType": "{}", "consistency": "Shadow Paging", "version": "1.1.0", "integrity": "{}", "region_kb": {}, "block_size": {}, "file_logical_bytes": {}, "file_physical_bytes": {}, "punched_bytes": {}, "checkpoint_id": {}, "dirty_blocks": {}}})",
                      ops_per_sec,
                      latency_us,
                      rss,
-                     total_persisted_bytes,
-                     logical_writes,
-                     allocated_blocks_,
+                     total_persisted_bytes.load(std::memory_order_relaxed),
+                     total_logical_bytes.load(std::memory_order_relaxed),
+                     allocated_blocks(),
+                     tree_type,
                      (verify_integrity() ? "PASSED" : "FAILED"),
                      (region_size_ / 1024),
-                     block_size_)
+                     block_size_,
+                     logical_file_size(),
+                     physical_file_size(),
+                     punched_bytes(),
+                     metadata_->checkpoint_id,
+                     dirty_block_count())
               << std::endl;
 
     std::string hex_data;
@@ -338,48 +1094,116 @@ void Manager::print_telemetry(double ops_per_sec, double latency_us) {
         static_cast<const std::uint64_t *>(base_);
     std::size_t words = region_size_ / sizeof(std::uint64_t);
 
-    for (std::size_t i = 0; i < words; ++i) {
-        if (ptr + i == &metadata_->checksum) [[unlikely]]
-            continue;
+    // The dirty bitmap is backup bookkeeping, not tree state; leave it out so
+    // marking a block does not invalidate the region checksum, and likewise
+    // the checksum and its stale flag. Folding the ranges on either side of
+    // the skipped words keeps the loops branch-free.
+    static_assert(offsetof(Metadata, checksum_stale) ==
+                  offsetof(Metadata, checksum) + sizeof(std::uint64_t));
+    std::size_t checksum_idx = static_cast<std::size_t>(&metadata_->checksum - ptr);
+    std::size_t dirty_begin = static_cast<std::size_t>(dirty_bitmap_ - ptr);
+    std::size_t dirty_end = dirty_begin + bitmap_size_words_;
 
-        std::uint64_t val = ptr[i];
-        checksum ^= std::rotl(val, 1);
-    }
+    auto fold = [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+            checksum ^= std::rotl(ptr[i], 1);
+    };
+    fold(0, checksum_idx);
+    fold(checksum_idx + 2, dirty_begin);
+    fold(dirty_end, words);
 
     return checksum;
 }
 
-[[nodiscard]] std::uint32_t calculate_node_checksum(const void *data,
-                                                    std::size_t len) noexcept {
-    const std::uint8_t *byte_ptr =
-        static_cast<const std::uint8_t *>(data);
-    std::uint32_t crc = 0xFFFFFFFF;
+[[nodiscard]] std::uint64_t Manager::fold_block(std::size_t block_idx) const noexcept {
+    const auto *words = reinterpret_cast<const std::uint64_t *>(
+        static_cast<const std::uint8_t *>(base_) + block_idx * block_size_);
+    std::uint64_t fold = 0;
+    for (std::size_t i = 0; i < block_size_ / sizeof(std::uint64_t); ++i)
+        fold ^= std::rotl(words[i], 1);
+    return fold;
+}
 
-    for (std::size_t i = 0; i < len; ++i) {
-        if (i >= 5 && i < 9) [[unlikely]]
-            continue;
+void Manager::refresh_block_folds() noexcept {
+    block_folds_.assign(block_count_, 0);
+    for (std::size_t i = reserved_blocks_; i < block_count_; ++i)
+        block_folds_[i] = fold_block(i);
+}
 
-        crc ^= byte_ptr[i];
-        for (int j = 0; j < 8; ++j) {
-            crc = (crc >> 1) ^ (0xEDB88320 & (-(crc & 1)));
-        }
-    }
+// Stays in DRAM: the region's copy is brought up to date by sync_checksum,
+// and the stale flag tells the next open to rebuild it if that never came.
+void Manager::xor_into_checksum(std::uint64_t delta) noexcept {
+    checksum_deltas_[checksum_stripe(checksum_stripes)].delta.fetch_xor(
+        delta, std::memory_order_relaxed);
+}
+
+[[nodiscard]] std::uint64_t Manager::pending_checksum() const noexcept {
+    std::uint64_t pending = 0;
+    for (const ChecksumStripe &stripe : checksum_deltas_)
+        pending ^= stripe.delta.load(std::memory_order_relaxed);
+    return pending;
+}
 
-    return ~crc;
+void Manager::sync_checksum() noexcept {
+    std::uint64_t pending = 0;
+    for (ChecksumStripe &stripe : checksum_deltas_)
+        pending ^= stripe.delta.exchange(0, std::memory_order_relaxed);
+    std::atomic_ref<std::uint64_t>(metadata_->checksum)
+        .fetch_xor(pending, std::memory_order_relaxed);
+    _mm_clflush(&metadata_->checksum);
+    _mm_sfence();
 }
 
 void Manager::update_persistent_checksum() {
+    refresh_block_folds();
+    for (ChecksumStripe &stripe : checksum_deltas_)
+        stripe.delta.store(0, std::memory_order_relaxed);
     metadata_->checksum = calculate_checksum();
     _mm_clflush(&metadata_->checksum);
     _mm_sfence();
 }
 
+// The checksum is an xor of rotated words, so swapping a block's old fold for
+// its new one is exact and commutes with other writers' updates.
+void Manager::update_block_checksum(std::uint64_t offset) noexcept {
+    std::size_t block_idx = static_cast<std::size_t>(offset / block_size_);
+    if (block_idx < reserved_blocks_ || block_idx >= block_count_) [[unlikely]]
+        return;
+
+    std::uint64_t fold = fold_block(block_idx);
+    xor_into_checksum(block_folds_[block_idx] ^ fold);
+    block_folds_[block_idx] = fold;
+}
+
+void Manager::fold_new_bytes(std::uint64_t offset, const void *src, std::size_t len) noexcept {
+    const auto *bytes = static_cast<const std::uint8_t *>(src);
+    std::uint64_t delta = 0;
+    while (len >= sizeof(std::uint64_t)) {
+        std::size_t block_idx = static_cast<std::size_t>(offset / block_size_);
+        std::size_t n = std::min<std::size_t>(len, (block_idx + 1) * block_size_ - offset);
+        std::uint64_t fold = 0;
+        for (std::size_t i = 0; i + sizeof(std::uint64_t) <= n; i += sizeof(std::uint64_t)) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            fold ^= std::rotl(word, 1);
+        }
+        if (block_idx >= reserved_blocks_ && block_idx < block_count_) [[likely]] {
+            block_folds_[block_idx] ^= fold;
+            delta ^= fold;
+        }
+        offset += n;
+        bytes += n;
+        len -= n;
+    }
+    xor_into_checksum(delta);
+}
+
 [[nodiscard]] bool Manager::verify_integrity() const noexcept {
     if (!base_ || metadata_->magic != magic_number()) [[unlikely]]
         return false;
 
     std::uint64_t current = calculate_checksum();
-    return (current == metadata_->checksum);
+    return (current == (metadata_->checksum ^ pending_checksum()));
 }
 
 } // namespace atomic_tree
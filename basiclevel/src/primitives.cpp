@@ -2,17 +2,23 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 
 #ifdef _WIN32
 #    include <windows.h>
+#else
+#    include <pthread.h>
+#    include <sched.h>
 #endif
 
 namespace atomic_tree {
 
-std::uint64_t total_persisted_bytes = 0;
+std::atomic<std::uint64_t> total_persisted_bytes{0};
+std::atomic<std::uint64_t> total_flushed_lines{0};
+std::atomic<std::uint64_t> total_logical_bytes{0};
 
 void pmem_flush(void *addr, std::size_t len) {
-    total_persisted_bytes += len;
+    total_persisted_bytes.fetch_add(len, std::memory_order_relaxed);
 
     // Align down to 64-byte cache line.
     char *ptr = reinterpret_cast<char *>(
@@ -21,9 +27,12 @@ void pmem_flush(void *addr, std::size_t len) {
 
     char *end = static_cast<char *>(addr) + len;
 
+    std::uint64_t lines = 0;
     for (; ptr < end; ptr += 64) {
         _mm_clflush(ptr);
+        ++lines;
     }
+    total_flushed_lines.fetch_add(lines, std::memory_order_relaxed);
 }
 
 void pmem_fence() noexcept {
@@ -58,4 +67,52 @@ void atomic_pointer_swap(std::uint64_t *addr,
 #endif
 }
 
+void persist_nt(void *dst, const void *src, std::size_t len) noexcept {
+    stream_nt(dst, src, len);
+    _mm_sfence();
+}
+
+void stream_nt(void *dst, const void *src, std::size_t len) noexcept {
+    total_persisted_bytes.fetch_add(len, std::memory_order_relaxed);
+    auto *d = static_cast<std::uint8_t *>(dst);
+    const auto *s = static_cast<const std::uint8_t *>(src);
+
+    // 16-byte streaming stores need a 16-byte aligned target; the odd word
+    // at either end goes out as two 4-byte ones.
+    auto stream_word = [&](std::size_t at) {
+        std::uint32_t halves[2] = {0, 0};
+        if (s)
+            std::memcpy(halves, s + at, sizeof(halves));
+        _mm_stream_si32(reinterpret_cast<int *>(d + at), static_cast<int>(halves[0]));
+        _mm_stream_si32(reinterpret_cast<int *>(d + at + 4), static_cast<int>(halves[1]));
+    };
+    std::size_t i = 0;
+    if ((reinterpret_cast<std::uintptr_t>(d) & 15) != 0 && len >= 8) {
+        stream_word(0);
+        i = 8;
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = s ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i))
+                      : _mm_setzero_si128();
+        _mm_stream_si128(reinterpret_cast<__m128i *>(d + i), v);
+    }
+    if (i + 8 <= len)
+        stream_word(i);
+}
+
+bool pin_thread_to_cpu(unsigned cpu) noexcept {
+#ifdef _WIN32
+    if (cpu >= 64) [[unlikely]]
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << cpu) != 0;
+#else
+    if (cpu >= CPU_SETSIZE) [[unlikely]]
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
 } // namespace atomic_tree
@@ -0,0 +1,187 @@
+#include "simd_search.h"
+
+#include <atomic>
+#include <cstdint>
+#include <bit>
+#include <immintrin.h>
+
+namespace atomic_tree {
+
+namespace {
+
+// Keys are sorted, so everything left of lo is <= key and everything from hi
+// on is > key. Halving down to a 32-key window keeps wide nodes (256 keys)
+// at a handful of cache lines; the window is then counted without branches.
+constexpr std::uint32_t rank_window = 32;
+
+template <typename T, typename CountLe>
+std::uint32_t narrowed_rank(const T *keys, std::uint32_t count, T key,
+                            CountLe count_le) noexcept {
+    std::uint32_t lo = 0;
+    std::uint32_t hi = count;
+    while (hi - lo > rank_window) {
+        std::uint32_t mid = lo + (hi - lo) / 2;
+        if (keys[mid] <= key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo + count_le(keys + lo, hi - lo, key);
+}
+
+template <typename T>
+std::uint32_t count_le_scalar(const T *keys, std::uint32_t n, T key) noexcept {
+    std::uint32_t rank = 0;
+    for (std::uint32_t i = 0; i < n; ++i)
+        rank += keys[i] <= key;
+    return rank;
+}
+
+template <typename T>
+std::uint32_t rank_scalar(const T *keys, std::uint32_t count, T key) noexcept {
+    return narrowed_rank(keys, count, key, count_le_scalar<T>);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#    define ATOMIC_TREE_HAS_AVX2_DISPATCH 1
+
+// Unsigned lanes are compared as signed after flipping the sign bit.
+__attribute__((target("avx2")))
+std::uint32_t count_le_avx2_32(const std::uint32_t *keys, std::uint32_t n,
+                               std::uint32_t key, std::uint32_t bias) noexcept {
+    const __m256i flip = _mm256_set1_epi32(static_cast<int>(bias));
+    const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), flip);
+    std::uint32_t greater = 0;
+    std::uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i lane = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), flip);
+        auto mask = static_cast<unsigned>(
+            _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lane, needle))));
+        greater += static_cast<std::uint32_t>(std::popcount(mask));
+    }
+
+    std::uint32_t rank = i - greater;
+    for (; i < n; ++i)
+        rank += static_cast<std::int32_t>(keys[i] ^ bias) <= static_cast<std::int32_t>(key ^ bias);
+    return rank;
+}
+
+__attribute__((target("avx2")))
+std::uint32_t count_le_avx2_64(const std::uint64_t *keys, std::uint32_t n,
+                               std::uint64_t key, std::uint64_t bias) noexcept {
+    const __m256i flip = _mm256_set1_epi64x(static_cast<long long>(bias));
+    const __m256i needle =
+        _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), flip);
+    std::uint32_t greater = 0;
+    std::uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i lane = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), flip);
+        auto mask = static_cast<unsigned>(
+            _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(lane, needle))));
+        greater += static_cast<std::uint32_t>(std::popcount(mask));
+    }
+
+    std::uint32_t rank = i - greater;
+    for (; i < n; ++i)
+        rank += static_cast<std::int64_t>(keys[i] ^ bias) <= static_cast<std::int64_t>(key ^ bias);
+    return rank;
+}
+
+template <typename T>
+std::uint32_t rank_avx2(const T *keys, std::uint32_t count, T key) noexcept {
+    constexpr bool is_signed = static_cast<T>(-1) < T{0};
+    if constexpr (sizeof(T) == 4) {
+        constexpr std::uint32_t bias = is_signed ? 0 : 0x80000000u;
+        return narrowed_rank(keys, count, key, [](const T *k, std::uint32_t n, T v) {
+            return count_le_avx2_32(reinterpret_cast<const std::uint32_t *>(k), n,
+                                    static_cast<std::uint32_t>(v), bias);
+        });
+    } else {
+        constexpr std::uint64_t bias = is_signed ? 0 : 0x8000000000000000ull;
+        return narrowed_rank(keys, count, key, [](const T *k, std::uint32_t n, T v) {
+            return count_le_avx2_64(reinterpret_cast<const std::uint64_t *>(k), n,
+                                    static_cast<std::uint64_t>(v), bias);
+        });
+    }
+}
+
+bool cpu_has_avx2() noexcept {
+    return __builtin_cpu_supports("avx2");
+}
+#else
+bool cpu_has_avx2() noexcept {
+    return false;
+}
+#endif
+
+template <typename T>
+using RankFn = std::uint32_t (*)(const T *, std::uint32_t, T) noexcept;
+
+struct RankTable {
+    RankFn<std::int32_t>  i32;
+    RankFn<std::uint32_t> u32;
+    RankFn<std::int64_t>  i64;
+    RankFn<std::uint64_t> u64;
+    bool                  simd;
+};
+
+RankTable make_rank_table(bool simd) noexcept {
+#ifdef ATOMIC_TREE_HAS_AVX2_DISPATCH
+    if (simd && cpu_has_avx2()) {
+        return {rank_avx2<std::int32_t>, rank_avx2<std::uint32_t>,
+                rank_avx2<std::int64_t>, rank_avx2<std::uint64_t>, true};
+    }
+#else
+    (void)simd;
+#endif
+    return {rank_scalar<std::int32_t>, rank_scalar<std::uint32_t>,
+            rank_scalar<std::int64_t>, rank_scalar<std::uint64_t>, false};
+}
+
+// Both tables are built once at startup. Lookups on every thread read the
+// active one through an atomic pointer, so a toggle swaps whole tables and
+// no reader sees a mix of the two.
+const RankTable scalar_table = make_rank_table(false);
+const RankTable best_table = make_rank_table(true);
+std::atomic<const RankTable *> rank_table{&best_table};
+
+const RankTable &active_table() noexcept {
+    return *rank_table.load(std::memory_order_acquire);
+}
+
+} // namespace
+
+[[nodiscard]] std::uint32_t separator_rank(const std::int32_t *keys, std::uint32_t count,
+                                           std::int32_t key) noexcept {
+    return active_table().i32(keys, count, key);
+}
+
+[[nodiscard]] std::uint32_t separator_rank(const std::uint32_t *keys, std::uint32_t count,
+                                           std::uint32_t key) noexcept {
+    return active_table().u32(keys, count, key);
+}
+
+[[nodiscard]] std::uint32_t separator_rank(const std::int64_t *keys, std::uint32_t count,
+                                           std::int64_t key) noexcept {
+    return active_table().i64(keys, count, key);
+}
+
+[[nodiscard]] std::uint32_t separator_rank(const std::uint64_t *keys, std::uint32_t count,
+                                           std::uint64_t key) noexcept {
+    return active_table().u64(keys, count, key);
+}
+
+bool enable_simd_separator_search(bool enabled) noexcept {
+    const RankTable *table = enabled ? &best_table : &scalar_table;
+    rank_table.store(table, std::memory_order_release);
+    return table->simd;
+}
+
+[[nodiscard]] bool simd_separator_search_enabled() noexcept {
+    return active_table().simd;
+}
+
+} // namespace atomic_tree
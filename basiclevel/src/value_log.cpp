@@ -0,0 +1,217 @@
+#include "value_log.h"
+#include "crc32c.h"
+#include "manager.h"
+#include "primitives.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace atomic_tree {
+
+namespace {
+
+constexpr std::uint64_t inline_handle(std::string_view value) noexcept {
+    std::uint64_t handle = 1 | static_cast<std::uint64_t>(value.size()) << 1;
+    for (std::size_t i = 0; i < value.size(); ++i)
+        handle |= std::uint64_t{static_cast<std::uint8_t>(value[i])} << (8 * (i + 1));
+    return handle;
+}
+
+} // namespace
+
+ValueLog::ValueLog(Manager *manager, std::size_t key_size)
+    : manager_(manager),
+      key_size_(key_size),
+      key_bytes_((key_size + 7) & ~std::size_t{7}),
+      segment_bytes_(Manager::blocks_per_group * manager->block_size()),
+      head_(0),
+      head_used_(0),
+      filled_(manager->block_count() / Manager::blocks_per_group),
+      live_(manager->block_count() / Manager::blocks_per_group),
+      in_flight_(manager->block_count() / Manager::blocks_per_group),
+      appended_bytes_(0),
+      segments_compacted_(0),
+      records_moved_(0),
+      compaction_errors_(0) {}
+
+// Segments are never resumed after a reopen; the head's unused tail counts
+// as dead space once a later log holds it.
+ValueLog::~ValueLog() {
+    if (head_ != 0)
+        manager_->unpin_block_group(head_);
+}
+
+[[nodiscard]] std::uint64_t ValueLog::append(const void *key, std::string_view value) {
+    if (value.size() <= max_inline)
+        return inline_handle(value);
+
+    std::size_t size = record_size(value.size());
+    if (value.size() > max_value_length || size > segment_bytes_) [[unlikely]] {
+        throw std::runtime_error(std::format("Value of {} bytes does not fit a {} byte log segment",
+                                             value.size(), segment_bytes_));
+    }
+
+    // Header and key, then the value's whole words straight from the
+    // caller, then its last partial word padded with zeros.
+    std::array<std::uint8_t, 256> prefix{};
+    std::size_t prefix_bytes = header_bytes + key_bytes_;
+    std::vector<std::uint8_t> long_prefix;
+    std::uint8_t *head = prefix.data();
+    if (prefix_bytes > prefix.size()) [[unlikely]] {
+        long_prefix.resize(prefix_bytes);
+        head = long_prefix.data();
+    }
+    std::uint32_t header[2] = {static_cast<std::uint32_t>(value.size()),
+                               record_crc(key, value.data(), value.size())};
+    std::memcpy(head, header, sizeof(header));
+    std::memcpy(head + header_bytes, key, key_size_);
+    std::size_t body = value.size() & ~std::size_t{7};
+    std::uint64_t last = 0;
+    std::memcpy(&last, value.data() + body, value.size() - body);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (head_ == 0 || head_used_ + size > segment_bytes_) {
+        std::uint64_t segment = manager_->alloc_block_group();
+        if (head_ != 0)
+            manager_->unpin_block_group(head_);
+        head_ = segment;
+        head_used_ = 0;
+    }
+
+    // One stream in three pieces, made durable by a single fence.
+    std::uint64_t offset = head_ + head_used_;
+    auto put = [&](std::uint64_t at, const void *src, std::size_t len) {
+        stream_nt(manager_->offset_to_ptr(at), src, len);
+        manager_->fold_new_bytes(at, src, len);
+    };
+    put(offset, head, prefix_bytes);
+    put(offset + prefix_bytes, value.data(), body);
+    if (body < value.size())
+        put(offset + prefix_bytes + body, &last, sizeof(last));
+    pmem_fence();
+    manager_->mark_dirty(offset, size);
+    head_used_ += size;
+
+    std::size_t index = segment_index(offset);
+    filled_[index].fetch_add(size, std::memory_order_relaxed);
+    live_[index].fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed);
+    in_flight_[index].fetch_add(1, std::memory_order_relaxed);
+    appended_bytes_.fetch_add(size, std::memory_order_relaxed);
+    return offset | static_cast<std::uint64_t>(value.size()) << 40;
+}
+
+void ValueLog::settle(std::uint64_t handle) noexcept {
+    if (!is_inline(handle))
+        in_flight_[segment_index(record_offset(handle))].fetch_sub(1, std::memory_order_release);
+}
+
+// A handle taken from the tree may be torn by a concurrent writer or name
+// a segment freed since, so nothing in it is trusted before it is checked
+// against the record.
+[[nodiscard]] bool ValueLog::read(std::uint64_t handle, const void *key, std::string &out) const {
+    std::size_t length = value_length(handle);
+    if (is_inline(handle)) {
+        out.resize(length);
+        for (std::size_t i = 0; i < length; ++i)
+            out[i] = static_cast<char>(handle >> (8 * (i + 1)));
+        return true;
+    }
+
+    std::uint64_t offset = record_offset(handle);
+    std::size_t size = record_size(length);
+    if (offset == 0 || offset % 8 != 0 || length <= max_inline ||
+        offset + size > manager_->region_size()) [[unlikely]]
+        return false;
+
+    const auto *record = static_cast<const std::uint8_t *>(manager_->base()) + offset;
+    std::uint32_t header[2];
+    std::memcpy(header, record, sizeof(header));
+    if (header[0] != length || std::memcmp(record + header_bytes, key, key_size_) != 0)
+        return false;
+    out.assign(reinterpret_cast<const char *>(record + header_bytes + key_bytes_), length);
+    return record_crc(key, out.data(), length) == header[1];
+}
+
+void ValueLog::release(std::uint64_t handle) noexcept {
+    if (is_inline(handle))
+        return;
+    std::size_t index = segment_index(record_offset(handle));
+    if (index < live_.size()) [[likely]]
+        live_[index].fetch_sub(static_cast<std::int64_t>(record_size(value_length(handle))),
+                               std::memory_order_relaxed);
+}
+
+void ValueLog::count_live(std::uint64_t handle) noexcept {
+    if (is_inline(handle))
+        return;
+    std::size_t index = segment_index(record_offset(handle));
+    if (index >= live_.size()) [[unlikely]]
+        return;
+    filled_[index].store(segment_bytes_, std::memory_order_relaxed);
+    live_[index].fetch_add(static_cast<std::int64_t>(record_size(value_length(handle))),
+                           std::memory_order_relaxed);
+}
+
+// The head is read under the lock, so every append into a sealed segment
+// has bumped its in-flight count before the check below.
+[[nodiscard]] std::vector<std::uint64_t> ValueLog::compaction_candidates(double min_dead_share) const {
+    std::uint64_t head;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        head = head_;
+    }
+
+    std::vector<std::uint64_t> segments;
+    for (std::size_t i = 0; i < filled_.size(); ++i) {
+        std::uint64_t segment = i * segment_bytes_;
+        std::uint64_t filled = filled_[i].load(std::memory_order_relaxed);
+        if (filled == 0 || segment == head ||
+            in_flight_[i].load(std::memory_order_acquire) != 0)
+            continue;
+        auto live = static_cast<std::uint64_t>(
+            std::clamp<std::int64_t>(live_[i].load(std::memory_order_relaxed), 0,
+                                     static_cast<std::int64_t>(filled)));
+        if (static_cast<double>(filled - live) >= min_dead_share * static_cast<double>(filled))
+            segments.push_back(segment);
+    }
+    return segments;
+}
+
+void ValueLog::free_segment(std::uint64_t segment) {
+    std::size_t index = segment_index(segment);
+    filled_[index].store(0, std::memory_order_relaxed);
+    live_[index].store(0, std::memory_order_relaxed);
+    manager_->free_block_group(segment);
+    segments_compacted_.fetch_add(1, std::memory_order_relaxed);
+}
+
+[[nodiscard]] ValueLogStats ValueLog::stats() const {
+    ValueLogStats stats{};
+    for (std::size_t i = 0; i < filled_.size(); ++i) {
+        std::uint64_t filled = filled_[i].load(std::memory_order_relaxed);
+        if (filled == 0)
+            continue;
+        auto live = static_cast<std::uint64_t>(
+            std::clamp<std::int64_t>(live_[i].load(std::memory_order_relaxed), 0,
+                                     static_cast<std::int64_t>(filled)));
+        stats.segments++;
+        stats.live_bytes += live;
+        stats.dead_bytes += filled - live;
+    }
+    stats.appended_bytes = appended_bytes_.load(std::memory_order_relaxed);
+    stats.segments_compacted = segments_compacted_.load(std::memory_order_relaxed);
+    stats.records_moved = records_moved_.load(std::memory_order_relaxed);
+    stats.compaction_errors = compaction_errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace atomic_tree
@@ -0,0 +1,122 @@
+#include "var_key.h"
+#include "manager.h"
+#include "primitives.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+
+namespace atomic_tree {
+
+namespace {
+
+VarKey make_key(std::string_view bytes, std::uint64_t tail_word) noexcept {
+    VarKey key{};
+    std::memcpy(key.head.data(), bytes.data(), std::min(bytes.size(), VarKey::inline_bytes));
+    key.word = static_cast<std::uint64_t>(bytes.size()) & 0xFFFF;
+    if (bytes.size() > VarKey::inline_bytes)
+        key.word |= tail_word;
+    return key;
+}
+
+} // namespace
+
+[[nodiscard]] VarKey VarKey::lookup(std::string_view bytes) noexcept {
+    if (bytes.size() <= inline_bytes)
+        return make_key(bytes, 0);
+    auto tail = reinterpret_cast<std::uintptr_t>(bytes.data() + inline_bytes);
+    return make_key(bytes, dram_tail | static_cast<std::uint64_t>(tail) << 16);
+}
+
+[[nodiscard]] VarKey VarKey::stored(std::string_view bytes, std::uint64_t tail_offset) noexcept {
+    if (bytes.size() <= inline_bytes)
+        return make_key(bytes, 0);
+    std::uint8_t hash = hash_tail(bytes.data() + inline_bytes, bytes.size() - inline_bytes);
+    return make_key(bytes, tail_offset << 24 | std::uint64_t{hash} << 16);
+}
+
+VarKeyLess::VarKeyLess(Manager *manager) noexcept
+    : base_(static_cast<const std::byte *>(manager->base())),
+      region_size_(manager->region_size()) {}
+
+[[nodiscard]] VarKey VarKeyLess::separator(const VarKey &left,
+                                           const VarKey &right) const noexcept {
+    // Bytes the two keys share; padding past a short key's end may match
+    // too, so the count is capped at the shorter length.
+    std::size_t limit = std::min(left.length(), right.length());
+    auto common = static_cast<std::size_t>(std::countl_zero(head_word(left) ^ head_word(right)) / 8);
+    if (common == VarKey::inline_bytes && limit > VarKey::inline_bytes) {
+        const std::uint8_t *a = tail(left);
+        const std::uint8_t *b = tail(right);
+        while (common < limit && a[common - VarKey::inline_bytes] == b[common - VarKey::inline_bytes])
+            ++common;
+    }
+    std::size_t length = std::min(common, limit) + 1;
+    if (length >= right.length())
+        return right;
+
+    VarKey sep = right;
+    if (length <= VarKey::inline_bytes) {
+        std::fill(sep.head.begin() + static_cast<std::ptrdiff_t>(length), sep.head.end(), 0);
+        sep.word = length;
+    } else {
+        std::uint8_t hash = VarKey::hash_tail(tail(right), length - VarKey::inline_bytes);
+        sep.word = (right.word & ~std::uint64_t{0xFFFFFF}) | std::uint64_t{hash} << 16 | length;
+    }
+    return sep;
+}
+
+KeyHeap::KeyHeap(Manager *manager) noexcept
+    : manager_(manager), block_(0), used_(0), blocks_allocated_(0) {}
+
+KeyHeap::~KeyHeap() {
+    if (block_ != 0)
+        manager_->unpin_block(block_);
+}
+
+[[nodiscard]] std::uint64_t KeyHeap::append(std::string_view bytes) {
+    std::size_t block_size = manager_->block_size();
+    if (bytes.size() > block_size) [[unlikely]] {
+        throw std::runtime_error(std::format("Key tail of {} bytes does not fit a {} byte block",
+                                             bytes.size(), block_size));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (block_ == 0 || used_ + bytes.size() > block_size) {
+        std::uint64_t block = manager_->alloc_block();
+        manager_->pin_block(block);
+        if (block_ != 0)
+            manager_->unpin_block(block_);
+        block_ = block;
+        used_ = 0;
+        blocks_allocated_++;
+    }
+
+    std::uint64_t offset = block_ + used_;
+    if (offset > VarKey::max_tail_offset) [[unlikely]]
+        throw std::runtime_error(std::format("Key tail at offset {} is past the {} byte limit",
+                                             offset, VarKey::max_tail_offset));
+    void *dst = manager_->offset_to_ptr(offset);
+    std::memcpy(dst, bytes.data(), bytes.size());
+    persist(dst, bytes.size());
+    manager_->mark_dirty(offset, bytes.size());
+    manager_->update_block_checksum(block_);
+    used_ += bytes.size();
+    return offset;
+}
+
+[[nodiscard]] std::size_t KeyHeap::blocks_allocated() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_allocated_;
+}
+
+// The tree type behind VarKeyBTree<>, compiled once like those in B_tree.cpp.
+template class BasicBTree<VarKey, std::uint64_t, VarKeyLess>;
+
+} // namespace atomic_tree
@@ -0,0 +1,27 @@
+#include "manager.h"
+
+#include <exception>
+#include <iostream>
+
+// Replays export_incremental streams onto a closed region file, in order:
+//   apply_incremental <region file> <full export> [<incremental> ...]
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0]
+                  << " <region file> <export> [<export> ...]\n";
+        return 2;
+    }
+
+    try {
+        for (int i = 2; i < argc; ++i) {
+            std::uint64_t checkpoint =
+                atomic_tree::Manager::apply_incremental(argv[i], argv[1]);
+            std::cout << argv[i] << " -> checkpoint " << checkpoint << '\n';
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}